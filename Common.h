@@ -13,6 +13,7 @@
 #include <cctype>
 #include <unordered_map>
 #include <fstream>
+#include <memory>
 
 class SimulatorError
 {
@@ -0,0 +1,286 @@
+//   File: ControlFlow.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "ControlFlow.h"
+#include "Simulator.h"
+
+#include <algorithm>
+#include <sstream>
+
+// What an instruction does to the program counter.
+enum Flow
+{
+    FLOW_NEXT,          // Goes on to the next word.
+    FLOW_BRANCH,        // To target or the next word.
+    FLOW_JUMP,          // To target.
+    FLOW_CALL,          // To target, returning to the next word.
+    FLOW_RETURN,        // jr $ra
+    FLOW_INDIRECT,      // jr through any other register.
+    FLOW_INDIRECT_CALL, // jalr
+    FLOW_STOP           // Does not decode.
+};
+
+// target is a word index, which may be past the text if the
+// instruction leaves it.
+static Flow flow_of(const uint8_t instruction, const uint32_t word, const uint32_t i,
+                    const uint32_t text_start, uint32_t & target)
+{
+    switch (instruction)
+    {
+        case BEQ:
+        case BNE:
+        case BGTZ:
+        case BLEZ:
+        case BGEZ:
+        case BLTZ:
+        {
+            // Relative to the branch itself, as the simulator runs it.
+            int16_t distance = (word & 0xffff) << 2;
+            target = i + distance / 4;
+            return FLOW_BRANCH;
+        }
+        case J:
+        case JAL:
+            target = (((word & 0x3ffffff) << 2) - text_start) >> 2;
+            return (instruction == J ? FLOW_JUMP : FLOW_CALL);
+        case JR:
+            return (((word >> 21) & 0b11111) == 31 ? FLOW_RETURN : FLOW_INDIRECT);
+        case JALR:
+            return FLOW_INDIRECT_CALL;
+        default:
+            return (instruction >= TOTAL_INSTRUCTIONS ? FLOW_STOP : FLOW_NEXT);
+    }
+}
+
+ControlFlowGraph::ControlFlowGraph(const ProgramImage & image, const uint32_t text_start) :
+    text_start_(text_start),
+    text_size_(image.text_size())
+{
+    const uint32_t * text = image.text_words();
+    const uint8_t * decoded = image.decoded_words();
+    uint32_t n = text_size_;
+    if (n == 0)
+        return;
+
+    // Text labels name functions and start blocks, computed jumps
+    // (jr $t0) may go to any of them.
+    std::unordered_map< uint32_t, std::string > names;
+    std::vector< char > leader(n, false);
+    leader[0] = true;
+    for (const std::pair< const std::string, uint32_t > & label : image.labels)
+    {
+        uint32_t i = (label.second - text_start) >> 2;
+        if (label.second < text_start || i >= n)
+            continue;
+        leader[i] = true;
+        std::unordered_map< uint32_t, std::string >::iterator it = names.find(i);
+        if (it == names.end() || label.first < it->second)
+            names[i] = label.first;
+    }
+
+    uint32_t entry = (image.entrypoint - text_start) >> 2;
+    if (image.entrypoint >= text_start && entry < n)
+        leader[entry] = true;
+
+    std::vector< uint32_t > call_targets;
+    for (uint32_t i = 0; i < n; ++i)
+    {
+        uint32_t target = NONE;
+        Flow flow = flow_of(decoded[i], text[i], i, text_start, target);
+        if (flow == FLOW_NEXT)
+            continue;
+        if (target < n)
+            leader[target] = true;
+        if (flow == FLOW_CALL && target < n)
+            call_targets.push_back(target);
+        if (i + 1 < n)
+            leader[i + 1] = true;
+    }
+
+    for (uint32_t i = 0; i < n; ++i)
+        if (leader[i])
+        {
+            if (!blocks_.empty())
+                blocks_.back().end = i;
+            blocks_.push_back({ i, n, {}, {}, NONE, false, false });
+        }
+
+    // Edges, from how each block ends.
+    for (uint32_t b = 0; b < blocks_.size(); ++b)
+    {
+        BasicBlock & block = blocks_[b];
+        uint32_t last = block.end - 1;
+        uint32_t target = NONE;
+        Flow flow = flow_of(decoded[last], text[last], last, text_start, target);
+        bool falls_through = (flow == FLOW_NEXT || flow == FLOW_BRANCH || flow == FLOW_CALL
+                              || flow == FLOW_INDIRECT_CALL);
+
+        if ((flow == FLOW_BRANCH || flow == FLOW_JUMP) && target < n)
+            block.successors.push_back(block_at(target));
+        if (falls_through && block.end < n
+            && std::find(block.successors.begin(), block.successors.end(), b + 1) == block.successors.end())
+            block.successors.push_back(b + 1);
+        if (flow == FLOW_CALL && target < n)
+            calls_.push_back(std::make_pair(b, block_at(target)));
+        block.indirect = (flow == FLOW_INDIRECT || flow == FLOW_INDIRECT_CALL);
+    }
+    for (uint32_t b = 0; b < blocks_.size(); ++b)
+        for (uint32_t s : blocks_[b].successors)
+            blocks_[s].predecessors.push_back(b);
+
+    // The entrypoint comes first, then the functions by address.
+    std::sort(call_targets.begin(), call_targets.end());
+    call_targets.erase(std::unique(call_targets.begin(), call_targets.end()), call_targets.end());
+    std::vector< uint32_t > entries;
+    if (image.entrypoint >= text_start && entry < n)
+        entries.push_back(block_at(entry));
+    for (uint32_t target : call_targets)
+        if (entries.empty() || block_at(target) != entries[0])
+            entries.push_back(block_at(target));
+    find_functions(entries, names);
+
+    return;
+}
+
+// Give each function the blocks reachable from its entry, without
+// going into another function's entry, and find its loops.
+void ControlFlowGraph::find_functions(const std::vector< uint32_t > & entries,
+                                      const std::unordered_map< uint32_t, std::string > & names)
+{
+    std::vector< uint32_t > function_of_entry(blocks_.size(), NONE);
+    for (uint32_t f = 0; f < entries.size(); ++f)
+        function_of_entry[entries[f]] = f;
+
+    // 0 unvisited, 1 on the search stack, 2 done.
+    std::vector< uint8_t > state(blocks_.size(), 0);
+    for (uint32_t f = 0; f < entries.size(); ++f)
+    {
+        Function function;
+        uint32_t entry = entries[f];
+        uint32_t start = blocks_[entry].start;
+        std::unordered_map< uint32_t, std::string >::const_iterator name = names.find(start);
+        function.name = (name != names.end() ? name->second : address(start));
+        function.entry = entry;
+        function.start = start;
+        function.end = blocks_[entry].end;
+
+        // Depth first, keeping the next successor to try for each block
+        // on the stack.
+        std::vector< std::pair< uint32_t, uint32_t > > stack;
+        if (state[entry] == 0)
+        {
+            state[entry] = 1;
+            stack.push_back(std::make_pair(entry, 0));
+        }
+        while (!stack.empty())
+        {
+            uint32_t b = stack.back().first;
+            uint32_t & next = stack.back().second;
+            if (next == 0)
+            {
+                blocks_[b].function = f;
+                function.blocks.push_back(b);
+                function.start = std::min(function.start, blocks_[b].start);
+                function.end = std::max(function.end, blocks_[b].end);
+            }
+
+            if (next < blocks_[b].successors.size())
+            {
+                uint32_t s = blocks_[b].successors[next++];
+                if (function_of_entry[s] != NONE && function_of_entry[s] != f)
+                    continue;
+                if (state[s] == 1)
+                    blocks_[s].loop_header = true;
+                else if (state[s] == 0)
+                {
+                    state[s] = 1;
+                    stack.push_back(std::make_pair(s, 0));
+                }
+            }
+            else
+            {
+                state[b] = 2;
+                stack.pop_back();
+            }
+        }
+
+        std::sort(function.blocks.begin(), function.blocks.end());
+        functions_.push_back(function);
+    }
+
+    for (const std::pair< uint32_t, uint32_t > & call : calls_)
+    {
+        uint32_t caller = blocks_[call.first].function;
+        uint32_t callee = function_of_entry[call.second];
+        if (caller == NONE || callee == NONE)
+            continue;
+        functions_[caller].callees.push_back(callee);
+        functions_[callee].callers.push_back(caller);
+    }
+    for (Function & function : functions_)
+    {
+        std::sort(function.callees.begin(), function.callees.end());
+        function.callees.erase(std::unique(function.callees.begin(), function.callees.end()),
+                               function.callees.end());
+        std::sort(function.callers.begin(), function.callers.end());
+        function.callers.erase(std::unique(function.callers.begin(), function.callers.end()),
+                               function.callers.end());
+    }
+
+    return;
+}
+
+uint32_t ControlFlowGraph::block_at(const uint32_t i) const
+{
+    if (i >= text_size_)
+        return NONE;
+
+    std::vector< BasicBlock >::const_iterator it
+        = std::upper_bound(blocks_.begin(), blocks_.end(), i,
+                           [](const uint32_t w, const BasicBlock & block) { return w < block.start; });
+
+    return (it - blocks_.begin()) - 1;
+}
+
+std::string ControlFlowGraph::address(const uint32_t i) const
+{
+    std::ostringstream ss;
+    ss << "0x" << std::hex << std::setfill('0') << std::setw(8) << text_start_ + 4 * i;
+
+    return ss.str();
+}
+
+void ControlFlowGraph::write_dot(std::ostream & os) const
+{
+    auto node = [&](const uint32_t b)
+    {
+        const BasicBlock & block = blocks_[b];
+        os << "    b" << b << " [label=\"" << address(block.start) << " - " << address(block.end - 1)
+           << (block.indirect ? "\\nindirect" : "") << "\"" << (block.loop_header ? ", style=bold" : "")
+           << "];\n";
+    };
+
+    os << "digraph cfg {\n"
+       << "    node [shape=box, fontname=\"monospace\"];\n";
+    for (uint32_t f = 0; f < functions_.size(); ++f)
+    {
+        os << "  subgraph cluster_" << f << " {\n"
+           << "    label=\"" << functions_[f].name << "\";\n";
+        for (uint32_t b : functions_[f].blocks)
+            node(b);
+        os << "  }\n";
+    }
+    for (uint32_t b = 0; b < blocks_.size(); ++b)
+        if (blocks_[b].function == NONE)
+            node(b);
+
+    for (uint32_t b = 0; b < blocks_.size(); ++b)
+        for (uint32_t s : blocks_[b].successors)
+            os << "    b" << b << " -> b" << s << ";\n";
+    for (const std::pair< uint32_t, uint32_t > & call : calls_)
+        os << "    b" << call.first << " -> b" << call.second << " [style=dashed];\n";
+    os << "}\n";
+
+    return;
+}
@@ -0,0 +1,85 @@
+//   File: ControlFlow.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef CONTROL_FLOW_H
+#define CONTROL_FLOW_H
+
+#include "Common.h"
+#include "ProgramImage.h"
+
+/*
+  The basic blocks of a program's text and the functions they make up,
+  worked out from the encoded instructions alone:
+    - blocks start at the entrypoint, at text labels, at branch and
+      jump targets and after every branch, jump or jr,
+    - functions start at the entrypoint and at every jal target, and
+      are made of the blocks reachable from there without following
+      calls or returns (jr $ra),
+    - loop headers are the targets of back edges found searching each
+      function from its entry.
+  Jumps through registers other than $ra (jr $t0, jalr) have no known
+  target, their blocks are marked indirect.
+*/
+
+struct BasicBlock
+{
+    uint32_t start; // First word, as an index into the text.
+    uint32_t end;   // One past the last word.
+    std::vector< uint32_t > successors;
+    std::vector< uint32_t > predecessors;
+    uint32_t function; // ControlFlowGraph::NONE if no function reaches it.
+    bool loop_header;
+    bool indirect;
+};
+
+struct Function
+{
+    std::string name; // Label at its entry, or the entry's address.
+    uint32_t entry;   // Block.
+    uint32_t start;   // Words from the first to the last of its blocks,
+    uint32_t end;     // which may leave gaps.
+    std::vector< uint32_t > blocks;
+    std::vector< uint32_t > callees; // Functions.
+    std::vector< uint32_t > callers;
+};
+
+class ControlFlowGraph
+{
+public:
+    static const uint32_t NONE = 0xffffffff;
+
+    ControlFlowGraph(const ProgramImage & image, const uint32_t text_start);
+
+    const std::vector< BasicBlock > & blocks() const
+    { return blocks_; }
+    const std::vector< Function > & functions() const
+    { return functions_; }
+
+    // Block the i'th word of text is in, NONE past the end of the text.
+    uint32_t block_at(const uint32_t i) const;
+    bool block_starts(const uint32_t i) const
+    { return block_at(i) != NONE && blocks_[block_at(i)].start == i; }
+
+    // Function the i'th word of text belongs to, NONE if it is not
+    // reachable from any.
+    uint32_t function_at(const uint32_t i) const
+    { return block_at(i) == NONE ? NONE : blocks_[block_at(i)].function; }
+
+    // Graphviz: one cluster per function, calls drawn dashed.
+    void write_dot(std::ostream & os) const;
+
+private:
+    uint32_t text_start_;
+    uint32_t text_size_;
+    std::vector< BasicBlock > blocks_;
+    std::vector< Function > functions_;
+    std::vector< std::pair< uint32_t, uint32_t > > calls_; // Calling block, callee.
+
+    void find_functions(const std::vector< uint32_t > & entries,
+                        const std::unordered_map< uint32_t, std::string > & names);
+
+    std::string address(const uint32_t i) const;
+};
+
+#endif
@@ -0,0 +1,419 @@
+//   File: Daemon.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "Daemon.h"
+#include "MappedFile.h"
+
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <endian.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static bool write_all(const int fd, const char * p, size_t n)
+{
+    while (n > 0)
+    {
+        ssize_t written = send(fd, p, n, MSG_NOSIGNAL);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            return false;
+        p += written;
+        n -= written;
+    }
+
+    return true;
+}
+
+// Everything up to the end of the stream, false if it fails first or
+// is longer than limit.
+static bool read_all(const int fd, std::string & s, const size_t limit = SIZE_MAX)
+{
+    char buffer[64 * 1024];
+    while (true)
+    {
+        ssize_t n = read(fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n == 0)
+            return true;
+        if (n < 0 || s.size() + n > limit)
+            return false;
+        s.append(buffer, n);
+    }
+}
+
+static void write_frame(const int fd, const char type, const std::string & bytes)
+{
+    uint32_t length = htole32(bytes.size());
+    char header[5];
+    header[0] = type;
+    std::memcpy(header + 1, &length, 4);
+    if (write_all(fd, header, sizeof(header)))
+        write_all(fd, bytes.data(), bytes.size());
+
+    return;
+}
+
+static sockaddr_un socket_address(const std::string & socket_path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+        throw SimulatorError("Socket path \"" + socket_path + "\" is too long.");
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    return address;
+}
+
+std::shared_ptr< const ProgramImage > ProgramCache::get(const std::vector< std::string > & filenames)
+{
+    // Names and contents, so a hit is never a different program.
+    std::string key;
+    for (const std::string & filename : filenames)
+    {
+        MappedFile file(filename);
+        key += filename;
+        key.push_back('\0');
+        key += std::to_string(file.size());
+        key.push_back('\0');
+        key.append((const char *)(file.data()), file.size());
+    }
+
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    for (char c : key)
+        hash = (hash ^ uint8_t(c)) * 1099511628211ull;
+
+    {
+        std::lock_guard< std::mutex > lock(mutex_);
+        auto range = by_hash_.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second->key != key)
+                continue;
+            if (!unchanged(it->second->dependencies))
+            {
+                entries_.erase(it->second);
+                by_hash_.erase(it);
+                break;
+            }
+            entries_.splice(entries_.begin(), entries_, it->second);
+            ++hits_;
+            return entries_.front().image;
+        }
+        ++misses_;
+    }
+
+    // Assembled without the lock, so other programs are not held up.
+    Simulator sim;
+    if (filenames.size() == 1)
+        sim.load_file(filenames[0]);
+    else
+        sim.assemble_files(filenames);
+    std::shared_ptr< const ProgramImage > image = sim.program_image();
+
+    // Stat after assembling, so a file written meanwhile is at worst
+    // assembled again next time.
+    std::vector< Dependency > dependencies;
+    for (const std::string & filename : image->incbin_files)
+    {
+        struct stat st;
+        if (stat(filename.c_str(), &st) != 0)
+            return image;
+        dependencies.push_back(Dependency{ filename, st.st_size, st.st_mtim });
+    }
+
+    std::lock_guard< std::mutex > lock(mutex_);
+    entries_.push_front(Entry{ hash, key, image, dependencies });
+    by_hash_.insert(std::make_pair(hash, entries_.begin()));
+    while (entries_.size() > capacity_)
+    {
+        auto range = by_hash_.equal_range(entries_.back().hash);
+        for (auto it = range.first; it != range.second; ++it)
+            if (it->second == std::prev(entries_.end()))
+            {
+                by_hash_.erase(it);
+                break;
+            }
+        entries_.pop_back();
+    }
+
+    return image;
+}
+
+bool ProgramCache::unchanged(const std::vector< Dependency > & dependencies)
+{
+    for (const Dependency & dependency : dependencies)
+    {
+        struct stat st;
+        if (stat(dependency.filename.c_str(), &st) != 0 || st.st_size != dependency.size
+            || st.st_mtim.tv_sec != dependency.modified.tv_sec
+            || st.st_mtim.tv_nsec != dependency.modified.tv_nsec)
+            return false;
+    }
+
+    return true;
+}
+
+Daemon::Daemon(const std::string & socket_path, const unsigned int threads,
+               const std::string & result_cache_directory) :
+    socket_path_(socket_path),
+    listen_fd_(-1),
+    programs_(DAEMON_CACHE_PROGRAMS),
+    stopping_(false)
+{
+    if (result_cache_directory != "")
+        results_.reset(new ResultCache(result_cache_directory));
+
+    sockaddr_un address = socket_address(socket_path);
+
+    // A client that goes away before its reply is not an error.
+    signal(SIGPIPE, SIG_IGN);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(socket_path.c_str());
+    if (listen_fd_ < 0 || bind(listen_fd_, (sockaddr *)(&address), sizeof(address)) != 0
+        || listen(listen_fd_, SOMAXCONN) != 0)
+    {
+        if (listen_fd_ >= 0)
+            close(listen_fd_);
+        throw SimulatorError("Unable to listen on \"" + socket_path + "\".");
+    }
+
+    unsigned int n = (threads == 0 ? std::thread::hardware_concurrency() : threads);
+    for (unsigned int i = 0; i < std::max(n, 1u); ++i)
+        workers_.push_back(std::thread(&Daemon::run_worker, this));
+}
+
+Daemon::~Daemon()
+{
+    {
+        std::lock_guard< std::mutex > lock(queue_mutex_);
+        stopping_ = true;
+    }
+    queue_ready_.notify_all();
+    for (std::thread & worker : workers_)
+        worker.join();
+
+    for (int fd : queue_)
+        close(fd);
+    close(listen_fd_);
+    unlink(socket_path_.c_str());
+}
+
+void Daemon::run()
+{
+    while (true)
+    {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            throw SimulatorError("Daemon failed to accept a connection.");
+        }
+
+        // For the reply as well, a client that does not read it only
+        // holds its worker this long.
+        timeval timeout = { DAEMON_TIMEOUT_SECONDS, 0 };
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+        {
+            std::lock_guard< std::mutex > lock(queue_mutex_);
+            queue_.push_back(fd);
+        }
+        queue_ready_.notify_one();
+    }
+}
+
+void Daemon::run_worker()
+{
+    while (true)
+    {
+        int fd;
+        {
+            std::unique_lock< std::mutex > lock(queue_mutex_);
+            queue_ready_.wait(lock, [&]() { return stopping_ || !queue_.empty(); });
+            if (stopping_)
+                return;
+            fd = queue_.front();
+            queue_.pop_front();
+        }
+
+        serve(fd);
+        close(fd);
+    }
+}
+
+void Daemon::serve(const int fd)
+{
+    std::string request;
+    if (!read_all(fd, request, DAEMON_MAX_REQUEST))
+    {
+        write_frame(fd, 'e', "Request too large or not finished in time.");
+        write_frame(fd, 'x', std::string("\1\0\0\0", 4));
+        return;
+    }
+    if (request == "stats\n")
+    {
+        uint64_t hits = programs_.hits();
+        uint64_t misses = programs_.misses();
+        std::string stats = "Program cache: " + std::to_string(hits) + " hits, "
+            + std::to_string(misses) + " misses ("
+            + std::to_string(hits + misses == 0 ? 0 : hits * 100 / (hits + misses)) + "% hit rate).\n"
+            + (results_ ? results_->report() : "Result cache: off.") + "\n";
+        write_frame(fd, 'o', stats);
+        write_frame(fd, 'x', std::string("\0\0\0\0", 4));
+        return;
+    }
+
+    // The file count, then a file per line.
+    std::vector< std::string > filenames;
+    size_t at = request.find('\n');
+    unsigned long count = std::strtoul(request.c_str(), nullptr, 10);
+    while (at != std::string::npos && filenames.size() < count)
+    {
+        size_t end = request.find('\n', at + 1);
+        if (end == std::string::npos)
+            break;
+        filenames.push_back(request.substr(at + 1, end - at - 1));
+        at = end;
+    }
+    if (at == std::string::npos || count == 0 || filenames.size() != count)
+    {
+        write_frame(fd, 'e', "Malformed request.");
+        write_frame(fd, 'x', std::string("\1\0\0\0", 4));
+        return;
+    }
+
+    std::unique_ptr< Simulator > sim;
+    {
+        std::lock_guard< std::mutex > lock(idle_mutex_);
+        if (!idle_.empty())
+        {
+            sim = std::move(idle_.back());
+            idle_.pop_back();
+        }
+    }
+    if (!sim)
+        sim.reset(new Simulator());
+
+    RunRecord record;
+    try
+    {
+        sim->reset(programs_.get(filenames));
+        record = run_with_cache(*sim, request.substr(at + 1), results_.get(),
+                                DAEMON_MAX_INSTRUCTIONS, DAEMON_MAX_OUTPUT);
+    }
+    catch (SimulatorError & e)
+    {
+        record.error = e.what();
+    }
+    catch (std::exception & e)
+    {
+        record.error = std::string("Invalid argument to function: ") + e.what();
+    }
+    int32_t status = (record.error == "" ? record.exit_status : 1);
+
+    write_frame(fd, 'o', record.output);
+    if (record.error != "")
+        write_frame(fd, 'e', record.error);
+    uint32_t code = htole32(uint32_t(status));
+    write_frame(fd, 'x', std::string((const char *)(&code), 4));
+
+    std::lock_guard< std::mutex > lock(idle_mutex_);
+    idle_.push_back(std::move(sim));
+
+    return;
+}
+
+// Send request, print the reply and return the exit status in it.
+static int exchange(const std::string & socket_path, const std::string & request)
+{
+    sockaddr_un address = socket_address(socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (sockaddr *)(&address), sizeof(address)) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        throw SimulatorError("No daemon is listening on \"" + socket_path + "\".");
+    }
+    write_all(fd, request.data(), request.size());
+    shutdown(fd, SHUT_WR);
+    std::string reply;
+    bool complete = read_all(fd, reply);
+    close(fd);
+    if (!complete)
+        throw SimulatorError("Lost the connection to the daemon.");
+
+    int status = 1;
+    size_t at = 0;
+    while (at + 5 <= reply.size())
+    {
+        uint32_t length;
+        std::memcpy(&length, reply.data() + at + 1, 4);
+        length = le32toh(length);
+        if (at + 5 + length > reply.size())
+            break;
+
+        const char * p = reply.data() + at + 5;
+        if (reply[at] == 'o')
+            std::cout.write(p, length);
+        else if (reply[at] == 'e')
+            std::cout << std::string(p, length) << std::endl;
+        else if (reply[at] == 'x' && length == 4)
+        {
+            uint32_t code;
+            std::memcpy(&code, p, 4);
+            status = int32_t(le32toh(code));
+        }
+        at += 5 + length;
+    }
+    std::cout.flush();
+
+    return status;
+}
+
+int submit_to_daemon(const std::string & socket_path, const std::vector< std::string > & filenames,
+                     const std::string & input_filename)
+{
+    // The daemon runs elsewhere, it needs whole paths.
+    std::string request = std::to_string(filenames.size()) + "\n";
+    for (const std::string & filename : filenames)
+    {
+        char path[PATH_MAX];
+        if (realpath(filename.c_str(), path) == nullptr)
+            throw SimulatorError("Unable to open file \"" + filename + "\".");
+        request += std::string(path) + "\n";
+    }
+
+    // Read through rather than mapped, so a pipe is sent whole.
+    int input_fd = STDIN_FILENO;
+    if (input_filename != "")
+    {
+        input_fd = open(input_filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if (input_fd < 0)
+            throw SimulatorError("Unable to open input file \"" + input_filename + "\".");
+    }
+    bool read = read_all(input_fd, request);
+    if (input_fd != STDIN_FILENO)
+        close(input_fd);
+    if (!read)
+        throw SimulatorError("Unable to read the program's input.");
+
+    return exchange(socket_path, request);
+}
+
+int daemon_stats(const std::string & socket_path)
+{
+    return exchange(socket_path, "stats\n");
+}
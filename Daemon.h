@@ -0,0 +1,145 @@
+//   File: Daemon.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "Common.h"
+#include "Simulator.h"
+#include "ResultCache.h"
+
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+
+/*
+  A long-lived simulator that runs programs sent to it over a Unix
+  socket, so short runs pay for neither starting a process nor, for a
+  program it has seen before, assembling it:
+    - assembled programs are kept by the contents of their files (the
+      DAEMON_CACHE_PROGRAMS used last), so an edited file is assembled
+      again and an unchanged one never is. Files they .incbin are
+      checked by size and modification time,
+    - simulators are kept once created and reset between runs, which
+      only gives back the pages the last run touched.
+
+  A request is the number of files on a line, each file's absolute
+  path on a line, then the program's whole input up to the end of the
+  stream. A request has to arrive within DAEMON_TIMEOUT_SECONDS and be
+  at most DAEMON_MAX_REQUEST bytes, so a client that never finishes
+  one cannot hold a worker. The reply is a series of frames, a type byte and a
+  little-endian uint32_t length followed by that many bytes:
+    'o'  what the program printed,
+    'e'  why it failed, if it did,
+    'x'  its exit status (int32_t), always last.
+  A request of just "stats" on a line is answered with how often each
+  cache has been hit, in an 'o' frame.
+
+  A run is stopped after DAEMON_MAX_INSTRUCTIONS, or once it has printed
+  DAEMON_MAX_OUTPUT bytes (which are sent), with an 'e' frame saying
+  so, so a program that never exits cannot keep a worker either.
+
+  Given a result cache, a program run before on the same input is
+  answered from it without running (see ResultCache.h).
+*/
+
+const unsigned int DAEMON_CACHE_PROGRAMS = 64;
+const unsigned int DAEMON_TIMEOUT_SECONDS = 10;
+const size_t DAEMON_MAX_REQUEST = 64 * 1024 * 1024;
+const uint64_t DAEMON_MAX_INSTRUCTIONS = 500000000;
+const size_t DAEMON_MAX_OUTPUT = 16 * 1024 * 1024;
+
+// Assembled programs by the names and contents of their files.
+class ProgramCache
+{
+public:
+    ProgramCache(const unsigned int capacity) :
+        capacity_(capacity),
+        hits_(0),
+        misses_(0)
+    {}
+
+    // The program made of these files, assembled now unless their
+    // contents are the same as when it was last.
+    std::shared_ptr< const ProgramImage > get(const std::vector< std::string > & filenames);
+
+    uint64_t hits() const
+    { return hits_; }
+    uint64_t misses() const
+    { return misses_; }
+
+private:
+    // A file the program .incbin'd, as it was when it was assembled.
+    struct Dependency
+    {
+        std::string filename;
+        off_t size;
+        timespec modified;
+    };
+
+    struct Entry
+    {
+        uint64_t hash;
+        std::string key;
+        std::shared_ptr< const ProgramImage > image;
+        std::vector< Dependency > dependencies;
+    };
+
+    static bool unchanged(const std::vector< Dependency > & dependencies);
+
+    unsigned int capacity_;
+    std::mutex mutex_;
+    std::list< Entry > entries_; // Most recently used first.
+    std::unordered_multimap< uint64_t, std::list< Entry >::iterator > by_hash_;
+    uint64_t hits_;
+    uint64_t misses_;
+};
+
+class Daemon
+{
+public:
+    // threads = 0 picks one per core. Results are cached in
+    // result_cache_directory, unless it is empty.
+    Daemon(const std::string & socket_path, const unsigned int threads,
+           const std::string & result_cache_directory);
+    ~Daemon();
+
+    Daemon(const Daemon &) = delete;
+    Daemon & operator=(const Daemon &) = delete;
+
+    // Serve requests, forever.
+    void run();
+
+private:
+    std::string socket_path_;
+    int listen_fd_;
+    ProgramCache programs_;
+    std::unique_ptr< ResultCache > results_;
+
+    // Simulators not running anything.
+    std::mutex idle_mutex_;
+    std::vector< std::unique_ptr< Simulator > > idle_;
+
+    // Connections waiting for a worker.
+    std::mutex queue_mutex_;
+    std::condition_variable queue_ready_;
+    std::deque< int > queue_;
+    bool stopping_;
+    std::vector< std::thread > workers_;
+
+    void run_worker();
+    void serve(const int fd);
+};
+
+// Send a request to the daemon listening on socket_path, printing what
+// it replies. Returns the program's exit status, 1 if it failed.
+int submit_to_daemon(const std::string & socket_path, const std::vector< std::string > & filenames,
+                     const std::string & input_filename);
+
+// Print the hit rates of the daemon's caches.
+int daemon_stats(const std::string & socket_path);
+
+#endif
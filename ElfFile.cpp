@@ -0,0 +1,211 @@
+//   File: ElfFile.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "ElfFile.h"
+#include "MappedFile.h"
+
+#include <cstring>
+#include <elf.h>
+#include <endian.h>
+#include <sstream>
+
+static std::string hex_address(const uint32_t addr)
+{
+    std::ostringstream ss;
+    ss << "0x" << std::hex << std::setfill('0') << std::setw(8) << addr;
+
+    return ss.str();
+}
+
+static Elf32_Shdr section_header(const uint8_t * base, const uint64_t offset)
+{
+    Elf32_Shdr sh;
+    std::memcpy(&sh, base + offset, sizeof(sh));
+    sh.sh_name = be32toh(sh.sh_name);
+    sh.sh_type = be32toh(sh.sh_type);
+    sh.sh_flags = be32toh(sh.sh_flags);
+    sh.sh_addr = be32toh(sh.sh_addr);
+    sh.sh_offset = be32toh(sh.sh_offset);
+    sh.sh_size = be32toh(sh.sh_size);
+    sh.sh_link = be32toh(sh.sh_link);
+    sh.sh_info = be32toh(sh.sh_info);
+    sh.sh_addralign = be32toh(sh.sh_addralign);
+    sh.sh_entsize = be32toh(sh.sh_entsize);
+
+    return sh;
+}
+
+// Sections that end up in memory. Notes and the MIPS specific ones
+// (.reginfo, .MIPS.abiflags) only describe the program.
+static bool loaded(const Elf32_Shdr & sh)
+{
+    return (sh.sh_flags & SHF_ALLOC) && sh.sh_size > 0
+        && sh.sh_type != SHT_NOTE && sh.sh_type < SHT_LOPROC;
+}
+
+// beq, bne, blez, bgtz, bltz, bgez
+static bool is_branch(const uint32_t word)
+{
+    uint32_t opcode = word >> 26;
+    uint32_t rt = (word >> 16) & 0b11111;
+
+    return (opcode >= 4 && opcode <= 7) || (opcode == 1 && rt <= 1);
+}
+
+// Branches and jumps, which have a delay slot on real hardware.
+static bool has_delay_slot(const uint32_t word)
+{
+    uint32_t opcode = word >> 26;
+    uint32_t funct = word & 0b111111;
+
+    return is_branch(word) || opcode == 1 || opcode == 2 || opcode == 3
+        || (opcode == 0 && (funct == 8 || funct == 9));
+}
+
+std::shared_ptr< ProgramImage > read_elf_file(const std::string & filename,
+                                              const uint32_t text_start,
+                                              const uint32_t text_bytes,
+                                              const uint32_t data_start,
+                                              const uint32_t data_bytes)
+{
+    MappedFile file(filename);
+    const uint8_t * base = file.data();
+    uint64_t size = file.size();
+    const std::string invalid = "Invalid ELF file \"" + filename + "\".";
+    if (size < sizeof(Elf32_Ehdr))
+        throw SimulatorError(invalid);
+
+    Elf32_Ehdr header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.e_ident, ELFMAG, SELFMAG) != 0)
+        throw SimulatorError(invalid);
+    if (header.e_ident[EI_CLASS] != ELFCLASS32 || header.e_ident[EI_DATA] != ELFDATA2MSB
+        || be16toh(header.e_machine) != EM_MIPS)
+        throw SimulatorError("\"" + filename + "\" is not a 32 bit big-endian MIPS ELF file.");
+    if (be16toh(header.e_type) != ET_EXEC)
+        throw SimulatorError("\"" + filename + "\" is not an executable, link it first.");
+
+    uint64_t shoff = be32toh(header.e_shoff);
+    uint16_t shnum = be16toh(header.e_shnum);
+    if (be16toh(header.e_shentsize) != sizeof(Elf32_Shdr) || shoff + uint64_t(shnum) * sizeof(Elf32_Shdr) > size)
+        throw SimulatorError(invalid);
+
+    std::vector< Elf32_Shdr > sections;
+    for (uint16_t i = 0; i < shnum; ++i)
+        sections.push_back(section_header(base, shoff + i * sizeof(Elf32_Shdr)));
+
+    // Size the segments, every section has to fit in one.
+    uint64_t text_end = text_start;
+    uint64_t data_end = data_start;
+    for (const Elf32_Shdr & sh : sections)
+    {
+        if (!loaded(sh))
+            continue;
+
+        uint64_t addr = sh.sh_addr;
+        uint64_t end = addr + sh.sh_size;
+        if (sh.sh_type != SHT_NOBITS && uint64_t(sh.sh_offset) + sh.sh_size > size)
+            throw SimulatorError(invalid);
+
+        if (sh.sh_flags & SHF_EXECINSTR)
+        {
+            if (addr < text_start || end > uint64_t(text_start) + text_bytes || addr % 4 != 0 || end % 4 != 0)
+                throw SimulatorError("Code at " + hex_address(addr) + " is outside the text segment, link with -Ttext="
+                                     + hex_address(text_start) + ".");
+            text_end = std::max(text_end, end);
+        }
+        else
+        {
+            if (addr < data_start || end > uint64_t(data_start) + data_bytes)
+                throw SimulatorError("Data at " + hex_address(addr) + " is outside the data segment, link with -Tdata="
+                                     + hex_address(data_start) + ".");
+            data_end = std::max(data_end, end);
+        }
+    }
+
+    std::shared_ptr< ProgramImage > image = std::make_shared< ProgramImage >();
+    image->text.assign((text_end - text_start) / 4, 0);
+    image->lines.assign(image->text.size(), 0);
+    image->data.assign(data_end - data_start, 0);
+
+    // The data is big-endian like the simulator's memory, the text has
+    // to be converted to host order.
+    for (const Elf32_Shdr & sh : sections)
+    {
+        if (!loaded(sh) || sh.sh_type == SHT_NOBITS)
+            continue;
+
+        if (sh.sh_flags & SHF_EXECINSTR)
+        {
+            uint32_t * words = image->text.data() + (sh.sh_addr - text_start) / 4;
+            std::memcpy(words, base + sh.sh_offset, sh.sh_size);
+            for (uint32_t i = 0; i < sh.sh_size / 4; ++i)
+                words[i] = be32toh(words[i]);
+        }
+        else
+            std::memcpy(image->data.data() + (sh.sh_addr - data_start), base + sh.sh_offset, sh.sh_size);
+    }
+
+    unsigned int n = image->text.size();
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        uint32_t word = image->text[i];
+        if (has_delay_slot(word) && i + 1 < n && image->text[i + 1] != 0)
+            throw SimulatorError("The delay slot of the branch or jump at " + hex_address(text_start + 4 * i)
+                                 + " is not a nop, the simulator has none (compile with -fno-delayed-branch).");
+
+        // Real branches are relative to the delay slot. The simulator
+        // shifts the offset within 16 bits, so it reaches 0x1fff words
+        // either way.
+        if (is_branch(word))
+        {
+            int32_t offset = int16_t(word & 0xffff) + 1;
+            if (offset > 0x1fff || offset < -0x1fff)
+                throw SimulatorError("The branch at " + hex_address(text_start + 4 * i) + " is out of range.");
+            image->text[i] = (word & 0xffff0000) | uint16_t(offset);
+        }
+    }
+
+    // Defined functions and objects become labels.
+    for (const Elf32_Shdr & sh : sections)
+    {
+        if (sh.sh_type != SHT_SYMTAB || sh.sh_link >= sections.size())
+            continue;
+
+        const Elf32_Shdr & strtab = sections[sh.sh_link];
+        if (uint64_t(sh.sh_offset) + sh.sh_size > size || uint64_t(strtab.sh_offset) + strtab.sh_size > size)
+            throw SimulatorError(invalid);
+        const char * names = (const char *)(base + strtab.sh_offset);
+
+        for (uint32_t offset = 0; offset + sizeof(Elf32_Sym) <= sh.sh_size; offset += sizeof(Elf32_Sym))
+        {
+            Elf32_Sym sym;
+            std::memcpy(&sym, base + sh.sh_offset + offset, sizeof(sym));
+            uint32_t name = be32toh(sym.st_name);
+            uint32_t value = be32toh(sym.st_value);
+            uint32_t type = ELF32_ST_TYPE(sym.st_info);
+            if (name == 0 || name >= strtab.sh_size || be16toh(sym.st_shndx) == SHN_UNDEF
+                || type == STT_SECTION || type == STT_FILE)
+                continue;
+
+            if ((value >= text_start && value < text_end) || (value >= data_start && value < data_end))
+                image->labels[std::string(names + name, strnlen(names + name, strtab.sh_size - name))] = value;
+        }
+    }
+
+    image->entrypoint = be32toh(header.e_entry);
+    image->standard_lui = true;
+    if (image->entrypoint < text_start || image->entrypoint >= text_end)
+        throw SimulatorError("The entry point " + hex_address(image->entrypoint) + " is outside the text segment.");
+
+    return image;
+}
+
+bool is_elf_file(const std::string & filename)
+{
+    char magic[SELFMAG];
+    std::ifstream ifs(filename, std::ifstream::binary);
+
+    return ifs.read(magic, sizeof(magic)) && std::memcmp(magic, ELFMAG, SELFMAG) == 0;
+}
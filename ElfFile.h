@@ -0,0 +1,38 @@
+//   File: ElfFile.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef ELF_FILE_H
+#define ELF_FILE_H
+
+#include "Common.h"
+#include "ProgramImage.h"
+
+/*
+  Executables built by a MIPS32 big-endian toolchain, loaded without
+  going through the assembler. Executables are not relocatable, so
+  they have to be linked for this simulator's memory layout:
+    - the executable sections inside the text segment,
+    - every other allocated section (.rodata, .data, .bss, ...)
+      inside the data segment.
+  For example with -Wl,-Ttext=0x40000,-Tdata=0x10010000 and any
+  read-only data placed in the data segment.
+
+  The simulator has no branch delay slots, so the instruction after a
+  branch or jump has to be a nop (-fno-delayed-branch, or
+  ".set reorder"). Branches are converted to the simulator's encoding,
+  which is relative to the branch itself rather than the delay slot.
+*/
+
+// Read an ELF executable into an image. The text is converted to host
+// byte order but not predecoded, the initial data is in image->data.
+std::shared_ptr< ProgramImage > read_elf_file(const std::string & filename,
+                                              const uint32_t text_start,
+                                              const uint32_t text_bytes,
+                                              const uint32_t data_start,
+                                              const uint32_t data_bytes);
+
+// True if filename starts like an ELF file.
+bool is_elf_file(const std::string & filename);
+
+#endif
@@ -0,0 +1,149 @@
+//   File: GuestInput.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "GuestInput.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+GuestInput::~GuestInput()
+{
+    if (fd_ >= 0)
+        close(fd_);
+}
+
+void GuestInput::open(const std::string & filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw SimulatorError("Unable to open input file \"" + filename + "\".");
+
+    if (fd_ >= 0)
+        close(fd_);
+    fd_ = fd;
+    buffer_.clear();
+    start_ = 0;
+    end_of_file_ = false;
+    pending_.clear();
+    pending_start_ = 0;
+
+    return;
+}
+
+void GuestInput::open_feed()
+{
+    if (fd_ >= 0)
+        close(fd_);
+    fd_ = -1;
+    fed_ = true;
+    buffer_.clear();
+    start_ = 0;
+    end_of_file_ = false;
+    pending_.clear();
+    pending_start_ = 0;
+
+    return;
+}
+
+void GuestInput::feed(const char * p, const size_t n)
+{
+    buffer_.erase(buffer_.begin(), buffer_.begin() + start_);
+    start_ = 0;
+    buffer_.insert(buffer_.end(), p, p + n);
+
+    return;
+}
+
+void GuestInput::end_feed()
+{
+    end_of_file_ = true;
+
+    return;
+}
+
+bool GuestInput::ready() const
+{
+    if (!fed_ || end_of_file_ || pending_start_ < pending_.size())
+        return true;
+
+    return std::memchr(buffer_.data() + start_, '\n', buffer_.size() - start_) != nullptr;
+}
+
+bool GuestInput::read_line(std::string & line)
+{
+    if (pending_start_ < pending_.size())
+    {
+        line.assign(pending_, pending_start_, std::string::npos);
+        pending_start_ = pending_.size();
+        if (!line.empty() && line.back() == '\n')
+            line.pop_back();
+        return true;
+    }
+
+    return next_line(line);
+}
+
+size_t GuestInput::read(char * p, const size_t n)
+{
+    if (pending_start_ == pending_.size())
+    {
+        pending_start_ = 0;
+        if (next_line(pending_))
+            pending_.push_back('\n');
+    }
+
+    size_t count = std::min(n, pending_.size() - pending_start_);
+    std::memcpy(p, pending_.data() + pending_start_, count);
+    pending_start_ += count;
+
+    return count;
+}
+
+bool GuestInput::next_line(std::string & line)
+{
+    if (fd_ < 0 && !fed_)
+    {
+        if (std::getline(std::cin, line))
+            return true;
+        line.clear();
+        return false;
+    }
+
+    while (true)
+    {
+        const char * p = buffer_.data() + start_;
+        size_t n = buffer_.size() - start_;
+        const char * newline = (const char *)(std::memchr(p, '\n', n));
+        if (newline != nullptr)
+        {
+            line.assign(p, newline - p);
+            start_ += newline - p + 1;
+            return true;
+        }
+
+        // The last line may have no newline. Fed input is only read
+        // once ready(), so there is no more to wait for either.
+        if (end_of_file_ || fed_)
+        {
+            line.assign(p, n);
+            start_ = buffer_.size();
+            return n > 0;
+        }
+
+        // Keep the partial line, and read the next block after it.
+        buffer_.erase(buffer_.begin(), buffer_.begin() + start_);
+        start_ = 0;
+        size_t used = buffer_.size();
+        buffer_.resize(used + GUEST_INPUT_BLOCK);
+        ssize_t got;
+        do
+            got = ::read(fd_, buffer_.data() + used, GUEST_INPUT_BLOCK);
+        while (got < 0 && errno == EINTR);
+        buffer_.resize(used + (got > 0 ? got : 0));
+        end_of_file_ = (got <= 0);
+    }
+}
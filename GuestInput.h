@@ -0,0 +1,76 @@
+//   File: GuestInput.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef GUEST_INPUT_H
+#define GUEST_INPUT_H
+
+#include "Common.h"
+
+/*
+  Where the program reads its input (syscalls 5 and 8) from, a line at
+  a time. By default that is std::cin, which the interactive menu
+  reads its commands from as well. An input file is instead read in
+  blocks of GUEST_INPUT_BLOCK bytes, lines are cut straight out of the
+  block.
+
+  A session (see SessionServer.h) instead feeds input in as it arrives.
+  Reading never waits for it then, ready() says whether a read can be
+  answered yet.
+*/
+
+const unsigned int GUEST_INPUT_BLOCK = 64 * 1024;
+
+class GuestInput
+{
+public:
+    GuestInput() :
+        fd_(-1),
+        start_(0),
+        end_of_file_(false),
+        fed_(false),
+        pending_start_(0)
+    {}
+
+    ~GuestInput();
+
+    GuestInput(const GuestInput &) = delete;
+    GuestInput & operator=(const GuestInput &) = delete;
+
+    // Read from a file instead of std::cin.
+    void open(const std::string & filename);
+
+    // Take input from feed() from here on, end_feed() once there is no
+    // more.
+    void open_feed();
+    void feed(const char * p, const size_t n);
+    void end_feed();
+
+    // A whole line (or the end of the input) is there to read. Always
+    // true unless input is fed.
+    bool ready() const;
+
+    // The next line, without its newline. False (and an empty line)
+    // once the input has run out.
+    bool read_line(std::string & line);
+
+    // Up to n bytes, at most through the end of the next line (with its
+    // newline). The rest of the line is kept for the next read. Returns
+    // 0 once the input has run out.
+    size_t read(char * p, const size_t n);
+
+private:
+    int fd_;
+    std::vector< char > buffer_;
+    size_t start_; // Start of the unread part of buffer_.
+    bool end_of_file_;
+    bool fed_;
+
+    // A line read() has only handed out part of.
+    std::string pending_;
+    size_t pending_start_;
+
+    bool next_line(std::string & line);
+};
+
+#endif
@@ -0,0 +1,183 @@
+//   File: GuestOutput.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "GuestOutput.h"
+
+#include <cerrno>
+#include <fcntl.h>
+
+GuestOutput::~GuestOutput()
+{
+    flush();
+    if (writer_.joinable())
+    {
+        {
+            std::lock_guard< std::mutex > lock(mutex_);
+            stopping_ = true;
+        }
+        filled_.notify_one();
+        writer_.join();
+    }
+    if (owned_)
+        close(fd_);
+}
+
+void GuestOutput::flush()
+{
+    // Nothing is written ahead of what the writer still holds, and
+    // the writer is idle once it is done, so the rest is simply
+    // written from here.
+    wait_for_writer(head_.load(std::memory_order_relaxed));
+    flush_cout();
+    write_out(buffer_.data(), buffer_.size());
+    buffer_.clear();
+
+    return;
+}
+
+void GuestOutput::open(const std::string & filename)
+{
+    int fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw SimulatorError("Unable to open output file \"" + filename + "\".");
+
+    // The writer is idle after a flush, and only looks at fd_ for
+    // buffers handed to it after this.
+    flush();
+    if (owned_)
+        close(fd_);
+    fd_ = fd;
+    owned_ = true;
+
+    return;
+}
+
+void GuestOutput::set_fd(const int fd)
+{
+    flush();
+    if (owned_)
+        close(fd_);
+    fd_ = fd;
+    owned_ = false;
+
+    return;
+}
+
+void GuestOutput::capture()
+{
+    set_fd(-1);
+    captured_.clear();
+
+    return;
+}
+
+std::string GuestOutput::take_captured()
+{
+    flush();
+    std::string output;
+    output.swap(captured_);
+
+    return output;
+}
+
+// Give the full buffer to the writer, taking back an empty one.
+void GuestOutput::hand_off()
+{
+    // Kept in memory, there is nothing to wait on a thread for.
+    if (fd_ < 0)
+    {
+        write_out(buffer_.data(), buffer_.size());
+        buffer_.clear();
+        return;
+    }
+
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head >= GUEST_OUTPUT_CHUNKS)
+        wait_for_writer(head - GUEST_OUTPUT_CHUNKS + 1);
+
+    flush_cout();
+    std::vector< char > & slot = ring_[head % GUEST_OUTPUT_CHUNKS];
+    slot.swap(buffer_);
+    buffer_.clear();
+    buffer_.reserve(GUEST_OUTPUT_CHUNK);
+    head_.store(head + 1, std::memory_order_release);
+
+    if (!writer_.joinable())
+        writer_ = std::thread(&GuestOutput::run_writer, this);
+    {
+        std::lock_guard< std::mutex > lock(mutex_);
+    }
+    filled_.notify_one();
+
+    return;
+}
+
+// Wait until the writer has written the first `written` buffers.
+void GuestOutput::wait_for_writer(const uint64_t written)
+{
+    if (tail_.load(std::memory_order_acquire) >= written)
+        return;
+
+    std::unique_lock< std::mutex > lock(mutex_);
+    drained_.wait(lock, [&]() { return tail_.load(std::memory_order_acquire) >= written; });
+
+    return;
+}
+
+void GuestOutput::run_writer()
+{
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    while (true)
+    {
+        if (head_.load(std::memory_order_acquire) == tail)
+        {
+            std::unique_lock< std::mutex > lock(mutex_);
+            filled_.wait(lock, [&]() { return head_.load(std::memory_order_acquire) != tail || stopping_; });
+            if (head_.load(std::memory_order_acquire) == tail)
+                return;
+        }
+
+        std::vector< char > & slot = ring_[tail % GUEST_OUTPUT_CHUNKS];
+        write_out(slot.data(), slot.size());
+        slot.clear();
+
+        tail_.store(++tail, std::memory_order_release);
+        {
+            std::lock_guard< std::mutex > lock(mutex_);
+        }
+        drained_.notify_one();
+    }
+}
+
+// Whatever went through std::cout before output handed on from here
+// has to come out before it. Only done by the thread printing.
+void GuestOutput::flush_cout()
+{
+    if (fd_ == STDOUT_FILENO)
+        std::cout.flush();
+
+    return;
+}
+
+void GuestOutput::write_out(const char * s, size_t n)
+{
+    if (fd_ < 0)
+    {
+        captured_.append(s, n);
+        return;
+    }
+
+    while (n > 0)
+    {
+        ssize_t written = ::write(fd_, s, n);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written <= 0)
+            break;
+        s += written;
+        n -= written;
+    }
+
+    return;
+}
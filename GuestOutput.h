@@ -0,0 +1,128 @@
+//   File: GuestOutput.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef GUEST_OUTPUT_H
+#define GUEST_OUTPUT_H
+
+#include "Common.h"
+
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+/*
+  What the guest prints (syscalls 1, 4 and 11). Output is collected in
+  a buffer of GUEST_OUTPUT_CHUNK bytes. A full buffer is handed to a
+  writer thread through a ring of GUEST_OUTPUT_CHUNKS buffers, so the
+  program keeps running while it is written. The ring has one producer
+  and one consumer and only needs its two counters to be atomic, the
+  mutex is only there to sleep on when it is empty or full.
+
+  flush() writes everything out before returning, and has to be called
+  before reading input and before printing anything else, so output
+  stays in the order the program produced it.
+*/
+
+const unsigned int GUEST_OUTPUT_CHUNK = 64 * 1024;
+const unsigned int GUEST_OUTPUT_CHUNKS = 8;
+
+class GuestOutput
+{
+public:
+    GuestOutput(const int fd) :
+        fd_(fd),
+        owned_(false),
+        head_(0),
+        tail_(0),
+        stopping_(false)
+    {}
+
+    ~GuestOutput();
+
+    GuestOutput(const GuestOutput &) = delete;
+    GuestOutput & operator=(const GuestOutput &) = delete;
+
+    void write(const char * s, const size_t n)
+    {
+        if (buffer_.size() + n > GUEST_OUTPUT_CHUNK)
+        {
+            hand_off();
+            if (n > GUEST_OUTPUT_CHUNK)
+            {
+                flush();
+                write_out(s, n);
+                return;
+            }
+        }
+        buffer_.insert(buffer_.end(), s, s + n);
+
+        return;
+    }
+
+    void put(const char c)
+    {
+        if (buffer_.size() == GUEST_OUTPUT_CHUNK)
+            hand_off();
+        buffer_.push_back(c);
+
+        return;
+    }
+
+    void write_int(const int value)
+    {
+        char s[16];
+        std::to_chars_result result = std::to_chars(s, s + sizeof(s), value);
+        write(s, result.ptr - s);
+
+        return;
+    }
+
+    // Write out everything printed so far.
+    void flush();
+
+    // Print to a file (created or truncated) from here on.
+    void open(const std::string & filename);
+
+    // Print to a descriptor owned by the caller from here on.
+    void set_fd(const int fd);
+
+    // Keep what is printed from here on in memory instead, until
+    // take_captured() (which flushes first). Full buffers are appended
+    // as they fill, without starting the writer.
+    void capture();
+    std::string take_captured();
+    bool capturing() const
+    { return fd_ < 0; }
+
+private:
+    int fd_;
+    bool owned_; // fd_ was opened here.
+    std::string captured_; // Output while fd_ is -1.
+    std::vector< char > buffer_;
+
+    // Buffers waiting to be written, from tail_ to head_ (counting up,
+    // each at its count % GUEST_OUTPUT_CHUNKS). Written buffers stay
+    // in the ring, emptied, to be swapped for the next full one.
+    std::vector< char > ring_[GUEST_OUTPUT_CHUNKS];
+    std::atomic< uint64_t > head_;
+    std::atomic< uint64_t > tail_;
+
+    // Started by the first full buffer.
+    std::thread writer_;
+    std::mutex mutex_;
+    std::condition_variable filled_;
+    std::condition_variable drained_;
+    bool stopping_;
+
+    void hand_off();
+    void wait_for_writer(const uint64_t written);
+    void run_writer();
+    void flush_cout();
+    void write_out(const char * s, size_t n);
+};
+
+#endif
@@ -0,0 +1,203 @@
+//   File: HeapAllocator.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef HEAP_ALLOCATOR_H
+#define HEAP_ALLOCATOR_H
+
+#include "Common.h"
+
+#include <map>
+
+/*
+  Manages the guest heap for syscalls 9 (sbrk), 92 (malloc) and
+  93 (free). All bookkeeping lives on the host, so a guest that writes
+  past the end of a block cannot corrupt the allocator.
+
+  Requests up to 2048 bytes are rounded up to a power of two size class
+  (8 - 2048) and served from a free list per class, which is refilled
+  a page at a time from the break. Larger requests are rounded up to
+  whole pages and served best fit from the freed large blocks before
+  growing the break.
+*/
+
+const unsigned int HEAP_PAGE_SIZE = 4096;
+const unsigned int HEAP_SIZE_CLASSES = 9; // 8, 16, ..., 2048
+const unsigned int HEAP_MAX_SMALL = 2048;
+
+class HeapAllocator
+{
+public:
+    HeapAllocator(const uint32_t start, const uint32_t limit) :
+        start_(start),
+        limit_(limit),
+        brk_(start),
+        allocator_end_(start),
+        allocations_(0),
+        frees_(0),
+        live_bytes_(0),
+        peak_bytes_(0)
+    {}
+
+    // Move the break by the given number of bytes and return the old
+    // break. Throws if the heap would leave its segment, or shrink
+    // over memory that allocate() has handed out.
+    uint32_t sbrk(const int32_t bytes)
+    {
+        int64_t new_brk = int64_t(brk_) + bytes;
+        if (new_brk < start_)
+            throw SimulatorError("Cannot shrink the heap below its start.");
+        if (new_brk < allocator_end_)
+            throw SimulatorError("Cannot shrink the heap below memory malloc has allocated.");
+
+        return grow(new_brk - brk_);
+    }
+
+    uint32_t allocate(uint32_t bytes)
+    {
+        if (bytes == 0)
+            bytes = 1;
+
+        uint32_t addr;
+        uint32_t block;
+        if (bytes <= HEAP_MAX_SMALL)
+        {
+            unsigned int c = size_class(bytes);
+            block = 8 << c;
+            if (free_lists_[c].empty())
+                refill(c);
+            addr = free_lists_[c].back();
+            free_lists_[c].pop_back();
+        }
+        else
+        {
+            // Checked before rounding up, which could wrap.
+            if (bytes > limit_ - start_)
+                throw SimulatorError("Heap overflow, cannot allocate " + std::to_string(bytes)
+                                     + " bytes, the heap holds at most "
+                                     + std::to_string(limit_ - start_) + ".");
+            block = (bytes + HEAP_PAGE_SIZE - 1) & ~(HEAP_PAGE_SIZE - 1);
+            std::multimap< uint32_t, uint32_t >::iterator it = large_free_.lower_bound(block);
+            if (it != large_free_.end())
+            {
+                // Split off whatever is left over.
+                addr = it->second;
+                if (it->first > block)
+                    large_free_.insert({it->first - block, addr + block});
+                large_free_.erase(it);
+            }
+            else
+            {
+                align_brk(8);
+                addr = grow(block);
+                allocator_end_ = brk_;
+            }
+        }
+
+        live_[addr] = block;
+        ++allocations_;
+        live_bytes_ += block;
+        if (live_bytes_ > peak_bytes_)
+            peak_bytes_ = live_bytes_;
+
+        return addr;
+    }
+
+    void release(const uint32_t addr)
+    {
+        // free(NULL) does nothing.
+        if (addr == 0)
+            return;
+
+        std::unordered_map< uint32_t, uint32_t >::iterator it = live_.find(addr);
+        if (it == live_.end())
+            throw SimulatorError("Invalid free, address was not allocated or was already freed.");
+
+        uint32_t block = it->second;
+        if (block <= HEAP_MAX_SMALL)
+            free_lists_[size_class(block)].push_back(addr);
+        else
+            large_free_.insert({block, addr});
+
+        live_.erase(it);
+        ++frees_;
+        live_bytes_ -= block;
+
+        return;
+    }
+
+    void print_stats(std::ostream & out) const
+    {
+        out << "heap size:          " << brk_ - start_ << " / " << limit_ - start_ << " bytes\n"
+            << "allocations:        " << allocations_ << '\n'
+            << "frees:              " << frees_ << '\n'
+            << "live allocations:   " << live_.size() << '\n'
+            << "live bytes:         " << live_bytes_ << '\n'
+            << "peak live bytes:    " << peak_bytes_ << '\n';
+
+        return;
+    }
+
+private:
+    uint32_t start_;
+    uint32_t limit_;
+    uint32_t brk_;
+    uint32_t allocator_end_; // The break after allocate() last moved it.
+
+    std::vector< uint32_t > free_lists_[HEAP_SIZE_CLASSES];
+    std::multimap< uint32_t, uint32_t > large_free_; // size -> address
+    std::unordered_map< uint32_t, uint32_t > live_;  // address -> size
+
+    uint64_t allocations_;
+    uint64_t frees_;
+    uint64_t live_bytes_;
+    uint64_t peak_bytes_;
+
+    // 1..8 --> 0, 9..16 --> 1, ..., 1025..2048 --> 8
+    static unsigned int size_class(const uint32_t bytes)
+    {
+        unsigned int c = 0;
+        while ((8u << c) < bytes)
+            ++c;
+
+        return c;
+    }
+
+    // Move the break by bytes and return the old break.
+    uint32_t grow(const int64_t bytes)
+    {
+        if (int64_t(brk_) + bytes > limit_)
+            throw SimulatorError("Heap overflow, cannot grow the heap past "
+                                 + std::to_string(limit_ - start_) + " bytes.");
+
+        uint32_t old_brk = brk_;
+        brk_ += bytes;
+
+        return old_brk;
+    }
+
+    void align_brk(const uint32_t alignment)
+    {
+        uint32_t pad = (alignment - (brk_ & (alignment - 1))) & (alignment - 1);
+        grow(pad);
+
+        return;
+    }
+
+    // Carve a fresh page into blocks of the given class.
+    void refill(const unsigned int c)
+    {
+        uint32_t block = 8 << c;
+        align_brk(8);
+        uint32_t page = grow(HEAP_PAGE_SIZE);
+        allocator_end_ = brk_;
+
+        // Push in reverse so blocks are handed out in address order.
+        for (uint32_t offset = HEAP_PAGE_SIZE; offset >= block; offset -= block)
+            free_lists_[c].push_back(page + offset - block);
+
+        return;
+    }
+};
+
+#endif
@@ -0,0 +1,301 @@
+//   File: Lexer.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "Lexer.h"
+#include "PerfectHash.h"
+
+#include <charconv>
+#include <cstring>
+
+bool Lexer::next_line(std::vector< Token > & tokens)
+{
+    if (!next_line())
+        return false;
+
+    tokenize(line_text_, tokens);
+
+    return true;
+}
+
+bool Lexer::next_line()
+{
+    if (pos_ >= source_.size())
+        return false;
+
+    const char * start = source_.data() + pos_;
+    const char * end = (const char *)(std::memchr(start, '\n', source_.size() - pos_));
+    size_t n = (end == nullptr ? source_.size() - pos_ : end - start);
+
+    line_text_ = source_.substr(pos_, n);
+    pos_ += n + 1;
+    ++line_;
+
+    return true;
+}
+
+void Lexer::tokenize(const std::string_view s, std::vector< Token > & tokens)
+{
+    tokens.clear();
+
+    size_t n = s.size();
+    size_t i = 0;
+    while (i < n)
+    {
+        char c = s[i];
+
+        // Separators.
+        if (c == ' ' || c == '\t' || c == ',' || c == '\r')
+        {
+            ++i;
+        }
+
+        // The rest of the line is a comment.
+        else if (c == '#')
+        {
+            break;
+        }
+
+        // String value, find the matching quote.
+        else if (c == '\"')
+        {
+            size_t start = i++;
+            while (i < n && s[i] != '\"')
+                i += (s[i] == '\\' ? 2 : 1);
+            if (i >= n)
+                throw SimulatorError("Unterminated string.");
+            ++i;
+
+            tokens.push_back({ TOKEN_STRING, s.substr(start, i - start), 0 });
+        }
+
+        // Character value.
+        else if (c == '\'')
+        {
+            // 'a' or '\n'
+            int32_t value;
+            size_t len;
+            if (i + 3 < n && s[i + 1] == '\\' && s[i + 3] == '\'')
+            {
+                value = escape_value(s[i + 2]);
+                len = 4;
+            }
+            else if (i + 2 < n && s[i + 1] != '\\' && s[i + 2] == '\'')
+            {
+                value = s[i + 1];
+                len = 3;
+            }
+            else
+                throw SimulatorError("Invalid character formatting.");
+
+            tokens.push_back({ TOKEN_INTEGER, s.substr(i, len), value });
+            i += len;
+        }
+
+        // Register.
+        else if (c == '$')
+        {
+            size_t start = i++;
+            while (i < n && isalnum(s[i]))
+                ++i;
+
+            tokens.push_back({ TOKEN_REGISTER, s.substr(start, i - start),
+                               register_number(s.substr(start + 1, i - start - 1)) });
+        }
+
+        // "4($31)" --> $31, 4
+        else if (c == '(')
+        {
+            size_t start = ++i;
+            while (i < n && s[i] != ')')
+                ++i;
+            if (i >= n || s[start] != '$')
+                throw SimulatorError("Invalid register offset formatting.");
+
+            Token reg = { TOKEN_REGISTER, s.substr(start, i - start),
+                          register_number(s.substr(start + 1, i - start - 1)) };
+            ++i;
+
+            // The immediate directly in front of the parenthesis has
+            // already been read, it goes after the register.
+            if (!tokens.empty() && tokens.back().type == TOKEN_INTEGER
+                && tokens.back().text.data() + tokens.back().text.size() == s.data() + start - 1)
+            {
+                tokens.insert(tokens.end() - 1, reg);
+            }
+            else
+            {
+                tokens.push_back(reg);
+                tokens.push_back(integer_token(0));
+            }
+        }
+
+        // Names, labels and numbers.
+        else
+        {
+            size_t start = i;
+            while (i < n && s[i] != ' ' && s[i] != '\t' && s[i] != ','
+                   && s[i] != '#' && s[i] != '(' && s[i] != '\r')
+                ++i;
+            std::string_view word = s.substr(start, i - start);
+
+            if (isdigit(word[0])
+                || ((word[0] == '-' || word[0] == '+') && word.size() > 1 && isdigit(word[1])))
+            {
+                size_t colon = word.find(':');
+                if (colon == std::string_view::npos)
+                    tokens.push_back({ TOKEN_INTEGER, word, parse_integer(word) });
+                else
+                {
+                    tokens.push_back({ TOKEN_INTEGER, word.substr(0, colon), parse_integer(word.substr(0, colon)) });
+                    tokens.push_back({ TOKEN_REPEAT, word.substr(colon), parse_integer(word.substr(colon + 1)) });
+                }
+            }
+            else if (word[0] == ':' && word.size() > 1 && !tokens.empty()
+                     && tokens.back().type == TOKEN_INTEGER)
+            {
+                // The count after a character value, 'a':8
+                tokens.push_back({ TOKEN_REPEAT, word, parse_integer(word.substr(1)) });
+            }
+            else if (tokens.empty() && word.back() == ':')
+            {
+                tokens.push_back({ TOKEN_LABEL, word.substr(0, word.size() - 1), 0 });
+            }
+            else
+            {
+                tokens.push_back({ TOKEN_NAME, word, 0 });
+            }
+        }
+    }
+
+    return;
+}
+
+// Format the escape sequences
+// "\"a\\tb\"" --> 'a', '\t', 'b'
+unsigned int Lexer::unescape(const std::string_view quoted, uint8_t * out)
+{
+    unsigned int count = 0;
+    size_t n = quoted.size() - 1;
+    for (size_t i = 1; i < n; ++i)
+    {
+        char c = quoted[i];
+        if (c == '\\')
+            c = escape_value(quoted[++i]);
+
+        if (out != nullptr)
+            out[count] = c;
+        ++count;
+    }
+
+    return count;
+}
+
+char Lexer::escape_value(const char c)
+{
+    switch (c)
+    {
+        case '0':  return '\0';
+        case 't':  return '\t';
+        case 'n':  return '\n';
+        case 'v':  return '\v';
+        case 'r':  return '\r';
+        case '\\': return '\\';
+        case '\'': return '\'';
+        case '\"': return '\"';
+        default:
+            throw SimulatorError("Unsupported escape sequence.");
+    }
+}
+
+static constexpr PerfectHash< int32_t, 32 > register_table = make_perfect_hash< int32_t >({
+    { "zero",  0 },
+    { "at",    1 },
+    { "v0",    2 },
+    { "v1",    3 },
+    { "a0",    4 },
+    { "a1",    5 },
+    { "a2",    6 },
+    { "a3",    7 },
+    { "t0",    8 },
+    { "t1",    9 },
+    { "t2",   10 },
+    { "t3",   11 },
+    { "t4",   12 },
+    { "t5",   13 },
+    { "t6",   14 },
+    { "t7",   15 },
+    { "s0",   16 },
+    { "s1",   17 },
+    { "s2",   18 },
+    { "s3",   19 },
+    { "s4",   20 },
+    { "s5",   21 },
+    { "s6",   22 },
+    { "s7",   23 },
+    { "t8",   24 },
+    { "t9",   25 },
+    { "k0",   26 },
+    { "k1",   27 },
+    { "gp",   28 },
+    { "sp",   29 },
+    { "fp",   30 },
+    { "ra",   31 }
+});
+
+int32_t Lexer::register_number(const std::string_view name)
+{
+    if (name.size() == 0 || name.size() > 4)
+        throw SimulatorError("Invalid register.");
+
+    if (isdigit(name[0]))
+    {
+        int32_t reg = parse_integer(name);
+        if (name.size() > 2 || reg > 31)
+            throw SimulatorError("Invalid register.");
+        return reg;
+    }
+
+    // Register names are not case sensitive.
+    char lower[4];
+    for (size_t i = 0; i < name.size(); ++i)
+        lower[i] = tolower(name[i]);
+
+    const int32_t * reg = register_table.find(std::string_view(lower, name.size()));
+    if (reg == nullptr)
+        throw SimulatorError("Invalid register.");
+
+    return *reg;
+}
+
+// Anything that fits in 32 bits, signed or unsigned, is accepted.
+int32_t Lexer::parse_integer(const std::string_view s)
+{
+    size_t i = 0;
+    bool negative = false;
+    if (s[0] == '-' || s[0] == '+')
+    {
+        negative = (s[0] == '-');
+        ++i;
+    }
+
+    int base = 10;
+    if (s.size() > i + 2 && s[i] == '0' && (s[i + 1] == 'x' || s[i + 1] == 'X'))
+    {
+        base = 16;
+        i += 2;
+    }
+    else if (s.size() > i + 2 && s[i] == '0' && (s[i + 1] == 'b' || s[i + 1] == 'B'))
+    {
+        base = 2;
+        i += 2;
+    }
+
+    uint64_t value;
+    std::from_chars_result result = std::from_chars(s.data() + i, s.data() + s.size(), value, base);
+    if (result.ec != std::errc() || result.ptr != s.data() + s.size()
+        || value > (negative ? 0x80000000ull : 0xffffffffull))
+        throw SimulatorError("Invalid immediate value " + std::string(s) + ".");
+
+    return negative ? int32_t(-int64_t(value)) : int32_t(uint32_t(value));
+}
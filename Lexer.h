@@ -0,0 +1,92 @@
+//   File: Lexer.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef LEXER_H
+#define LEXER_H
+
+#include "Common.h"
+
+#include <string_view>
+
+enum TokenType
+{
+    TOKEN_NAME,     // Mnemonic, directive or label reference.
+    TOKEN_LABEL,    // Label definition, "main:" (text excludes the ':').
+    TOKEN_REGISTER, // "$t0" or "$8", value is the register number.
+    TOKEN_INTEGER,  // Decimal, hex, binary or character literal.
+    TOKEN_STRING,   // String literal, text keeps the quotes and escapes.
+    TOKEN_REPEAT    // ":1024" in "0:1024", value is the count.
+};
+
+// Tokens point into the source text, which has to outlive them.
+// Registers and immediates are parsed once, into value.
+struct Token
+{
+    TokenType type;
+    std::string_view text;
+    int32_t value;
+};
+
+// Tokens for instructions built by the assembler itself, e.g. the
+// parts of a pseudoinstruction.
+inline Token name_token(const std::string_view name)
+{ return { TOKEN_NAME, name, 0 }; }
+inline Token register_token(const int32_t reg)
+{ return { TOKEN_REGISTER, "", reg }; }
+inline Token integer_token(const int32_t value)
+{ return { TOKEN_INTEGER, "", value }; }
+
+/*
+  Splits source text into lines of tokens in a single pass, without
+  copying it. Commas and whitespace separate tokens, '#' starts a
+  comment and "imm($reg)" becomes the register followed by the
+  immediate ("4($31)" --> $31, 4), with a missing immediate being 0.
+  A repeated number "0:1024" becomes the number followed by the count.
+*/
+class Lexer
+{
+public:
+    Lexer(const std::string_view source) :
+        source_(source),
+        pos_(0),
+        line_(0)
+    {}
+
+    // Tokenize the next line, which may leave tokens empty. Returns
+    // false once the source is exhausted.
+    bool next_line(std::vector< Token > & tokens);
+
+    // Move to the next line without tokenizing it.
+    bool next_line();
+
+    // Number of the line last returned (starting at 1), and its text.
+    unsigned int line() const
+    { return line_; }
+    std::string_view line_text() const
+    { return line_text_; }
+
+    // Tokenize a single line.
+    static void tokenize(const std::string_view line, std::vector< Token > & tokens);
+
+    // Write the contents of a string literal with its escape sequences
+    // resolved to out, which may be null to only count them. Returns
+    // the number of bytes.
+    static unsigned int unescape(const std::string_view quoted, uint8_t * out);
+
+    // "t0" --> 8, "31" --> 31
+    static int32_t register_number(const std::string_view name);
+
+    // "42", "-7", "0x2a", "0b101010"
+    static int32_t parse_integer(const std::string_view s);
+
+private:
+    std::string_view source_;
+    size_t pos_;
+    unsigned int line_;
+    std::string_view line_text_;
+
+    static char escape_value(const char c);
+};
+
+#endif
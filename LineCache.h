@@ -0,0 +1,221 @@
+//   File: LineCache.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef LINE_CACHE_H
+#define LINE_CACHE_H
+
+#include "Common.h"
+#include "SymbolTable.h"
+
+#include <string_view>
+
+/*
+  What each line of a file assembled to the last time, so assembling it
+  again after an edit only lexes and encodes the lines whose text
+  changed. Lines are looked up by their text (and the segment they are
+  in), not their line number, so inserting or deleting lines does not
+  invalidate the ones after them.
+
+  Entries are position independent: label references are kept as
+  relocations relative to the start of the line, naming the label by
+  where it appears in the line's text. Lines whose encoding depends on
+  their own address (a branch to a numeric address) are never cached.
+
+  The cache also keeps the last assembly of the whole file (CachedFile),
+  so the unchanged lines at the start and end of the file are not even
+  looked up one by one.
+*/
+
+struct CachedRelocation
+{
+    uint32_t offset;      // From the line's first byte.
+    uint32_t name_start;  // The label, as a range of the line's text.
+    uint32_t name_length;
+    RelocationType type;
+};
+
+struct CachedLine
+{
+    std::string text;
+    bool text_segment;
+    uint32_t size;                // Bytes the line takes up.
+    int32_t label_start;          // Label defined by the line, or -1.
+    uint32_t label_length;
+    std::vector< uint32_t > words; // Text segment encodings.
+    std::vector< uint8_t > bytes;  // Data segment contents.
+    std::vector< CachedRelocation > relocations;
+};
+
+// Where assembly stands before a line: the segment it is in and the
+// next free address in each segment.
+struct CachedState
+{
+    uint32_t segment; // MipsSegment
+    uint32_t text;
+    uint32_t data;
+};
+
+inline bool operator==(const CachedState & a, const CachedState & b)
+{ return a.segment == b.segment && a.text == b.text && a.data == b.data; }
+
+// A label defined by a line, named by where it is in the line's text.
+struct CachedLabel
+{
+    uint32_t line;        // Index of the line, from 0.
+    uint32_t name_start;
+    uint32_t name_length;
+    uint32_t address;
+    bool text_segment;
+};
+
+// A reference to labels[label], as it was resolved.
+struct CachedReference
+{
+    uint32_t address;
+    uint32_t label;
+    RelocationType type;
+    uint32_t line;
+};
+
+/*
+  The whole file as it was last assembled, so the lines before and after
+  an edit can be reused in bulk: their words and bytes are copied, moved
+  by however much the edited lines grew or shrank, and only references
+  whose target or distance changed are patched again.
+*/
+struct CachedFile
+{
+    CachedFile() :
+        incbin(false)
+    {}
+
+    std::string source;
+    std::vector< uint32_t > line_starts;  // Offset of each line in source.
+    std::vector< CachedState > states;    // Before each line, then at the end.
+    std::vector< CachedLabel > labels;    // In line order.
+    std::vector< CachedReference > references;
+    std::vector< uint32_t > fixed_lines;  // Lines that cannot move (.align, ...).
+    std::vector< uint32_t > globl_lines;
+    bool incbin;
+    std::string entrypoint_label;
+
+    std::vector< uint32_t > text;
+    std::vector< uint8_t > decoded;
+    std::vector< uint32_t > lines;
+    std::vector< uint8_t > data;
+};
+
+class LineCache
+{
+public:
+    LineCache() :
+        hits_(0),
+        misses_(0)
+    {}
+
+    // The entry for this line from the previous assembly, or one
+    // already made by this assembly for an identical line.
+    const CachedLine * find(const std::string_view line, const bool text_segment)
+    {
+        uint64_t key = hash(line, text_segment);
+
+        std::unordered_map< uint64_t, CachedLine >::iterator it = current_.find(key);
+        if (it != current_.end() && matches(it->second, line, text_segment))
+        {
+            ++hits_;
+            return &it->second;
+        }
+
+        it = previous_.find(key);
+        if (it != previous_.end() && matches(it->second, line, text_segment))
+        {
+            // Carry it over to this assembly.
+            ++hits_;
+            return &(current_[key] = std::move(it->second));
+        }
+
+        ++misses_;
+        return nullptr;
+    }
+
+    void insert(CachedLine && entry)
+    {
+        uint64_t key = hash(entry.text, entry.text_segment);
+        current_[key] = std::move(entry);
+
+        return;
+    }
+
+    // The assembly succeeded, drop the lines that are no longer in
+    // the file.
+    void finish()
+    {
+        previous_.swap(current_);
+        current_.clear();
+
+        return;
+    }
+
+    // The file as the last successful assembly left it, if any.
+    const CachedFile * file() const
+    { return file_.get(); }
+
+    void set_file(std::unique_ptr< CachedFile > file)
+    {
+        file_ = std::move(file);
+
+        return;
+    }
+
+    // The assembly failed, keep what the last good one had.
+    void abandon()
+    {
+        merge();
+
+        return;
+    }
+
+    // Keep the lines from before this assembly along with the new ones,
+    // for an assembly that only looked up some of the file's lines.
+    void merge()
+    {
+        for (std::pair< const uint64_t, CachedLine > & entry : current_)
+            previous_[entry.first] = std::move(entry.second);
+        current_.clear();
+
+        return;
+    }
+
+    // Lines reused and lines assembled from scratch, over every
+    // assembly so far.
+    uint64_t hits() const
+    { return hits_; }
+    uint64_t misses() const
+    { return misses_; }
+
+private:
+    std::unordered_map< uint64_t, CachedLine > previous_;
+    std::unordered_map< uint64_t, CachedLine > current_;
+    std::unique_ptr< CachedFile > file_;
+    uint64_t hits_;
+    uint64_t misses_;
+
+    static bool matches(const CachedLine & entry, const std::string_view line,
+                        const bool text_segment)
+    {
+        return entry.text_segment == text_segment && entry.text == line;
+    }
+
+    // FNV-1a
+    static uint64_t hash(const std::string_view line, const bool text_segment)
+    {
+        uint64_t h = 14695981039346656037ull ^ uint64_t(text_segment);
+        for (char c : line)
+            h = (h ^ uint8_t(c)) * 1099511628211ull;
+
+        return h;
+    }
+};
+
+#endif
@@ -0,0 +1,126 @@
+//   File: LinkUnit.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef LINK_UNIT_H
+#define LINK_UNIT_H
+
+#include "Common.h"
+#include "SymbolTable.h"
+
+/*
+  One file of a program made of several, assembled on its own as if it
+  started at the beginning of both segments. Every label reference is
+  left as a relocation, so linking can put the file anywhere and point
+  references at labels of other files.
+
+  Labels are local to their file unless the file lists them with
+  .globl (which a file may do any number of times). The program starts
+  at the first .globl of the first file.
+*/
+
+// Where each file's data starts is a multiple of this (or of its
+// largest .align), so its .word directives stay aligned.
+const uint32_t LINK_DATA_ALIGN = 4;
+
+struct UnitSymbol
+{
+    std::string name;
+    bool defined;
+    bool text;       // In the text segment, otherwise the data segment.
+    uint32_t offset; // From the start of the file's part of the segment.
+};
+
+struct UnitRelocation
+{
+    bool text;
+    uint32_t offset;
+    uint32_t symbol; // Index into the unit's symbols.
+    RelocationType type;
+    unsigned int line;
+};
+
+struct LinkUnit
+{
+    std::string filename;
+    std::vector< uint32_t > text;  // Label fields not filled in yet.
+    std::vector< uint32_t > lines;
+    std::vector< uint8_t > data;
+    uint32_t data_alignment;
+    std::vector< UnitSymbol > symbols;
+    std::vector< UnitRelocation > relocations;
+    std::vector< std::string > globls;
+    std::vector< std::string > incbin_files;
+
+    // A branch to a numeric address, which only encodes correctly if
+    // the file is not moved.
+    bool position_dependent;
+};
+
+/*
+  Files assembled by earlier runs, by name. A file is only assembled
+  again if its contents changed, so editing one file of a program
+  leaves the others alone.
+*/
+class UnitCache
+{
+public:
+    UnitCache() :
+        hits_(0),
+        misses_(0)
+    {}
+
+    std::shared_ptr< const LinkUnit > find(const std::string & filename,
+                                           const std::string_view source)
+    {
+        std::unordered_map< std::string, Entry >::iterator it = entries_.find(filename);
+        if (it != entries_.end() && it->second.hash == hash(source) && it->second.source == source)
+        {
+            ++hits_;
+            return it->second.unit;
+        }
+
+        ++misses_;
+        return nullptr;
+    }
+
+    void insert(const std::string_view source, const std::shared_ptr< const LinkUnit > & unit)
+    {
+        Entry & entry = entries_[unit->filename];
+        entry.hash = hash(source);
+        entry.source = source;
+        entry.unit = unit;
+
+        return;
+    }
+
+    // Files reused and files assembled, over every run so far.
+    uint64_t hits() const
+    { return hits_; }
+    uint64_t misses() const
+    { return misses_; }
+
+private:
+    struct Entry
+    {
+        uint64_t hash;
+        std::string source;
+        std::shared_ptr< const LinkUnit > unit;
+    };
+
+    std::unordered_map< std::string, Entry > entries_;
+    uint64_t hits_;
+    uint64_t misses_;
+
+    // FNV-1a
+    static uint64_t hash(const std::string_view source)
+    {
+        uint64_t h = 14695981039346656037ull;
+        for (char c : source)
+            h = (h ^ uint8_t(c)) * 1099511628211ull;
+
+        return h;
+    }
+};
+
+#endif
@@ -0,0 +1,114 @@
+//   File: MappedFile.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "Common.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A host file mapped into memory. Read only by default, a writable
+// mapping is private so writes never reach the file (copy-on-write).
+class MappedFile
+{
+public:
+    MappedFile(const std::string & filename, const bool writable = false) :
+        data_(nullptr),
+        size_(0)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw SimulatorError("Unable to open file \"" + filename + "\".");
+
+        struct stat st;
+        if (fstat(fd, &st) < 0)
+        {
+            close(fd);
+            throw SimulatorError("Unable to read file \"" + filename + "\".");
+        }
+        size_ = st.st_size;
+
+        // A pipe (or anything else fstat cannot size) is read through
+        // instead, into memory of its own.
+        if (!S_ISREG(st.st_mode))
+        {
+            std::string contents;
+            if (!read_all(fd, contents))
+            {
+                close(fd);
+                throw SimulatorError("Unable to read file \"" + filename + "\".");
+            }
+            close(fd);
+            size_ = contents.size();
+            if (size_ > 0)
+            {
+                void * p = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p == MAP_FAILED)
+                    throw SimulatorError("Unable to map file \"" + filename + "\".");
+                data_ = (uint8_t *)(p);
+                std::memcpy(data_, contents.data(), size_);
+            }
+            return;
+        }
+
+        // Empty files cannot be mapped, they simply have no data.
+        if (size_ > 0)
+        {
+            void * p = mmap(nullptr, size_,
+                            PROT_READ | (writable ? PROT_WRITE : 0),
+                            MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED)
+            {
+                close(fd);
+                throw SimulatorError("Unable to map file \"" + filename + "\".");
+            }
+            data_ = (uint8_t *)(p);
+        }
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (data_ != nullptr)
+            munmap(data_, size_);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile & operator=(const MappedFile &) = delete;
+
+    const uint8_t * data() const
+    { return data_; }
+    uint8_t * data()
+    { return data_; }
+
+    size_t size() const
+    { return size_; }
+
+private:
+    uint8_t * data_;
+    size_t size_;
+
+    static bool read_all(const int fd, std::string & contents)
+    {
+        char buffer[64 * 1024];
+        while (true)
+        {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n > 0)
+                contents.append(buffer, n);
+            else if (n == 0)
+                return true;
+            else if (errno != EINTR)
+                return false;
+        }
+    }
+};
+
+#endif
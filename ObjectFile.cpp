@@ -0,0 +1,165 @@
+//   File: ObjectFile.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "ObjectFile.h"
+#include "Simulator.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+
+static uint64_t align_up(const uint64_t n, const uint64_t alignment)
+{
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+static void pad_to(std::ofstream & ofs, const uint64_t offset)
+{
+    static const char zeros[16] = {};
+    uint64_t at = ofs.tellp();
+    while (at < offset)
+    {
+        uint64_t n = std::min< uint64_t >(offset - at, sizeof(zeros));
+        ofs.write(zeros, n);
+        at += n;
+    }
+
+    return;
+}
+
+void write_object_file(const ProgramImage & image, const std::string & filename)
+{
+    std::ofstream ofs;
+    ofs.open(filename, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+    if (ofs.fail())
+        throw SimulatorError("Unable to write object file \"" + filename + "\".");
+
+    ObjectHeader header = {};
+    std::memcpy(header.magic, OBJECT_MAGIC, sizeof(OBJECT_MAGIC));
+    header.version = OBJECT_VERSION;
+    header.byte_order = OBJECT_BYTE_ORDER;
+    header.entrypoint = image.entrypoint;
+    header.flags = (image.standard_lui ? OBJECT_STANDARD_LUI : 0);
+    header.text_size = image.text_size();
+    std::ostringstream source_map;
+    image.source_map.write(source_map);
+    header.source_map_size = source_map.str().size();
+    header.label_count = image.labels.size();
+    header.data_size = image.data_size();
+
+    // Everything before the data has a known size.
+    header.source_map_offset = align_up(sizeof(ObjectHeader) + uint64_t(header.text_size) * 5, 4);
+    header.labels_offset = header.source_map_offset + header.source_map_size;
+    uint64_t labels_end = header.labels_offset;
+    for (const std::pair< const std::string, uint32_t > & label : image.labels)
+        labels_end += 8 + align_up(label.first.size(), 4);
+    header.data_offset = align_up(labels_end, OBJECT_DATA_ALIGN);
+
+    ofs.write((const char *)(&header), sizeof(header));
+    ofs.write((const char *)(image.text_words()), header.text_size * 4);
+    ofs.write((const char *)(image.decoded_words()), header.text_size);
+    pad_to(ofs, header.source_map_offset);
+
+    ofs.write(source_map.str().data(), header.source_map_size);
+
+    for (const std::pair< const std::string, uint32_t > & label : image.labels)
+    {
+        uint32_t entry[2] = { label.second, uint32_t(label.first.size()) };
+        ofs.write((const char *)(entry), sizeof(entry));
+        ofs.write(label.first.data(), label.first.size());
+        pad_to(ofs, align_up(ofs.tellp(), 4));
+    }
+
+    pad_to(ofs, header.data_offset);
+    ofs.write((const char *)(image.data_bytes()), header.data_size);
+    ofs.close();
+    if (ofs.fail())
+        throw SimulatorError("Unable to write object file \"" + filename + "\".");
+
+    // Cover the rest of the data segment with a hole so it can be
+    // mapped whole.
+    if (truncate(filename.c_str(), header.data_offset + DATA_SEGMENT_SIZE) != 0)
+        throw SimulatorError("Unable to write object file \"" + filename + "\".");
+
+    return;
+}
+
+std::shared_ptr< const ProgramImage > read_object_file(const std::string & filename,
+                                                       const uint32_t text_start)
+{
+    std::shared_ptr< ProgramImage > image = std::make_shared< ProgramImage >();
+    image->object.reset(new MappedFile(filename));
+
+    const uint8_t * base = image->object->data();
+    uint64_t size = image->object->size();
+    const std::string invalid = "Invalid object file \"" + filename + "\".";
+    if (size < sizeof(ObjectHeader))
+        throw SimulatorError(invalid);
+
+    ObjectHeader header;
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, OBJECT_MAGIC, sizeof(OBJECT_MAGIC)) != 0)
+        throw SimulatorError(invalid);
+    if (header.version != OBJECT_VERSION || header.byte_order != OBJECT_BYTE_ORDER)
+        throw SimulatorError("Object file \"" + filename + "\" was written by a different version, reassemble it.");
+    if (header.text_size > TEXT_SEGMENT_SIZE || header.data_size > DATA_SEGMENT_SIZE
+        || header.source_map_offset < sizeof(ObjectHeader) + uint64_t(header.text_size) * 5
+        || header.labels_offset < header.source_map_offset + header.source_map_size
+        || header.data_offset < header.labels_offset
+        || header.data_offset % OBJECT_DATA_ALIGN != 0
+        || header.data_offset + DATA_SEGMENT_SIZE > size)
+        throw SimulatorError(invalid);
+
+    // Every predecoded word is an instruction or TOTAL_INSTRUCTIONS,
+    // step() indexes its dispatch table with them.
+    const uint8_t * decoded = base + sizeof(ObjectHeader) + header.text_size * 4;
+    for (uint32_t i = 0; i < header.text_size; ++i)
+        if (decoded[i] > TOTAL_INSTRUCTIONS)
+            throw SimulatorError(invalid);
+
+    image->entrypoint = header.entrypoint;
+    image->standard_lui = (header.flags & OBJECT_STANDARD_LUI) != 0;
+    image->object_text = (const uint32_t *)(base + sizeof(ObjectHeader));
+    image->object_decoded = decoded;
+    image->object_text_size = header.text_size;
+    image->object_data = base + header.data_offset;
+    image->object_data_size = header.data_size;
+
+    uint64_t offset = header.labels_offset;
+    image->labels.reserve(header.label_count);
+    for (uint32_t i = 0; i < header.label_count; ++i)
+    {
+        if (offset + 8 > header.data_offset)
+            throw SimulatorError(invalid);
+        const uint32_t * entry = (const uint32_t *)(base + offset);
+        if (offset + 8 + entry[1] > header.data_offset)
+            throw SimulatorError(invalid);
+        image->labels[std::string((const char *)(entry + 2), entry[1])] = entry[0];
+        offset += 8 + align_up(entry[1], 4);
+    }
+
+    if (image->source_map.read(base + header.source_map_offset, header.source_map_size) == 0
+        || image->source_map.size() != header.text_size)
+        throw SimulatorError(invalid);
+    image->source_map.set_labels(image->labels, text_start);
+
+    // Simulators map the initial data from the file itself, unless it
+    // was a pipe that cannot be opened again.
+    struct stat st;
+    if (stat(filename.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        image->data_fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    image->data_offset = header.data_offset;
+
+    return image;
+}
+
+bool is_object_file(const std::string & filename)
+{
+    char magic[sizeof(OBJECT_MAGIC)];
+    std::ifstream ifs(filename, std::ifstream::binary);
+
+    return ifs.read(magic, sizeof(magic))
+        && std::memcmp(magic, OBJECT_MAGIC, sizeof(OBJECT_MAGIC)) == 0;
+}
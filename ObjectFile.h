@@ -0,0 +1,69 @@
+//   File: ObjectFile.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef OBJECT_FILE_H
+#define OBJECT_FILE_H
+
+#include "Common.h"
+#include "ProgramImage.h"
+
+/*
+  Assembled programs saved to disk so they can be run again without
+  the assembler. Loading maps the file: the text segment and its
+  decoded instructions are used in place, and the initial data is
+  mapped copy-on-write straight from the file by every simulator
+  running it.
+
+  Layout, all integers in host byte order:
+    ObjectHeader
+    text          text_size x uint32_t
+    decoded       text_size x uint8_t, padded to 4 bytes
+    source map    source_map_size bytes, see SourceMap::write
+    labels        label_count x { uint32_t address, uint32_t length,
+                  name }, each padded to 4 bytes
+    data          data_size bytes at data_offset (a multiple of
+                  OBJECT_DATA_ALIGN), the file then extends as a hole
+                  to cover the whole data segment
+
+  Bump OBJECT_VERSION whenever the layout, the segment addresses or the
+  Instruction enum change, older objects are then rejected.
+*/
+
+const char OBJECT_MAGIC[8] = { 'M', 'I', 'P', 'S', 'O', 'B', 'J', '\0' };
+const uint32_t OBJECT_VERSION = 3;
+const uint32_t OBJECT_BYTE_ORDER = 0x01020304;
+const uint32_t OBJECT_DATA_ALIGN = 65536; // Any host page size divides it.
+
+// ObjectHeader::flags
+const uint32_t OBJECT_STANDARD_LUI = 1; // See ProgramImage::standard_lui.
+
+struct ObjectHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint32_t entrypoint;
+    uint32_t text_size;
+    uint32_t source_map_size;
+    uint32_t label_count;
+    uint32_t data_size;
+    uint32_t flags;
+    uint64_t source_map_offset;
+    uint64_t labels_offset;
+    uint64_t data_offset;
+};
+
+// Write an assembled program to filename.
+void write_object_file(const ProgramImage & image, const std::string & filename);
+
+// Map an object file written by write_object_file, for a text segment
+// starting at text_start.
+std::shared_ptr< const ProgramImage > read_object_file(const std::string & filename,
+                                                       const uint32_t text_start);
+
+// True if filename starts like an object file, otherwise it is
+// treated as assembly source.
+bool is_object_file(const std::string & filename);
+
+#endif
@@ -0,0 +1,101 @@
+//   File: PerfectHash.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef PERFECT_HASH_H
+#define PERFECT_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+/*
+  Fixed keyword table (mnemonics, directives, register names) built at
+  compile time. The constructor searches for a hash seed that puts
+  every key in its own slot, so a lookup is one hash of the key, one
+  slot and one comparison, with no allocation.
+
+  constexpr PerfectHash< int, 3 > table = make_perfect_hash< int >({
+      { "a", 1 }, { "b", 2 }, { "c", 3 } });
+  table.find("b") --> pointer to 2, table.find("d") --> nullptr
+*/
+
+template < typename T >
+struct PerfectHashEntry
+{
+    std::string_view key;
+    T value;
+};
+
+template < typename T, size_t N >
+class PerfectHash
+{
+public:
+    constexpr PerfectHash(const PerfectHashEntry< T > (&entries)[N]) :
+        seed_(0),
+        slots_{}
+    {
+        // Keep trying seeds until no two keys share a slot.
+        for (uint32_t seed = 1; seed_ == 0; ++seed)
+        {
+            bool used[SIZE] = {};
+            size_t i = 0;
+            while (i < N && !used[slot(entries[i].key, seed)])
+                used[slot(entries[i++].key, seed)] = true;
+
+            if (i == N)
+                seed_ = seed;
+        }
+
+        for (size_t i = 0; i < N; ++i)
+            slots_[slot(entries[i].key, seed_)] = entries[i];
+    }
+
+    // Value stored for key, nullptr if it is not in the table.
+    constexpr const T * find(const std::string_view key) const
+    {
+        const PerfectHashEntry< T > & entry = slots_[slot(key, seed_)];
+        if (entry.key.size() == 0 || entry.key != key)
+            return nullptr;
+
+        return &entry.value;
+    }
+
+private:
+    // At least 8 slots per key (a power of two), which keeps the seed
+    // search short.
+    static constexpr size_t table_size()
+    {
+        size_t size = 8;
+        while (size < 8 * N)
+            size <<= 1;
+
+        return size;
+    }
+    static constexpr size_t SIZE = table_size();
+
+    uint32_t seed_;
+    PerfectHashEntry< T > slots_[SIZE];
+
+    // FNV-1a followed by a final mix so the low bits depend on every
+    // character.
+    static constexpr size_t slot(const std::string_view key, const uint32_t seed)
+    {
+        uint32_t h = 2166136261u ^ seed;
+        for (char c : key)
+            h = (h ^ uint8_t(c)) * 16777619u;
+        h ^= h >> 16;
+        h *= 0x45d9f3bu;
+        h ^= h >> 16;
+
+        return h & (SIZE - 1);
+    }
+};
+
+template < typename T, size_t N >
+constexpr PerfectHash< T, N > make_perfect_hash(const PerfectHashEntry< T > (&entries)[N])
+{
+    return PerfectHash< T, N >(entries);
+}
+
+#endif
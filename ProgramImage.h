@@ -0,0 +1,116 @@
+//   File: ProgramImage.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef PROGRAM_IMAGE_H
+#define PROGRAM_IMAGE_H
+
+#include "Common.h"
+#include "MappedFile.h"
+#include "SourceMap.h"
+
+#include <unistd.h>
+
+/*
+  Everything assembling a program produces. Once a simulator finishes
+  assembling an image it is never written again, so any number of
+  simulators can run it at the same time through a
+  std::shared_ptr< const ProgramImage >. Each of them only owns its
+  registers, heap, stack and the data pages it writes to.
+*/
+struct ProgramImage
+{
+    ProgramImage() :
+        entrypoint(0),
+        standard_lui(false),
+        data_fd(-1),
+        data_offset(0),
+        object_text(nullptr),
+        object_decoded(nullptr),
+        object_text_size(0),
+        object_data(nullptr),
+        object_data_size(0)
+    {}
+
+    ~ProgramImage()
+    {
+        if (data_fd >= 0)
+            close(data_fd);
+    }
+
+    ProgramImage(const ProgramImage &) = delete;
+    ProgramImage & operator=(const ProgramImage &) = delete;
+
+    // Encoded instructions, starting at the beginning of the text
+    // segment, and the Instruction each one decodes to so execution
+    // can skip decoding. Words that do not decode hold
+    // TOTAL_INSTRUCTIONS, words lazy assembly has not encoded yet hold
+    // NOT_ENCODED.
+    std::vector< uint32_t > text;
+    std::vector< uint8_t > decoded;
+
+    // Source line each word of text came from, 0 if none, while it
+    // is being assembled. Finishing the image compresses it into
+    // source_map.
+    std::vector< uint32_t > lines;
+    SourceMap source_map;
+
+    std::unordered_map< std::string, uint32_t > labels;
+    uint32_t entrypoint;
+
+    // lui clears the low half of its register, as on real MIPS. Set
+    // for ELF executables, whose compilers load addresses with lui
+    // then addiu. Assembled source relies on the simulator's own lui,
+    // which keeps the low half (li and la are ori then lui).
+    bool standard_lui;
+
+    // Files .incbin copied into the data segment, as they were opened.
+    std::vector< std::string > incbin_files;
+
+    // Initial contents of the data segment. data_fd is an in-memory
+    // file holding the same bytes (from data_offset on) which
+    // instances map copy-on-write, or -1 if they have to copy data
+    // instead.
+    std::vector< uint8_t > data;
+    int data_fd;
+    off_t data_offset;
+
+    // An image loaded from an object file reads its text and initial
+    // data straight out of the file's mapping instead of the vectors.
+    std::unique_ptr< MappedFile > object;
+    const uint32_t * object_text;
+    const uint8_t * object_decoded;
+    uint32_t object_text_size;
+    const uint8_t * object_data;
+    uint32_t object_data_size;
+
+    const uint32_t * text_words() const
+    { return object ? object_text : text.data(); }
+    const uint8_t * decoded_words() const
+    { return object ? object_decoded : decoded.data(); }
+    uint32_t text_size() const
+    { return object ? object_text_size : text.size(); }
+    const uint8_t * data_bytes() const
+    { return object ? object_data : data.data(); }
+    uint32_t data_size() const
+    { return object ? object_data_size : data.size(); }
+
+    // Source line of the i'th word of text, 0 if it is not known.
+    unsigned int line_of(const uint32_t i) const
+    { return source_map.line(i); }
+
+    // "line <n>" for the i'th word of text, with its file in front if
+    // the program has several. Empty if the line is not known.
+    std::string location_of(const uint32_t i) const
+    {
+        unsigned int line = line_of(i);
+        if (line == 0)
+            return "";
+        if (source_map.file_count() > 1)
+            return source_map.file(i) + " line " + std::to_string(line);
+
+        return "line " + std::to_string(line);
+    }
+};
+
+#endif
@@ -25,9 +25,11 @@
 class RegisterFile
 {
 public:
-    RegisterFile()
+    RegisterFile() :
+        hi_(0),
+        lo_(0)
     {
-        for (int i = 32; i >= 0; --i)
+        for (int i = 31; i >= 0; --i)
             *(x_ + i) = 0;
     }
     
@@ -0,0 +1,361 @@
+//   File: ResultCache.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "ResultCache.h"
+#include "MappedFile.h"
+#include "Simulator.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <endian.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+// FNV-1a, continuing from h.
+static uint64_t hash_bytes(const void * p, const size_t n, uint64_t h = 14695981039346656037ull)
+{
+    const uint8_t * bytes = (const uint8_t *)(p);
+    for (size_t i = 0; i < n; ++i)
+        h = (h ^ bytes[i]) * 1099511628211ull;
+
+    return h;
+}
+
+// The simulator's own executable, so rebuilding it in any way leaves
+// the entries the old build wrote stale.
+static uint64_t hash_build()
+{
+    uint64_t h = hash_bytes(&RESULT_CACHE_VERSION, sizeof(RESULT_CACHE_VERSION));
+    try
+    {
+        MappedFile exe("/proc/self/exe");
+        h = hash_bytes(exe.data(), exe.size(), h);
+    }
+    catch (SimulatorError &)
+    {}
+
+    return h;
+}
+
+static void put_u32(std::string & s, const uint32_t n)
+{
+    uint32_t le = htole32(n);
+    s.append((const char *)(&le), 4);
+
+    return;
+}
+
+static void put_u64(std::string & s, const uint64_t n)
+{
+    uint64_t le = htole64(n);
+    s.append((const char *)(&le), 8);
+
+    return;
+}
+
+// Read n bytes at p, false if fewer than that are left before end.
+static bool get_bytes(const uint8_t *& p, const uint8_t * end, void * out, const size_t n)
+{
+    if (size_t(end - p) < n)
+        return false;
+    std::memcpy(out, p, n);
+    p += n;
+
+    return true;
+}
+
+static bool get_u32(const uint8_t *& p, const uint8_t * end, uint32_t & n)
+{
+    if (!get_bytes(p, end, &n, 4))
+        return false;
+    n = le32toh(n);
+
+    return true;
+}
+
+static bool get_u64(const uint8_t *& p, const uint8_t * end, uint64_t & n)
+{
+    if (!get_bytes(p, end, &n, 8))
+        return false;
+    n = le64toh(n);
+
+    return true;
+}
+
+ResultCache::ResultCache(const std::string & directory) :
+    directory_(directory),
+    build_hash_(hash_build()),
+    hits_(0),
+    misses_(0),
+    stale_(0),
+    corrupt_(0),
+    uncacheable_(0),
+    bytes_(0)
+{
+    if (mkdir(directory.c_str(), 0777) != 0 && errno != EEXIST)
+        throw SimulatorError("Unable to create result cache \"" + directory + "\".");
+    bytes_ = scan(nullptr);
+}
+
+std::string ResultCache::entry_path(const uint64_t image_hash, const std::string & input) const
+{
+    char name[33];
+    std::snprintf(name, sizeof(name), "%016llx%016llx", (unsigned long long)(image_hash),
+                  (unsigned long long)(hash_bytes(input.data(), input.size())));
+
+    return directory_ + "/" + name;
+}
+
+bool ResultCache::find(const uint64_t image_hash, const std::string & input, RunRecord & record)
+{
+    std::string path = entry_path(image_hash, input);
+    std::unique_ptr< MappedFile > file;
+    try
+    {
+        file.reset(new MappedFile(path));
+    }
+    catch (SimulatorError &)
+    {
+        ++misses_;
+        return false;
+    }
+
+    const uint8_t * p = file->data();
+    const uint8_t * end = p + file->size();
+    char magic[4];
+    uint32_t version;
+    uint64_t build_hash;
+    if (!get_bytes(p, end, magic, 4) || std::memcmp(magic, RESULT_CACHE_MAGIC, 4) != 0
+        || !get_u32(p, end, version) || !get_u64(p, end, build_hash)
+        || version != RESULT_CACHE_VERSION || build_hash != build_hash_)
+    {
+        unlink(path.c_str());
+        ++stale_;
+        ++misses_;
+        return false;
+    }
+
+    uint64_t input_size;
+    bool ok = get_u64(p, end, input_size) && uint64_t(end - p) >= input_size;
+    if (ok && (input_size != input.size() || std::memcmp(p, input.data(), input_size) != 0))
+    {
+        // Another input with the same hash, a miss rather than a
+        // corrupt entry.
+        ++misses_;
+        return false;
+    }
+    if (ok)
+        p += input_size;
+
+    uint32_t status;
+    uint32_t error_size;
+    uint64_t output_size;
+    ok = ok && get_u32(p, end, status)
+        && get_u64(p, end, record.instructions)
+        && get_u64(p, end, record.cycles);
+    for (unsigned int i = 0; ok && i < 35; ++i)
+        ok = get_u32(p, end, record.registers[i]);
+    ok = ok && get_u32(p, end, error_size) && size_t(end - p) >= error_size;
+    if (ok)
+    {
+        record.error.assign((const char *)(p), error_size);
+        p += error_size;
+    }
+    ok = ok && get_u64(p, end, output_size) && uint64_t(end - p) == output_size;
+    if (!ok)
+    {
+        unlink(path.c_str());
+        ++corrupt_;
+        ++misses_;
+        return false;
+    }
+    record.exit_status = int32_t(status);
+    record.output.assign((const char *)(p), output_size);
+    ++hits_;
+
+    // Recently used, as far as eviction is concerned.
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+
+    return true;
+}
+
+void ResultCache::store(const uint64_t image_hash, const std::string & input, const RunRecord & record)
+{
+    std::string bytes(RESULT_CACHE_MAGIC, 4);
+    put_u32(bytes, RESULT_CACHE_VERSION);
+    put_u64(bytes, build_hash_);
+    put_u64(bytes, input.size());
+    bytes += input;
+    put_u32(bytes, uint32_t(record.exit_status));
+    put_u64(bytes, record.instructions);
+    put_u64(bytes, record.cycles);
+    for (unsigned int i = 0; i < 35; ++i)
+        put_u32(bytes, record.registers[i]);
+    put_u32(bytes, record.error.size());
+    bytes += record.error;
+    put_u64(bytes, record.output.size());
+    bytes += record.output;
+
+    // Written aside and renamed into place, so a run reading the entry
+    // at the same time never sees half of it.
+    static std::atomic< uint64_t > next_temp(0);
+    std::string path = entry_path(image_hash, input);
+    std::string temp = path + ".tmp." + std::to_string(getpid()) + "." + std::to_string(next_temp++);
+    std::ofstream out(temp, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+    out.write(bytes.data(), bytes.size());
+    out.close();
+    if (out.fail() || rename(temp.c_str(), path.c_str()) != 0)
+    {
+        unlink(temp.c_str());
+        return;
+    }
+
+    if ((bytes_ += bytes.size()) > RESULT_CACHE_MAX_BYTES)
+        evict();
+
+    return;
+}
+
+// Total size of the entries in the directory, listing each with its
+// modification time if entries is not null.
+uint64_t ResultCache::scan(std::vector< std::pair< timespec, std::string > > * entries) const
+{
+    DIR * dir = opendir(directory_.c_str());
+    if (dir == nullptr)
+        return 0;
+
+    uint64_t total = 0;
+    while (dirent * entry = readdir(dir))
+    {
+        // Entries are 32 hex digits, anything else (a file still being
+        // written, say) is left alone.
+        std::string name = entry->d_name;
+        struct stat st;
+        if (name.size() != 32 || name.find_first_not_of("0123456789abcdef") != std::string::npos
+            || fstatat(dirfd(dir), name.c_str(), &st, 0) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        total += st.st_size;
+        if (entries != nullptr)
+            entries->push_back({st.st_mtim, name});
+    }
+    closedir(dir);
+
+    return total;
+}
+
+// Remove the least recently used entries until the directory is under
+// three quarters of RESULT_CACHE_MAX_BYTES. Only one thread evicts at
+// a time, the others carry on.
+void ResultCache::evict()
+{
+    std::unique_lock< std::mutex > lock(evict_mutex_, std::try_to_lock);
+    if (!lock.owns_lock())
+        return;
+
+    std::vector< std::pair< timespec, std::string > > entries;
+    uint64_t total = scan(&entries);
+    std::sort(entries.begin(), entries.end(),
+              [](const std::pair< timespec, std::string > & a, const std::pair< timespec, std::string > & b)
+              {
+                  return (a.first.tv_sec != b.first.tv_sec ? a.first.tv_sec < b.first.tv_sec
+                          : a.first.tv_nsec < b.first.tv_nsec);
+              });
+
+    for (const std::pair< timespec, std::string > & entry : entries)
+    {
+        if (total <= RESULT_CACHE_MAX_BYTES / 4 * 3)
+            break;
+        std::string path = directory_ + "/" + entry.second;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && unlink(path.c_str()) == 0)
+            total -= std::min< uint64_t >(total, st.st_size);
+    }
+    bytes_ = total;
+
+    return;
+}
+
+std::string ResultCache::report() const
+{
+    uint64_t hits = hits_;
+    uint64_t runs = hits + misses_;
+    std::string rate = (runs == 0 ? "0" : std::to_string(hits * 100 / runs));
+
+    return "Result cache: " + std::to_string(hits) + " hits, " + std::to_string(misses_)
+        + " misses (" + rate + "% hit rate), " + std::to_string(stale_)
+        + " stale from another simulator build, " + std::to_string(corrupt_)
+        + " corrupt, " + std::to_string(uncacheable_)
+        + " runs not cacheable.";
+}
+
+RunRecord run_with_cache(Simulator & sim, const std::string & input, ResultCache * cache,
+                         const uint64_t max_instructions, const size_t max_output)
+{
+    sim.set_session();
+    sim.feed_input(input.data(), input.size());
+    sim.end_input();
+
+    RunRecord record;
+    uint64_t image_hash = (cache != nullptr ? sim.image_hash() : 0);
+    if (cache != nullptr && cache->find(image_hash, input, record))
+    {
+        sim.restore_result(record);
+        return record;
+    }
+
+    // In slices, so the output is checked against max_output as it
+    // grows rather than once the run is over.
+    const uint64_t slice = 1000000;
+    uint64_t left = max_instructions;
+    bool limited = false;
+    sim.start_program();
+    try
+    {
+        while (true)
+        {
+            RunResult result = sim.run_for(std::min(left, slice));
+            record.output += sim.captured_output();
+            if (record.output.size() > max_output)
+            {
+                record.output.resize(max_output);
+                record.error = "Output limit of " + std::to_string(max_output) + " bytes reached, run stopped.";
+                limited = true;
+                break;
+            }
+            if (result != RUN_YIELDED)
+                break;
+            left -= std::min(left, slice);
+            if (left == 0)
+            {
+                record.error = "Instruction limit of " + std::to_string(max_instructions) + " reached, run stopped.";
+                limited = true;
+                break;
+            }
+        }
+    }
+    catch (SimulatorError & e)
+    {
+        record.error = e.what();
+    }
+    catch (std::exception & e)
+    {
+        record.error = std::string("Invalid argument to function: ") + e.what();
+    }
+    record.output += sim.captured_output();
+    if (record.output.size() > max_output)
+        record.output.resize(max_output);
+    sim.save_result(record);
+
+    if (cache != nullptr && !limited)
+    {
+        if (sim.deterministic())
+            cache->store(image_hash, input, record);
+        else
+            cache->count_uncacheable();
+    }
+
+    return record;
+}
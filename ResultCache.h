@@ -0,0 +1,115 @@
+//   File: ResultCache.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include "Common.h"
+
+#include <atomic>
+#include <mutex>
+
+/*
+  Whole runs kept on disk, so running the same program on the same
+  input again prints what it printed last time without executing it.
+
+  A run is only cached if nothing but the program and its input decided
+  its result and all of its output is in what it printed: reading the
+  host clock (syscall 30 outside virtual time), opening a host file
+  (syscall 13), mapping one (syscall 90) or writing to stderr (syscall
+  15 to descriptor 2) rules it out. The whole input has to be known before the run starts.
+
+  An entry is a file in the cache directory named by the hash of the
+  assembled image and the hash of the input, laid out as:
+    magic "MSRC", version (uint32_t), hash of the simulator
+    executable (uint64_t), input length (uint64_t) and bytes, exit
+    status (int32_t), instructions and cycles (uint64_t each), $0-$31,
+    hi, lo and pc (uint32_t each), error length (uint32_t) and bytes,
+    output length (uint64_t) and bytes,
+  all little-endian. The input is kept whole, so two inputs whose
+  hashes collide never share a result. Entries written by any other
+  build of the simulator are stale and entries that do not parse are
+  corrupt, both are removed when found.
+
+  The directory is kept under RESULT_CACHE_MAX_BYTES: once it grows
+  past that, the least recently used entries (by modification time,
+  which a hit updates) are removed until it is back under three
+  quarters of it.
+*/
+
+const char RESULT_CACHE_MAGIC[4] = { 'M', 'S', 'R', 'C' };
+const uint32_t RESULT_CACHE_VERSION = 2;
+const uint64_t RESULT_CACHE_MAX_BYTES = 256 * 1024 * 1024;
+
+// What a run left behind.
+struct RunRecord
+{
+    RunRecord() :
+        exit_status(0),
+        instructions(0),
+        cycles(0),
+        registers()
+    {}
+
+    std::string output;
+    std::string error; // Why it failed, empty if it exited.
+    int32_t exit_status;
+    uint64_t instructions;
+    uint64_t cycles;
+    uint32_t registers[35]; // $0-$31, hi, lo, pc.
+};
+
+class Simulator;
+
+class ResultCache
+{
+public:
+    // Entries go in directory, which is created if it does not exist.
+    ResultCache(const std::string & directory);
+
+    ResultCache(const ResultCache &) = delete;
+    ResultCache & operator=(const ResultCache &) = delete;
+
+    // The run of the program with these hashes on input, if cached.
+    bool find(const uint64_t image_hash, const std::string & input, RunRecord & record);
+    void store(const uint64_t image_hash, const std::string & input, const RunRecord & record);
+
+    // A run that could not be cached.
+    void count_uncacheable()
+    { ++uncacheable_; }
+
+    // Hits, misses, stale and corrupt entries and uncacheable runs so
+    // far, on a line.
+    std::string report() const;
+
+private:
+    std::string directory_;
+    uint64_t build_hash_;
+    std::atomic< uint64_t > hits_;
+    std::atomic< uint64_t > misses_;
+    std::atomic< uint64_t > stale_;
+    std::atomic< uint64_t > corrupt_;
+    std::atomic< uint64_t > uncacheable_;
+
+    // Roughly how many bytes the directory holds. Other processes
+    // sharing it are only seen when it is scanned.
+    std::atomic< uint64_t > bytes_;
+    std::mutex evict_mutex_;
+
+    std::string entry_path(const uint64_t image_hash, const std::string & input) const;
+    uint64_t scan(std::vector< std::pair< timespec, std::string > > * entries) const;
+    void evict();
+};
+
+// Run sim's loaded program on the whole of input, capturing what it
+// prints, unless cache (if not null) already has the result. Either
+// way sim is left as the run left it. A run is stopped with an error
+// once it has executed max_instructions or printed more than
+// max_output bytes (what it printed up to max_output is kept), and is
+// not cached then.
+RunRecord run_with_cache(Simulator & sim, const std::string & input, ResultCache * cache,
+                         const uint64_t max_instructions = UINT64_MAX,
+                         const size_t max_output = SIZE_MAX);
+
+#endif
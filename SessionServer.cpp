@@ -0,0 +1,375 @@
+//   File: SessionServer.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "SessionServer.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+SessionServer::SessionServer(const std::string & socket_path,
+                             const std::shared_ptr< const ProgramImage > & program,
+                             const unsigned int threads) :
+    socket_path_(socket_path),
+    program_(program),
+    listen_fd_(-1),
+    epoll_fd_(-1),
+    wake_fd_(-1),
+    stopping_(false)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (socket_path.size() >= sizeof(address.sun_path))
+        throw SimulatorError("Socket path \"" + socket_path + "\" is too long.");
+    std::memcpy(address.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    // A client that goes away while its program prints is not an error.
+    signal(SIGPIPE, SIG_IGN);
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(socket_path.c_str());
+    if (listen_fd_ < 0 || bind(listen_fd_, (sockaddr *)(&address), sizeof(address)) != 0
+        || listen(listen_fd_, SOMAXCONN) != 0)
+    {
+        if (listen_fd_ >= 0)
+            close(listen_fd_);
+        throw SimulatorError("Unable to listen on \"" + socket_path + "\".");
+    }
+
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd_ < 0 || wake_fd_ < 0)
+        throw SimulatorError("Unable to start the session server.");
+    for (int fd : { listen_fd_, wake_fd_ })
+    {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+    }
+
+    unsigned int n = (threads == 0 ? std::thread::hardware_concurrency() : threads);
+    for (unsigned int i = 0; i < std::max(n, 1u); ++i)
+        workers_.push_back(std::thread(&SessionServer::run_worker, this));
+}
+
+SessionServer::~SessionServer()
+{
+    {
+        std::lock_guard< std::mutex > lock(queue_mutex_);
+        stopping_ = true;
+    }
+    queue_ready_.notify_all();
+    for (std::thread & worker : workers_)
+        worker.join();
+
+    for (const std::pair< const int, std::shared_ptr< Session > > & session : sessions_)
+        close(session.first);
+    close(listen_fd_);
+    if (epoll_fd_ >= 0)
+        close(epoll_fd_);
+    if (wake_fd_ >= 0)
+        close(wake_fd_);
+    unlink(socket_path_.c_str());
+}
+
+void SessionServer::run()
+{
+    epoll_event events[64];
+    while (true)
+    {
+        int n = epoll_wait(epoll_fd_, events, 64, -1);
+        if (n < 0 && errno != EINTR)
+            throw SimulatorError("Session server failed to wait for clients.");
+
+        for (int i = 0; i < n; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listen_fd_)
+                accept_clients();
+            else if (fd == wake_fd_)
+                update_woken();
+            else
+            {
+                std::unordered_map< int, std::shared_ptr< Session > >::iterator it = sessions_.find(fd);
+                if (it == sessions_.end())
+                    continue;
+                std::shared_ptr< Session > session = it->second;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    read_client(session, events[i].events);
+                update_client(session);
+            }
+        }
+    }
+}
+
+void SessionServer::accept_clients()
+{
+    while (true)
+    {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+
+        std::shared_ptr< Session > session;
+        try
+        {
+            session = std::make_shared< Session >(fd, program_);
+            session->sim.set_session();
+            session->sim.start_program();
+        }
+        catch (SimulatorError & e)
+        {
+            std::string message = e.what() + "\n";
+            send(fd, message.data(), message.size(), MSG_NOSIGNAL);
+            close(fd);
+            continue;
+        }
+
+        epoll_event event = {};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event);
+        sessions_[fd] = session;
+
+        std::lock_guard< std::mutex > lock(session->mutex);
+        enqueue(session);
+    }
+}
+
+void SessionServer::read_client(const std::shared_ptr< Session > & session, const uint32_t events)
+{
+    char buffer[64 * 1024];
+    std::string input;
+    bool ended = false;
+    bool closing = (events & (EPOLLHUP | EPOLLERR)) != 0;
+    while (!ended && !closing)
+    {
+        ssize_t n = recv(session->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (n > 0)
+            input.append(buffer, n);
+        else if (n == 0)
+            ended = true;
+        else if (errno == EAGAIN || errno == EWOULDBLOCK)
+            break;
+        else if (errno != EINTR)
+            closing = true;
+    }
+
+    std::lock_guard< std::mutex > lock(session->mutex);
+    if (!session->input_ended)
+    {
+        session->input += input;
+        session->input_ended = ended;
+    }
+    session->closing = session->closing || closing;
+    if (session->state != SESSION_WAITING)
+        return;
+    if (session->closing)
+        session->state = SESSION_DONE;
+    else if (!input.empty() || ended)
+        enqueue(session);
+
+    return;
+}
+
+// Update the sessions workers woke the epoll thread for.
+void SessionServer::update_woken()
+{
+    uint64_t count;
+    while (read(wake_fd_, &count, sizeof(count)) > 0)
+        continue;
+
+    std::vector< std::shared_ptr< Session > > woken;
+    {
+        std::lock_guard< std::mutex > lock(queue_mutex_);
+        woken.swap(to_update_);
+    }
+    for (const std::shared_ptr< Session > & session : woken)
+        if (sessions_.count(session->fd) != 0 && sessions_[session->fd] == session)
+            update_client(session);
+
+    return;
+}
+
+// Write what the session's client will take of its output, then close
+// the connection if the session is done with it, or wait for whatever
+// the session needs from it next. Only called by the epoll thread.
+void SessionServer::update_client(const std::shared_ptr< Session > & session)
+{
+    std::unique_lock< std::mutex > lock(session->mutex);
+    while (session->output_sent < session->output.size() && !session->closing)
+    {
+        ssize_t n = send(session->fd, session->output.data() + session->output_sent,
+                         session->output.size() - session->output_sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (n > 0)
+            session->output_sent += n;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        else if (n < 0 && errno == EINTR)
+            continue;
+        else
+            session->closing = true;
+    }
+    if (session->output_sent == session->output.size() || session->closing)
+    {
+        session->output.clear();
+        session->output_sent = 0;
+    }
+    size_t unsent = session->output.size() - session->output_sent;
+
+    if (session->closing && session->state == SESSION_WAITING)
+        session->state = SESSION_DONE;
+    else if (session->state == SESSION_FULL && unsent <= SESSION_OUTPUT_LIMIT)
+    {
+        if (session->closing)
+            session->state = SESSION_DONE;
+        else
+            enqueue(session);
+    }
+
+    if (session->state == SESSION_DONE && unsent == 0)
+    {
+        int fd = session->fd;
+        lock.unlock();
+
+        // Closing with input left unread resets the connection, which
+        // can lose output the client has not read yet.
+        char buffer[4096];
+        while (recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT) > 0)
+            continue;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+        close(fd);
+        sessions_.erase(fd);
+        return;
+    }
+
+    // A client that is gone is not watched while its session stops.
+    if (session->closing)
+    {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, session->fd, nullptr);
+        return;
+    }
+
+    // Once a client has nothing more to send, its connection is only
+    // written to.
+    epoll_event event = {};
+    event.data.fd = session->fd;
+    if (!session->input_ended)
+        event.events |= EPOLLIN | EPOLLRDHUP;
+    if (unsent > 0)
+        event.events |= EPOLLOUT;
+    epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, session->fd, &event);
+
+    return;
+}
+
+// Called holding the session's mutex.
+void SessionServer::enqueue(const std::shared_ptr< Session > & session)
+{
+    session->state = SESSION_QUEUED;
+    {
+        std::lock_guard< std::mutex > lock(queue_mutex_);
+        run_queue_.push_back(session);
+    }
+    queue_ready_.notify_one();
+
+    return;
+}
+
+// Have the epoll thread, which owns the connections, update a session
+// that has output to write or is done.
+void SessionServer::wake(const std::shared_ptr< Session > & session)
+{
+    {
+        std::lock_guard< std::mutex > lock(queue_mutex_);
+        to_update_.push_back(session);
+    }
+    uint64_t one = 1;
+    while (write(wake_fd_, &one, sizeof(one)) < 0 && errno == EINTR)
+        continue;
+
+    return;
+}
+
+void SessionServer::run_worker()
+{
+    while (true)
+    {
+        std::shared_ptr< Session > session;
+        {
+            std::unique_lock< std::mutex > lock(queue_mutex_);
+            queue_ready_.wait(lock, [&]() { return stopping_ || !run_queue_.empty(); });
+            if (stopping_)
+                return;
+            session = run_queue_.front();
+            run_queue_.pop_front();
+        }
+
+        run_slice(*session);
+
+        std::unique_lock< std::mutex > lock(session->mutex);
+        bool has_output = session->output_sent < session->output.size();
+        if (session->state == SESSION_DONE || session->closing)
+            session->state = SESSION_DONE;
+        else if (session->output.size() - session->output_sent > SESSION_OUTPUT_LIMIT)
+            session->state = SESSION_FULL;
+        else if (session->state == SESSION_QUEUED || !session->input.empty() || session->input_ended)
+            enqueue(session);
+        else
+            session->state = SESSION_WAITING;
+
+        bool done = (session->state == SESSION_DONE);
+        lock.unlock();
+        if (has_output || done)
+            wake(session);
+    }
+}
+
+// Run a session until it exits, waits for input or uses up its slice.
+// Leaves its state DONE if it exited, QUEUED if it used up its slice
+// and RUNNING if it is waiting for input.
+void SessionServer::run_slice(Session & session)
+{
+    {
+        std::lock_guard< std::mutex > lock(session.mutex);
+        session.sim.feed_input(session.input.data(), session.input.size());
+        session.input.clear();
+        if (session.input_ended)
+            session.sim.end_input();
+        session.state = SESSION_RUNNING;
+    }
+
+    RunResult result;
+    std::string error = "";
+    try
+    {
+        result = session.sim.run_for(SESSION_SLICE);
+    }
+    catch (SimulatorError & e)
+    {
+        result = RUN_EXITED;
+        error = e.what() + "\n";
+    }
+    catch (std::exception & e)
+    {
+        result = RUN_EXITED;
+        error = std::string("Invalid argument to function: ") + e.what() + "\n";
+    }
+    std::string output = session.sim.captured_output() + error;
+
+    std::lock_guard< std::mutex > lock(session.mutex);
+    session.output += output;
+    if (result == RUN_EXITED)
+        session.state = SESSION_DONE;
+    else if (result == RUN_YIELDED)
+        session.state = SESSION_QUEUED;
+
+    return;
+}
@@ -0,0 +1,119 @@
+//   File: SessionServer.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef SESSION_SERVER_H
+#define SESSION_SERVER_H
+
+#include "Common.h"
+#include "Simulator.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+/*
+  Runs one program for every client of a Unix socket, each in its own
+  simulator sharing the one assembled image. What a client sends is the
+  program's input, what the program prints is sent back, and the
+  connection is closed when it exits.
+
+  A program waiting for input holds no thread: its read syscall is left
+  to run again (see Simulator::await_input()) and the session sits idle
+  until the client sends a line. One thread watches every connection
+  with epoll, a few workers run the sessions that can make progress,
+  SESSION_SLICE instructions at a time so a busy program does not hold
+  the others up.
+
+  Connections are never waited on. What a program prints is kept with
+  its session and written by the epoll thread as its client takes it,
+  and a session with more than SESSION_OUTPUT_LIMIT bytes of it waiting
+  stops running until its client reads them, so a client that stops
+  reading holds up only its own program.
+*/
+
+const uint64_t SESSION_SLICE = 1000000;
+const size_t SESSION_OUTPUT_LIMIT = 256 * 1024;
+
+class SessionServer
+{
+public:
+    // threads = 0 picks one per core.
+    SessionServer(const std::string & socket_path,
+                  const std::shared_ptr< const ProgramImage > & program,
+                  const unsigned int threads);
+    ~SessionServer();
+
+    SessionServer(const SessionServer &) = delete;
+    SessionServer & operator=(const SessionServer &) = delete;
+
+    // Serve clients, forever.
+    void run();
+
+private:
+    enum SessionState
+    {
+        SESSION_WAITING, // For input, or to start.
+        SESSION_QUEUED,
+        SESSION_RUNNING,
+        SESSION_FULL,    // Waiting for its client to read its output.
+        SESSION_DONE
+    };
+
+    struct Session
+    {
+        Session(const int fd, const std::shared_ptr< const ProgramImage > & program) :
+            fd(fd),
+            sim(program),
+            input_ended(false),
+            output_sent(0),
+            closing(false),
+            state(SESSION_WAITING)
+        {}
+
+        int fd;
+        Simulator sim; // Only touched by the worker running it.
+
+        // Everything below is guarded by mutex. Input is handed to the
+        // simulator by the worker, before it runs it, output is taken
+        // from it after, and written from output_sent on by the epoll
+        // thread.
+        std::mutex mutex;
+        std::string input;
+        bool input_ended;
+        std::string output;
+        size_t output_sent;
+        bool closing; // The client went away, stop at the next chance.
+        SessionState state;
+    };
+
+    std::string socket_path_;
+    std::shared_ptr< const ProgramImage > program_;
+    int listen_fd_;
+    int epoll_fd_;
+    int wake_fd_; // eventfd, a worker has output or a finished session.
+
+    // Sessions by their connection, only touched by the epoll thread.
+    std::unordered_map< int, std::shared_ptr< Session > > sessions_;
+
+    // Sessions that can run, and sessions the epoll thread has to write
+    // out or close.
+    std::mutex queue_mutex_;
+    std::condition_variable queue_ready_;
+    std::deque< std::shared_ptr< Session > > run_queue_;
+    std::vector< std::shared_ptr< Session > > to_update_;
+    bool stopping_;
+    std::vector< std::thread > workers_;
+
+    void accept_clients();
+    void read_client(const std::shared_ptr< Session > & session, const uint32_t events);
+    void update_woken();
+    void update_client(const std::shared_ptr< Session > & session);
+    void enqueue(const std::shared_ptr< Session > & session);
+    void wake(const std::shared_ptr< Session > & session);
+    void run_worker();
+    void run_slice(Session & session);
+};
+
+#endif
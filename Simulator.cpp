@@ -3,6 +3,154 @@
 //   Date: 12/17/2023
 
 #include "Simulator.h"
+#include "PerfectHash.h"
+#include "ObjectFile.h"
+#include "ElfFile.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <endian.h>
+#include <exception>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+// Every mnemonic, including the pseudoinstructions.
+static constexpr PerfectHash< Instruction, 60 > mnemonic_table = make_perfect_hash< Instruction >({
+    { "add",    ADD     },
+    { "addi",   ADDI    },
+    { "addiu",  ADDIU   },
+    { "addu",   ADDU    },
+    { "and",    AND     },
+    { "andi",   ANDI    },
+    { "beq",    BEQ     },
+    { "bne",    BNE     },
+    { "j",      J       },
+    { "jal",    JAL     },
+    { "jr",     JR      },
+    { "lbu",    LBU     },
+    { "lhu",    LHU     },
+    { "lui",    LUI     },
+    { "lw",     LW      },
+    { "nor",    NOR     },
+    { "or",     OR      },
+    { "ori",    ORI     },
+    { "slt",    SLT     },
+    { "slti",   SLTI    },
+    { "sltiu",  SLTIU   },
+    { "sltu",   SLTU    },
+    { "sll",    SLL     },
+    { "srl",    SRL     },
+    { "sb",     SB      },
+    { "sc",     SC      },
+    { "sh",     SH      },
+    { "sw",     SW      },
+    { "sub",    SUB     },
+    { "subu",   SUBU    },
+    { "div",    DIV     },
+    { "divu",   DIVU    },
+    { "mfhi",   MFHI    },
+    { "mflo",   MFLO    },
+    { "mult",   MULT    },
+    { "multu",  MULTU   },
+    { "sra",    SRA     },
+    { "sllv",   SLLV    },
+    { "srav",   SRAV    },
+    { "srlv",   SRLV    },
+    { "xor",    XOR     },
+    { "xori",   XORI    },
+    { "bgtz",   BGTZ    },
+    { "blez",   BLEZ    },
+    { "jalr",   JALR    },
+    { "lb",     LB      },
+    { "lh",     LH      },
+    { "mthi",   MTHI    },
+    { "mtlo",   MTLO    },
+    { "syscall", SYSCALL },
+    { "seq",    SEQ     },
+    { "bgez",   BGEZ    },
+    { "bltz",   BLTZ    },
+    { "move",   MOVE    },
+    { "li",     LI      },
+    { "la",     LA      },
+    { "blt",    BLT     },
+    { "ble",    BLE     },
+    { "bgt",    BGT     },
+    { "bge",    BGE     }
+});
+
+static constexpr PerfectHash< Directive, 11 > directive_table = make_perfect_hash< Directive >({
+    { ".text",   DIRECTIVE_TEXT   },
+    { ".data",   DIRECTIVE_DATA   },
+    { ".globl",  DIRECTIVE_GLOBL  },
+    { ".word",   DIRECTIVE_WORD   },
+    { ".half",   DIRECTIVE_HALF   },
+    { ".byte",   DIRECTIVE_BYTE   },
+    { ".space",  DIRECTIVE_SPACE  },
+    { ".ascii",  DIRECTIVE_ASCII  },
+    { ".asciiz", DIRECTIVE_ASCIIZ },
+    { ".align",  DIRECTIVE_ALIGN  },
+    { ".incbin", DIRECTIVE_INCBIN }
+});
+
+// Watchpoint state shared with the SIGSEGV handler. The handler is
+// process wide, so only one simulator may own watchpoints at a time:
+// the first to protect a page claims watch_owner and every other one
+// is refused until it has no watchpoints left.
+const unsigned int MAX_WATCHED_PAGES = 64;
+static std::atomic< Simulator * > watch_owner(nullptr);
+static uintptr_t watched_pages[MAX_WATCHED_PAGES];
+static volatile sig_atomic_t watched_page_faulted[MAX_WATCHED_PAGES];
+static volatile sig_atomic_t watched_page_count = 0;
+static volatile sig_atomic_t watch_fault_pending = 0;
+static struct sigaction previous_segv_action;
+static const uintptr_t host_page_size = sysconf(_SC_PAGESIZE);
+
+// A store hit a write protected page. If it is one of ours, open the
+// page back up so the store can go through and flag it so the
+// watchpoints get compared once the instruction finishes.
+static void watch_fault_handler(int sig, siginfo_t * info, void *)
+{
+    uintptr_t page = uintptr_t(info->si_addr) & ~(host_page_size - 1);
+    for (int i = 0; i < watched_page_count; ++i)
+    {
+        if (watched_pages[i] == page)
+        {
+            mprotect((void *)(page), host_page_size, PROT_READ | PROT_WRITE);
+            watched_page_faulted[i] = 1;
+            watch_fault_pending = 1;
+            return;
+        }
+    }
+
+    // Not a watched page, let the fault happen as usual.
+    sigaction(sig, &previous_segv_action, nullptr);
+    
+    return;
+}
+
+Simulator::~Simulator()
+{
+    if (watch_owner == this)
+    {
+        watchpoints.clear();
+        protect_watched_pages();
+    }
+    
+    unmap_segment(data, DATA_SEGMENT_SIZE);
+    unmap_segment(heap, MAX_HEAP);
+    unmap_segment(stack, MAX_STACK);
+
+    for (int fd : open_files)
+        if (fd >= 0)
+            close(fd);
+}
 
 
 // Main runner function, lets user decide what mode to run
@@ -57,6 +205,7 @@ void Simulator::run_simulator_mode()
     
     while (running)
     {
+        guest_output.flush();
         std::cout << '[' << mips_segment_str(current_segment) << "] "
                   << "0x" << std::setfill('0') << std::setw(8)
                   << std::hex << program_counter << std::dec
@@ -135,6 +284,11 @@ void Simulator::interpret_input(std::string input)
         print_data_segment();
     }
 
+    else if (input == "heap")
+    {
+        print_heap_stats();
+    }
+
     // Non-mips command for jumping to a previously entered instruction
     // Without locking yourself into an infinite loop using a jump.
     // This will only acccept hexadecimal addresses.
@@ -151,13 +305,33 @@ void Simulator::interpret_input(std::string input)
             // Execute instructions in the text segment from addr to the program counter's value
             while (program_counter != curr_pc)
             {
-                execute(text[(program_counter - TEXT_START) >> 2]);
+                step();
             }
         }
         else
             throw SimulatorError("Invalid hexadecimal goto address.");
     }
 
+    // Watch a label or hexadecimal address, optionally giving the
+    // number of bytes to watch (defaults to a word).
+    else if (input.substr(0, 6) == "watch ")
+    {
+        std::vector< Token > args;
+        Lexer::tokenize(input, args);
+        if (args.size() < 2 || args.size() > 3 || (args.size() == 3 && args[2].type != TOKEN_INTEGER))
+            throw SimulatorError("Usage: watch <label | hexadecimal address> [bytes]");
+        
+        if (args.size() == 3 && args[2].value <= 0)
+            throw SimulatorError("Watchpoints must cover at least one byte.");
+        unsigned int bytes = (args.size() == 3 ? args[2].value : 4);
+        add_watchpoint(parse_address(std::string(args[1].text)), bytes);
+    }
+
+    else if (input.substr(0, 8) == "unwatch ")
+    {
+        remove_watchpoint(parse_address(input.substr(8)));
+    }
+
     // Command for saving to file.
     else if (input.substr(0, 6) == "saveto")
     {
@@ -179,37 +353,36 @@ void Simulator::interpret_input(std::string input)
     // Handle MIPS inputs
     else
     {
-        // Save the base input for later (for saving to file) and turn registers into their
-        // numerical forms (i.e. $sp --> 29)
+        // Save the base input for later (for saving to file).
         std::string saved_input = input;
-        input = replace_registers(input);
 
         // Isolate each part of the input to work with.
-        std::vector< std::string > strs = split_input(input);
+        std::vector< Token > strs;
+        Lexer::tokenize(input, strs);
 
         // Handle a label at the beginning of the instruction
         // ex: "labelname: addiu $s0, $s0, 42"
-        if (strs[0].back() == ':')
+        if (!strs.empty() && strs[0].type == TOKEN_LABEL)
         {
             // Make sure the label is formatted correctly
-            if (!valid_label(strs[0].substr(0, strs[0].size() - 1)))
+            std::string label(strs[0].text);
+            if (!valid_label(label))
                 throw SimulatorError("Invalid label.");
         
             // Put label into the label hashtable
-            strs[0].pop_back();
-            if (labels.find(strs[0]) != labels.end())
+            if (image->labels.find(label) != image->labels.end())
                 throw SimulatorError("Duplicate label.");
-            labels[strs[0]] = program_counter;
+            assembling->labels[label] = program_counter;
 
             // Append onto input list.
-            valid_sim_inputs.push_back(strs[0] + ":");
+            valid_sim_inputs.push_back(label + ":");
 
             // Remove label from input for storage of the
             // string of the command seperately if it was not
             // the only thing input.
             if (strs.size() > 1)
             {
-                saved_input = saved_input.substr(strs[0].size() + 2);
+                saved_input = input.substr(strs[1].text.data() - input.data());
             }
             
             // Remove the label from the strings and continue.
@@ -219,9 +392,6 @@ void Simulator::interpret_input(std::string input)
         // Make sure there is still stuff to do if a label was removed.
         if (!strs.empty())
         {
-            // Change hexidecimal and binary numbers into base 10.
-            format_immediates(strs);
-
             // Handle the pseudoinstructions if necessary.
             Instruction pseudo = Instruction(0);
             if (current_segment == TEXT)
@@ -249,12 +419,12 @@ void Simulator::interpret_input(std::string input)
                 // if it denotes an entrypoint (".globl main"). If not,
                 // check to see if you are in the data segment and act
                 // accordingly depending on the input.
-                if (strs[0][0] == '.')
+                if (strs[0].text[0] == '.')
                 {
                     // Segment change
                     if (strs.size() == 1)
                     {
-                        if (strs[0] == ".text")
+                        if (get_directive(strs[0].text) == DIRECTIVE_TEXT)
                         {
                             // Do nothing if already in text segment.
                             if (current_segment == TEXT)
@@ -272,7 +442,7 @@ void Simulator::interpret_input(std::string input)
                             }
                         }
 
-                        else if (strs[0] == ".data")
+                        else if (get_directive(strs[0].text) == DIRECTIVE_DATA)
                         {
                             // Do nothing if already in data segment.
                             if (current_segment == DATA)
@@ -297,9 +467,9 @@ void Simulator::interpret_input(std::string input)
 
                     // ".globl < label > "
                     // Simply just put this onto the input list.
-                    else if (strs.size() == 2 && strs[0] == ".globl")
+                    else if (strs.size() == 2 && get_directive(strs[0].text) == DIRECTIVE_GLOBL)
                     {
-                        if (!valid_label(strs[1]))
+                        if (!valid_label(std::string(strs[1].text)))
                             throw SimulatorError("Invalid label.");
 
                         // Append onto input list.
@@ -324,13 +494,13 @@ void Simulator::interpret_input(std::string input)
                     }
 
                     // Perform encoding and execute.
-                    uint32_t encoding = encode(strs);
+                    uint32_t encoding = encode(strs, program_counter);
 
                     // DEBUGGING
                     // std::cout << std::bitset<32>(encoding) << std::endl;
 
                     // Save where the input instruction lives in the text segment.
-                    input_addr.push_back({input, program_counter});
+                    input_addr.push_back({saved_input, program_counter});
 
                     // Attempt execution of the encoded instruction.
                     try
@@ -341,13 +511,13 @@ void Simulator::interpret_input(std::string input)
                         // Store the encoding
                         // >> 2 is used to index the text segment
                         // because instruction addresses are 4 bytes large.
-                        text[(old_pc - TEXT_START) >> 2] = encoding;
+                        set_text(old_pc, encoding);
             
                         // if you jumped, execute instructions at that location
                         // until you are back where we are supposed to be.
                         while (program_counter != old_pc + 4)
                         {
-                            execute(text[(program_counter - TEXT_START) >> 2]);
+                            step();
                         }
                     }
                     catch (SimulatorError & e)
@@ -406,8 +576,11 @@ void Simulator::print_simulator_help() const
     std::cout << "\"regs\" - Print the register information screen.\n";
     std::cout << "\"data\" - Print the data segment information screen.\n";
     std::cout << "\"labels\" - Print the label information screen.\n";
+    std::cout << "\"heap\" - Print the heap allocation statistics.\n";
     std::cout << "\"saveto <filename>\" - Save all previous inputs into a file.\n";
     std::cout << "\"goto <hexadecimal address>\" - Jump to a previously input\n\tinstruction without saving a jump instruction.\n";
+    std::cout << "\"watch <label | hexadecimal address> [bytes]\" - Report whenever\n\tthe given memory changes.\n";
+    std::cout << "\"unwatch <label | hexadecimal address>\" - Remove a watchpoint.\n";
     std::cout << "To stop the program, perform syscall 10. i.e. \"li $v0, 10\"\n\tthen \"syscall\".\n";
     return;
 }
@@ -497,11 +670,11 @@ void Simulator::print_labels() const
     std::cout << std::setw(65) << '\n';
     std::cout << std::setfill(' ') << std::hex;
     unsigned int max = 0;
-    for (const std::pair< std::string, uint32_t > & p : labels)
+    for (const std::pair< std::string, uint32_t > & p : image->labels)
         if (p.first.size() > max)
             max = p.first.size();
     ++max;
-    for (const std::pair< std::string, uint32_t > & p : labels)
+    for (const std::pair< std::string, uint32_t > & p : image->labels)
     {
         std::cout << "0x" << std::setfill('0') << std::setw(8)
                   << p.second << '|' << std::setfill(' ')
@@ -579,6 +752,18 @@ void Simulator::print_data_segment() const
     return;
 }
 
+// Display the heap allocator statistics in interpreter mode.
+void Simulator::print_heap_stats() const
+{
+    std::cout << std::setfill('=') << std::setw(65) << '\n';
+    std::cout << "HEAP\n";
+    std::cout << std::setw(65) << '\n';
+    std::cout << std::setfill(' ');
+    heap_allocator.print_stats(std::cout);
+
+    return;
+}
+
 ///////////////////////////////
 ///// Read mode functions /////
 ///////////////////////////////
@@ -586,453 +771,1970 @@ void Simulator::print_data_segment() const
 // Read from file and execute mips instructions.
 void Simulator::run_read_mode()
 {
-    current_segment = NONE;
-    
     std::string filename = "";
-    std::ifstream file;
     while (true)
     {
         // Open file
         std::cout << "Input file to run: ";
         std::getline(std::cin, filename);
-        file.open(filename, std::ios::in);
-        if (!file.fail())
+        if (access(filename.c_str(), R_OK) == 0)
             break;
     }
 
     try
     {
-        // Attempt to execute program.
-        run_file(file);
+        // Attempt to assemble (or load) and execute program.
+        load_file(filename);
+        run_program();
     }
     catch (SimulatorError & e)
     {
         std::cout << e.what() << std::endl;
     }
-    file.close();
     
     return;
 }
 
-// Given a stream to a file, load the file contents and
-// then run through the instructions after they have all been
-// loaded.
-void Simulator::run_file(std::ifstream & file)
+// Assemble a file without running it. The file is mapped rather than
+// read, tokens point straight into it.
+void Simulator::assemble_file(const std::string & filename)
 {
-    std::string line;
-    unsigned int i = 1;
-    while (std::getline(file, line))
+    source_file.reset(new MappedFile(filename));
+    source_files.assign(1, std::make_pair(0u, filename));
+    size_t slash = filename.rfind('/');
+    source_dir = (slash == std::string::npos ? "" : filename.substr(0, slash + 1));
+
+    sim_mode = false;
+    current_segment = NONE;
+    try
     {
-        try
-        {
-            // Prepare the line to be encoded
-            prepare_read_input(line, i);
-            ++i;
-        }
-        catch (SimulatorError & e)
-        {
-            throw SimulatorError("(Line " + std::to_string(i) + ") Simulator Error: " + e.what());
-        }
-        catch (std::invalid_argument & e)
-        {
-            throw SimulatorError("(Line " + std::to_string(i) + ") Invalid argument to function: " + e.what());
-        }
+        assemble(std::string_view((const char *)(source_file->data()), source_file->size()));
+    }
+    catch (SimulatorError & e)
+    {
+        source_file.reset();
+        throw e;
     }
 
-    // Validate the entrypoint
-    if (labels.find(entrypoint_label) != labels.end())
-        entrypoint_addr = labels.find(entrypoint_label)->second;
+    // Lines left for lazy assembly still point into the file.
+    if (lazy_lines.empty())
+        source_file.reset();
+
+    return;
+}
+
+std::shared_ptr< const ProgramImage > Simulator::program_image()
+{
+    encode_lazy_text();
+
+    return image;
+}
+
+const ControlFlowGraph & Simulator::control_flow()
+{
+    encode_lazy_text();
+    if (!control_flow_graph || control_flow_image != image)
+    {
+        control_flow_graph.reset(new ControlFlowGraph(*image, TEXT_START));
+        control_flow_image = image;
+    }
+
+    return *control_flow_graph;
+}
+
+void Simulator::save_object(const std::string & filename)
+{
+    encode_lazy_text();
+    write_object_file(*image, filename);
+
+    return;
+}
+
+void Simulator::load_object(const std::string & filename)
+{
+    load_image(read_object_file(filename, TEXT_START));
+
+    return;
+}
+
+// Linked code is used as is, it only needs predecoding.
+void Simulator::load_elf(const std::string & filename)
+{
+    source_files.clear();
+    assembling = read_elf_file(filename, TEXT_START, TEXT_SEGMENT_SIZE * 4,
+                               DATA_START, DATA_SEGMENT_SIZE);
+    image = assembling;
+
+    unsigned int n = assembling->text.size();
+    assembling->decoded.resize(n);
+    for (unsigned int i = 0; i < n; ++i)
+        store_text(TEXT_START + 4 * i, assembling->text[i], 0);
+    text = assembling->text.data();
+    decoded = assembling->decoded.data();
+    text_size = n;
+
+    std::memcpy(data, assembling->data.data(), assembling->data.size());
+    finish_image(DATA_START + assembling->data.size());
+
+    return;
+}
+
+// Object file, ELF executable or source, by what the file starts with.
+// A pipe can only be read once, so it is always taken as source.
+void Simulator::load_file(const std::string & filename)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) == 0 && !S_ISREG(st.st_mode))
+        assemble_file(filename);
+    else if (is_object_file(filename))
+        load_object(filename);
+    else if (is_elf_file(filename))
+        load_elf(filename);
     else
-        throw SimulatorError("No entrypoint defined. (.globl <label>)");
+        assemble_file(filename);
 
-    // Perform computation on all data segment entries.
-    program_counter = 0x10010000;
-    for (StrsAddressSegmentLine & data : to_be_encoded)
+    return;
+}
+
+// Given the contents of a file, load them into the program image.
+void Simulator::assemble(const std::string_view source)
+{
+    unsigned int threads = assembly_threads;
+    if (threads == 0 && source.size() >= PARALLEL_ASSEMBLY_SIZE)
+        threads = std::thread::hardware_concurrency();
+    threads = std::max(threads, 1u);
+
+    // The line cache goes line by line. Otherwise files are assembled
+    // in two passes, and anything those cannot handle (errors included)
+    // is done again line by line so it is reported the same way.
+    uint32_t text_start = text_seg_addr;
+    uint32_t data_start = data_seg_addr;
+    uint32_t data_end = 0;
+    std::unique_ptr< CachedFile > file;
+    if (line_cache)
+        data_end = assemble_cached(source, file);
+    else
     {
-        if (!data.text)
+        if (!assemble_two_pass(source, threads, data_end))
         {
-            replace_labels(data.strs);
-            add_to_data_segment(data.strs);
+            restart_assembly(text_start, data_start);
+            data_end = assemble_lines(source);
         }
+        apply_relocations();
     }
-    
-    // Replace labels in the instructions with their values.
-    for (StrsAddressSegmentLine & data : to_be_encoded)
-        for (std::string & s : data.strs)
-            if (labels.find(s) != labels.end())
-                s = std::to_string(labels.find(s)->second);
 
-    std::unordered_map< uint32_t, unsigned int > line_numbers;
+    finish_assembly(data_end);
+    if (line_cache)
+        line_cache->set_file(std::move(file));
     
-    // Encode the instructions in the text segment.
-    for (StrsAddressSegmentLine & data : to_be_encoded)
+    return;
+}
+
+// Assemble a file one line at a time. Instructions and data are
+// emitted as each line is read, references to labels that may not be
+// defined yet become relocations which are patched once the whole file
+// has been read. Returns the end of its data.
+uint32_t Simulator::assemble_lines(const std::string_view source)
+{
+    Lexer lexer(source);
+    SourceLine source_line;
+    while (lexer.next_line())
     {
-        if (data.text)
+        try
         {
-            program_counter = data.address;
-            Instruction pseudo = is_pseudo(data.strs[0], data.strs.back());
-            if (pseudo)
-            {
-                read_handle_pseudo(pseudo, data.strs, data.address, data.line, line_numbers);
-            }
-            else
-            {
-                text[(program_counter - TEXT_START) >> 2] = encode(data.strs);
-                line_numbers[program_counter] = data.line;
-            }
+            lex_line(lexer.line_text(), lexer.line(), source_line);
+            emit_line(source_line, place_line(source_line), assembly_output);
+        }
+        catch (SimulatorError & e)
+        {
+            throw SimulatorError("(Line " + std::to_string(lexer.line()) + ") Simulator Error: " + e.what());
         }
     }
 
-    // Set entrypoint
-    program_counter = entrypoint_addr;
+    return (current_segment == DATA ? program_counter : data_seg_addr);
+}
 
-    // Execute instructions until an error occurs or the program exits.
-    while (running)
+// Assemble a file through the line cache. The lines before and after
+// the ones edited since the last assembly are reused as they are when
+// possible, otherwise the whole file is assembled line by line. file is
+// set to what the next assembly can reuse. Returns the end of its data.
+uint32_t Simulator::assemble_cached(const std::string_view source, std::unique_ptr< CachedFile > & file)
+{
+    uint32_t text_start = text_seg_addr;
+    uint32_t data_start = data_seg_addr;
+    uint32_t data_end = 0;
+    if (line_cache->file() != nullptr)
     {
+        file.reset(new CachedFile);
         try
         {
-            execute(text[(program_counter - TEXT_START) >> 2]);
+            if (assemble_changes(source, *line_cache->file(), *file, data_end))
+            {
+                // Only the edited lines went through the cache.
+                line_cache->merge();
+                return data_end;
+            }
         }
         catch (SimulatorError & e)
         {
-            throw SimulatorError(e.what() + " (line " + std::to_string(line_numbers[program_counter]) + ").");
+            // Assembling the whole file reports it the usual way.
         }
+        restart_assembly(text_start, data_start);
     }
-    
-    return;
-}
 
+    file.reset(new CachedFile);
+    try
+    {
+        assemble_changes(source, CachedFile(), *file, data_end);
+    }
+    catch (SimulatorError & e)
+    {
+        line_cache->abandon();
+        throw e;
+    }
+    line_cache->finish();
+
+    return data_end;
+}
 
-void Simulator::prepare_read_input(std::string input, unsigned int line)
+// Assemble source given the last assembly of the file. Whole lines at
+// the start and end of the file that did not change are not assembled
+// again: their words and bytes are copied, the ones after the edit
+// moved by however much it grew or shrank, and only the references
+// whose target (or distance, for branches) changed are patched again.
+// Returns false if something that cannot move would have to, in which
+// case the file has to be assembled from scratch. An empty previous
+// assembles the whole file.
+bool Simulator::assemble_changes(const std::string_view source, const CachedFile & previous,
+                                 CachedFile & file, uint32_t & data_end)
 {
-    // Get rid of comments and get rid of extra whitespace.
-    input = truncate_comments(input);
-    input = strip_useless_whitespace(input);
+    const std::string & old = previous.source;
+    const std::vector< uint32_t > & starts = previous.line_starts;
+    uint32_t old_lines = starts.size();
+    if (previous.incbin || (old_lines > 0 && !(previous.states[0] == line_state())))
+        return false;
 
-    // Ignore empty lines.
-    if (input.size() == 0)
-        return;
+    // Lines up to the first difference, newline included.
+    size_t common = std::mismatch(old.begin(), old.end(), source.begin(), source.end()).first - old.begin();
+    uint32_t prefix = 0;
+    if (old_lines > 0)
+    {
+        prefix = std::upper_bound(starts.begin() + 1, starts.end(), common) - (starts.begin() + 1);
+        if (prefix == old_lines - 1 && common == old.size()
+            && (old.back() == '\n' || source.size() == old.size()))
+            prefix = old_lines;
+    }
+    size_t prefix_end = (prefix < old_lines ? starts[prefix] : old.size());
+
+    // Lines from the last difference on, which have to start a line in
+    // source as well.
+    size_t limit = std::min(old.size(), source.size()) - prefix_end;
+    size_t same_end = 0;
+    while (same_end < limit && old[old.size() - 1 - same_end] == source[source.size() - 1 - same_end])
+        ++same_end;
+    int64_t shift = int64_t(source.size()) - int64_t(old.size());
+    uint32_t first = std::lower_bound(starts.begin() + prefix, starts.end(), old.size() - same_end) - starts.begin();
+    if (first < old_lines && starts[first] + shift > 0 && source[starts[first] + shift - 1] != '\n')
+        ++first;
+
+    // The entrypoint comes from the one .globl in the file.
+    std::vector< uint32_t >::const_iterator globl = std::lower_bound(previous.globl_lines.begin(),
+                                                                      previous.globl_lines.end(), prefix);
+    if (globl != previous.globl_lines.end() && *globl < first)
+        return false;
+    if (prefix > 0 || first < old_lines)
+        entrypoint_label = previous.entrypoint_label;
+
+    auto label_name = [](const std::string_view text, const CachedFile & from, const CachedLabel & label)
+    { return text.substr(from.line_starts[label.line] + label.name_start, label.name_length); };
+    auto by_line = [](const CachedLabel & label, const uint32_t line)
+    { return label.line < line; };
+    uint32_t labels_before = std::lower_bound(previous.labels.begin(), previous.labels.end(), prefix, by_line)
+                             - previous.labels.begin();
+    uint32_t labels_after = std::lower_bound(previous.labels.begin(), previous.labels.end(), first, by_line)
+                            - previous.labels.begin();
+
+    // The lines before the edit.
+    file.source.assign(source.data(), source.size());
+    file.line_starts.assign(starts.begin(), starts.begin() + prefix);
+    file.states.assign(previous.states.begin(), previous.states.begin() + prefix);
+    file.labels.assign(previous.labels.begin(), previous.labels.begin() + labels_before);
+    for (uint32_t line : previous.fixed_lines)
+        if (line < prefix)
+            file.fixed_lines.push_back(line);
+    for (uint32_t line : previous.globl_lines)
+        if (line < prefix)
+            file.globl_lines.push_back(line);
+    if (prefix > 0)
+    {
+        const CachedState & state = previous.states[prefix];
+        restore_state(state);
+
+        uint32_t n = (state.text - TEXT_START) >> 2;
+        assembling->text.assign(previous.text.begin(), previous.text.begin() + n);
+        assembling->decoded.assign(previous.decoded.begin(), previous.decoded.begin() + n);
+        assembling->lines.assign(previous.lines.begin(), previous.lines.begin() + n);
+        text = assembling->text.data();
+        decoded = assembling->decoded.data();
+        text_size = n;
+        std::memcpy(data, previous.data.data(), state.data - DATA_START);
+    }
+    // Symbol id of each label, to find the labels references point to.
+    std::vector< uint32_t > label_symbols;
+    label_symbols.reserve(previous.labels.size());
+    symbols.reserve(previous.labels.size());
+    for (const CachedLabel & label : file.labels)
+        label_symbols.push_back(symbols.define(label_name(source, file, label), label.address));
+
+    // The lines that changed.
+    size_t middle_end = (first < old_lines ? starts[first] + shift : source.size());
+    std::string_view middle = source.substr(prefix_end, middle_end - prefix_end);
+    Lexer lexer(middle);
+    SourceLine source_line;
+    while (lexer.next_line())
+    {
+        unsigned int line = prefix + lexer.line();
+        file.line_starts.push_back(prefix_end + (lexer.line_text().data() - middle.data()));
+        file.states.push_back(line_state());
+        try
+        {
+            assemble_cached_line(lexer.line_text(), source_line, line, file);
+        }
+        catch (SimulatorError & e)
+        {
+            throw SimulatorError("(Line " + std::to_string(line) + ") Simulator Error: " + e.what());
+        }
+    }
+    uint32_t labels_middle_end = file.labels.size();
+    for (uint32_t i = labels_before; i < labels_middle_end; ++i)
+        label_symbols.push_back(symbols.find(label_name(source, file, file.labels[i])));
+    int64_t line_shift = int64_t(prefix + lexer.line()) - int64_t(first);
+
+    // The lines after it, moved.
+    CachedState end = line_state();
+    uint32_t text_shift = 0;
+    uint32_t data_shift = 0;
+    if (first < old_lines)
+    {
+        const CachedState & from = previous.states[first];
+        const CachedState & last = previous.states[old_lines];
+        if (end.segment != from.segment)
+            return false;
+        text_shift = end.text - from.text;
+        data_shift = end.data - from.data;
+        if ((text_shift != 0 || data_shift != 0)
+            && std::lower_bound(previous.fixed_lines.begin(), previous.fixed_lines.end(), first)
+               != previous.fixed_lines.end())
+            return false;
+        if (int64_t(last.text) - from.text + end.text > int64_t(TEXT_START) + 4 * int64_t(TEXT_SEGMENT_SIZE)
+            || int64_t(last.data) - from.data + end.data > int64_t(DATA_START) + DATA_SEGMENT_SIZE)
+            return false;
+
+        uint32_t from_word = (from.text - TEXT_START) >> 2;
+        uint32_t last_word = (last.text - TEXT_START) >> 2;
+        if (last_word > from_word)
+        {
+            uint32_t n = (end.text - TEXT_START) >> 2;
+            assembling->text.resize(n, 0);
+            assembling->decoded.resize(n, SLL);
+            assembling->lines.resize(n, 0);
+            assembling->text.insert(assembling->text.end(), previous.text.begin() + from_word,
+                                    previous.text.begin() + last_word);
+            assembling->decoded.insert(assembling->decoded.end(), previous.decoded.begin() + from_word,
+                                       previous.decoded.begin() + last_word);
+            for (uint32_t i = from_word; i < last_word; ++i)
+                assembling->lines.push_back(previous.lines[i] == 0 ? 0 : previous.lines[i] + line_shift);
+            text = assembling->text.data();
+            decoded = assembling->decoded.data();
+            text_size = assembling->text.size();
+        }
+        std::memcpy(data + (end.data - DATA_START), previous.data.data() + (from.data - DATA_START),
+                    last.data - from.data);
 
-    // Get numerical register values.
-    input = replace_registers(input);
+        for (uint32_t i = first; i < old_lines; ++i)
+        {
+            const CachedState & state = previous.states[i];
+            file.line_starts.push_back(starts[i] + shift);
+            file.states.push_back({state.segment, state.text + text_shift, state.data + data_shift});
+        }
+        for (uint32_t i = labels_after; i < previous.labels.size(); ++i)
+        {
+            CachedLabel label = previous.labels[i];
+            label.line += line_shift;
+            label.address += (label.text_segment ? text_shift : data_shift);
+            file.labels.push_back(label);
+            label_symbols.push_back(symbols.define(label_name(source, file, label), label.address));
+        }
+        for (uint32_t line : previous.fixed_lines)
+            if (line >= first)
+                file.fixed_lines.push_back(line + line_shift);
+        for (uint32_t line : previous.globl_lines)
+            if (line >= first)
+                file.globl_lines.push_back(line + line_shift);
+        end = previous.states[old_lines];
+        end.text += text_shift;
+        end.data += data_shift;
+    }
+    file.states.push_back(end);
+    restore_state(end);
 
-    // Split input into individual parts to process
-    std::vector< std::string > strs = split_input(input);
+    // Patch references. Those of the lines that changed are all new,
+    // the others only need it if what they point to moved.
+    std::vector< uint32_t > label_of_symbol(symbols.symbols().size(), NO_SYMBOL);
+    for (uint32_t i = 0; i < label_symbols.size(); ++i)
+        label_of_symbol[label_symbols[i]] = i;
 
-    // Handle labels
-    if (strs[0].back() == ':')
+    auto reuse = [&](const CachedReference & reference)
     {
-        if (current_segment == NONE)
-            throw SimulatorError("Labels cannot exist outside of a segment.");
-
-        strs[0].pop_back();
-        if (!valid_label(strs[0]))
-            throw SimulatorError("Invalid label.");
-        
-        if (labels.find(strs[0]) != labels.end())
-            throw SimulatorError("Duplicate label.");
+        const CachedLabel & target = previous.labels[reference.label];
+        uint32_t label = reference.label;
+        uint32_t address = target.address;
+        if (target.line >= first)
+        {
+            label = reference.label - labels_after + labels_middle_end;
+            address += (target.text_segment ? text_shift : data_shift);
+        }
+        else if (target.line >= prefix)
+        {
+            // Defined by a line that changed, if it still is.
+            uint32_t id = symbols.find(label_name(old, previous, target));
+            if (id == NO_SYMBOL || !symbols[id].defined)
+                throw SimulatorError("Undefined label.");
+            label = label_of_symbol[id];
+            address = symbols[id].address;
+        }
 
-        // Save the label with address
-        labels[strs[0]] = program_counter;
+        bool after = (reference.line >= first);
+        bool text_reference = (reference.type == RELOC_BRANCH || reference.type == RELOC_JUMP
+                               || reference.type == RELOC_HI || reference.type == RELOC_LO);
+        uint32_t site = reference.address + (!after ? 0 : text_reference ? text_shift : data_shift);
+        if (reference.type == RELOC_BRANCH ? address - site != target.address - reference.address
+                                           : address != target.address)
+            relocate(site, address, reference.type);
 
-        // Remove the label from the strings and continue.
-        strs.erase(strs.begin());
-    }
+        file.references.push_back({site, label, reference.type,
+                                   uint32_t(after ? reference.line + line_shift : reference.line)});
+    };
 
-    // Make sure there wasnt only a label
-    if (!strs.empty())
+    std::vector< CachedReference >::const_iterator reference = previous.references.begin();
+    for (; reference != previous.references.end() && reference->line < prefix; ++reference)
+        reuse(*reference);
+    for (const Relocation & relocation : assembly_output.relocations)
     {
-        // Change binary and hex numbers into base 10 for consistent computation.
-        format_immediates(strs);
+        apply_relocation(relocation);
+        file.references.push_back({relocation.address, label_of_symbol[relocation.symbol],
+                                   relocation.type, relocation.line - 1});
+    }
+    for (; reference != previous.references.end(); ++reference)
+        if (reference->line >= first)
+            reuse(*reference);
 
-        // Handle the pseudoinstructions if necessary.
-        if (current_segment == TEXT)
-        {
-            // Check for pseudoinstructions, throw errors if they are not formatted correctly.
-            Instruction pseudo = is_pseudo(strs[0], strs.back());
-            if (pseudo)
-            {
-                switch (pseudo)
-                {
-                    case MOVE:
-                        if (strs.size() != 3)
-                            throw SimulatorError("Invalid parameters for pseudoinstruction " + strs[0] + ".");
-                        // Only one instruction, dont move PC.
-                        break;
-                    case LI:
-                        if (strs.size() != 3)
-                            throw SimulatorError("Invalid parameters for pseudoinstruction " + strs[0] + ".");
-                        program_counter += 4; // Read mode will force 2 instructions for consistency.
-                        break;
-                    case LW:
-                        if (strs.size() != 3)
-                            throw SimulatorError("Invalid parameters for pseudoinstruction " + strs[0] + ".");
-                        program_counter += 8;
-                        break;
-                    case LA:
-                        if (strs.size() != 3)
-                            throw SimulatorError("Invalid parameters for pseudoinstruction " + strs[0] + ".");
-                        program_counter += 4;
-                        break;
-                    case BLT:
-                        if (strs.size() != 4)
-                            throw SimulatorError("Invalid parameters for pseudoinstruction " + strs[0] + ".");
-                        program_counter += 4;
-                        break;
-                    case BLE:
-                        if (strs.size() != 4)
-                            throw SimulatorError("Invalid parameters for pseudoinstruction " + strs[0] + ".");
-                        program_counter += 4;
-                        break;
-                    case BGT:
-                        if (strs.size() != 4)
-                            throw SimulatorError("Invalid parameters for pseudoinstruction " + strs[0] + ".");
-                        program_counter += 4;
-                        break;
-                    case BGE:
-                        if (strs.size() != 4)
-                            throw SimulatorError("Invalid parameters for pseudoinstruction " + strs[0] + ".");
-                        program_counter += 4;
-                        break;
-                }
-            } // if (pseudo)
-        } // if (current_segment == TEXT)
+    data_end = end.data;
+    file.entrypoint_label = entrypoint_label;
+    file.text = assembling->text;
+    file.decoded = assembling->decoded;
+    file.lines = assembling->lines;
+    file.data.assign(data, data + (data_end - DATA_START));
 
-        // '.' input, check to see if it is a segment change or
-        // if it denotes an entrypoint (".globl main"). If not,
-        // check to see if you are in the data segment and act
-        // accordingly depending on the input.
-        if (strs[0][0] == '.')
-        {
-            // Segment change
-            if (strs.size() == 1)
-            {
-                if (strs[0] == ".text")
-                {
-                    switch (current_segment)
-                    {
-                        case TEXT: // Ignore
-                            break;
-                        case DATA:
-                            current_segment = TEXT;
-                            data_seg_addr = program_counter;
-                            program_counter = text_seg_addr;
-                            break;
-                        case NONE:
-                            current_segment = TEXT;
-                            program_counter = text_seg_addr;
-                            break;
-                    }
-                }
+    return true;
+}
 
-                else if (strs[0] == ".data")
-                {
-                    switch (current_segment)
-                    {
-                        case TEXT:
-                            current_segment = DATA;
-                            text_seg_addr = program_counter;
-                            program_counter = data_seg_addr;
-                            break;
-                        case DATA: // Ignore
-                            break;
-                        case NONE:
-                            current_segment = DATA;
-                            program_counter = data_seg_addr;
-                    }
-                }
-            }
+// Where assembly stands, to pick up from there later.
+CachedState Simulator::line_state() const
+{
+    switch (current_segment)
+    {
+        case TEXT:
+            return { TEXT, program_counter, data_seg_addr };
+        case DATA:
+            return { DATA, text_seg_addr, program_counter };
+        default:
+            return { NONE, text_seg_addr, data_seg_addr };
+    }
+}
 
-            // ".globl < label > "
-            // Simply just put this onto the input list.
-            else if (strs.size() == 2 && strs[0] == ".globl")
-            {
-                if (!valid_label(strs[1]))
-                    throw SimulatorError("Invalid label.");
-                if (entrypoint_label != "")
-                    throw SimulatorError("Entrypoint already set (Duplicate .globl).");
+void Simulator::restore_state(const CachedState & state)
+{
+    current_segment = MipsSegment(state.segment);
+    text_seg_addr = state.text;
+    data_seg_addr = state.data;
+    if (current_segment == TEXT)
+        program_counter = state.text;
+    else if (current_segment == DATA)
+        program_counter = state.data;
 
-                // Set the entrypoint label.
-                entrypoint_label = strs[1];
+    return;
+}
 
-                return;
+// Run job(0) .. job(count - 1) on up to threads threads. If a job
+// throws, the jobs not started yet are skipped and the first exception
+// is rethrown here once every thread has finished.
+template< typename Job >
+static void parallel_for(const unsigned int count, const unsigned int threads, Job job)
+{
+    std::atomic< unsigned int > next(0);
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto work = [&]()
+    {
+        unsigned int i;
+        while ((i = next++) < count)
+        {
+            try
+            {
+                job(i);
             }
-
-            else
+            catch (...)
             {
-                // Move forward prorgam counter based on how much data
-                // is input for label computation.
-                std::string type = strs[0];
-                if (type == ".word")
-                {
-                    program_counter += (strs.size() - 1) * 4;
-                }
-                else if (type == ".half")
-                {
-                    program_counter += (strs.size() - 1) * 2;
-                }
-                else if (type == ".byte")
-                {
-                    program_counter += (strs.size() - 1);
-                }
-                else if (type == ".space")
-                {
-                    program_counter += std::stoi(strs[1]);
-                }
-                else if (type == ".asciiz")
-                {
-                    read_format_ascii_escape_sequences(strs[1]);
-                    program_counter += strs[1].size() - 1;
-                }
-                else if (type == ".ascii")
-                {
-                    read_format_ascii_escape_sequences(strs[1]);
-                    program_counter += strs[1].size() - 2;
-                }
-                else
-                    throw SimulatorError("Unsupported data segment data type.");
-
-                // store data segment input with address 0, address
-                // will get worked out in the data storage.
-                to_be_encoded.push_back({strs, 0, false, line});
+                std::lock_guard< std::mutex > lock(error_mutex);
+                if (!error)
+                    error = std::current_exception();
+                next = count;
             }
-        } // if (strs[0][0] == '.')
-
-        // Handle text segment inputs
-        else if (current_segment = TEXT)
-        {
-            // Grab instruction to be encoded later.
-            to_be_encoded.push_back({strs, program_counter, true, line});
-            program_counter += 4;
         }
+    };
 
-        // If you somehow made it here, you have a very interesting input in the
-        // data segment.
-        else
-            SimulatorError("Invalid data segment input.");
-       
-    } // if (!strs.empty())
+    std::vector< std::thread > workers;
+    for (unsigned int i = 1; i < threads && i < count; ++i)
+        workers.emplace_back(work);
+    work();
+    for (std::thread & worker : workers)
+        worker.join();
+
+    if (error)
+        std::rethrow_exception(error);
 
     return;
 }
 
-
-// Read file mode handling of pseudoinstructions
-void Simulator::read_handle_pseudo(const Instruction & ins,
-                                   const std::vector< std::string > & strs,
-                                   const uint32_t & addr,
-                                   const unsigned int line,
-                                   std::unordered_map< uint32_t, unsigned int > & line_numbers)
+// Where a line's contents go given the segment state before it, which
+// is moved past the line.
+static uint32_t line_address(const SourceLine & source, MipsSegment & segment,
+                             uint32_t & text_pc, uint32_t & data_pc)
 {
-    uint32_t immediate;
-    uint16_t param;
-
-    // Split each pseudoinstruction into its composite
-    // instructions and encode them.
-    switch (ins)
+    uint32_t addr = 0;
+    switch (source.kind)
     {
-        case MOVE:
-            line_numbers[addr] = line;
-            text[(addr - TEXT_START) >> 2] = encode({"addu", strs[1], "$0", strs[2]});
-            break;
-        case LI:
-            immediate = std::stoi(strs[2]);
-            param = immediate & 0b1111111111111111;
-            text[(addr - TEXT_START - 4) >> 2] = encode({"ori", strs[1], "$0", std::to_string(param)});
-            param = immediate >> 16;
-            text[(addr - TEXT_START) >> 2] = encode({"lui", strs[1], std::to_string(param)});
-            line_numbers[addr] = line;
-            line_numbers[addr - 4] = line;
-            break;
-        case LW:
-            immediate = labels[strs[2]];
-            param = immediate & 0b1111111111111111;
-            text[(addr - TEXT_START - 8) >> 2] = encode({"ori", "$1", "$0", std::to_string(param)});
-            param = immediate >> 16;
-            text[(addr - TEXT_START - 4) >> 2] = encode({"lui", "$1", std::to_string(param)});
-            text[(addr - TEXT_START) >> 2] = encode({"lw", strs[1], "$1", "0"});
-            line_numbers[addr] = line;
-            line_numbers[addr - 4] = line;
-            line_numbers[addr - 8] = line;
-            break;
-        case LA:
-            immediate = std::stoi(strs[2]);
-            param = immediate & 0b1111111111111111;
-            text[(addr - TEXT_START - 4) >> 2] = encode({"ori", strs[1], "$0", std::to_string(param)});
-            param = immediate >> 16;
-            text[(addr - TEXT_START) >> 2] = encode({"lui", strs[1], std::to_string(param)});
-            line_numbers[addr] = line;
-            line_numbers[addr - 4] = line;
-            break;
-        case BLT:
-            text[(addr - TEXT_START - 4) >> 2] = encode({"slt", "$1", strs[1], strs[2]});
-            text[(addr - TEXT_START) >> 2] = encode({"bne", "$1", "$0", strs[3]});
-            line_numbers[addr] = line;
-            line_numbers[addr - 4] = line;
+        case LINE_SEGMENT:
+            if (source.directive == DIRECTIVE_TEXT)
+                segment = TEXT;
+            else if (source.directive == DIRECTIVE_DATA)
+                segment = DATA;
             break;
-        case BLE:
-            text[(addr - TEXT_START - 4) >> 2] = encode({"slt", "$1", strs[2], strs[1]});
-            text[(addr - TEXT_START) >> 2] = encode({"beq", "$1", "$0", strs[3]});
-            line_numbers[addr] = line;
-            line_numbers[addr - 4] = line;
+        case LINE_DATA:
+            addr = data_pc;
+            data_pc += source.size;
             break;
-        case BGT:
-            text[(addr - TEXT_START - 4) >> 2] = encode({"slt", "$1", strs[2], strs[1]});
-            text[(addr - TEXT_START) >> 2] = encode({"bne", "$1", "$0", strs[3]});
-            line_numbers[addr] = line;
-            line_numbers[addr - 4] = line;
+        case LINE_INSTRUCTION:
+            addr = text_pc;
+            text_pc += source.size;
             break;
-        case BGE:
-            text[(addr - TEXT_START - 4) >> 2] = encode({"slt", "$1", strs[1], strs[2]});
-            text[(addr - TEXT_START) >> 2] = encode({"beq", "$1", "$0", strs[3]});
-            line_numbers[addr] = line;
-            line_numbers[addr - 4] = line;
+        default:
             break;
     }
+
+    return addr;
+}
+
+/*
+  Assemble a file in two passes, producing exactly what assemble_lines()
+  would while only keeping the labels in memory. The file is split into
+  chunks of whole lines, one chunk per thread or a few:
+    1. Each chunk is lexed and sized, and its labels found.
+    2. Adding up the sizes of the chunks before it gives each chunk its
+       starting addresses, segment and line number. The labels and
+       entrypoint are collected in order.
+    3. Each chunk is lexed again and encoded straight into the (already
+       sized) text segment and the data segment.
+  Returns false, with the assembly left half done, if the file has
+  anything wrong with it.
+*/
+bool Simulator::assemble_two_pass(const std::string_view source, const unsigned int threads,
+                                  uint32_t & data_end)
+{
+    // A few chunks per thread, so one slow chunk does not hold the
+    // others up.
+    std::vector< SourceChunk > chunks;
+    size_t n = source.size();
+    size_t start = 0;
+    unsigned int count = (threads == 1 ? 1 : threads * 4);
+    for (unsigned int i = 1; i <= count && start < n; ++i)
+    {
+        size_t end = source.find('\n', std::max(start, n / count * i));
+        end = (end == std::string_view::npos || i == count ? n : end + 1);
+        chunks.emplace_back();
+        chunks.back().source = source.substr(start, end - start);
+        start = end;
+    }
+
+    parallel_for(chunks.size(), threads, [&](const unsigned int i) { size_chunk(chunks[i], lazy_assembly); });
+
+    MipsSegment segment = current_segment;
+    uint64_t text_pc = text_seg_addr;
+    uint64_t data_pc = data_seg_addr;
+    unsigned int line = 0;
+    for (SourceChunk & chunk : chunks)
+    {
+        if (chunk.failed || !chunk.valid[segment])
+            return false;
+
+        chunk.start_segment = segment;
+        chunk.text_start = text_pc;
+        chunk.data_start = data_pc;
+        chunk.first_line = line;
+        segment = chunk.end_segment[segment];
+        text_pc += chunk.text_bytes;
+        data_pc += chunk.data_bytes;
+        line += chunk.line_count;
+
+        for (LazyLine & text_line : chunk.text_lines)
+        {
+            text_line.line += chunk.first_line;
+            text_line.address += chunk.text_start;
+        }
+        for (LazyLine & data_line : chunk.data_lines)
+        {
+            data_line.line += chunk.first_line;
+            data_line.address += chunk.data_start;
+        }
+
+        for (const ChunkLabel & label : chunk.labels)
+        {
+            if (symbols.find(label.name) != NO_SYMBOL)
+                return false;
+            if ((label.segment == NONE ? chunk.start_segment : label.segment) == TEXT)
+                symbols.define(label.name, chunk.text_start + label.text_offset);
+            else
+                symbols.define(label.name, chunk.data_start + label.data_offset);
+        }
+
+        for (const SourceLine & globl : chunk.globls)
+        {
+            if (entrypoint_label != "" || globl.tokens[1].type != TOKEN_NAME
+                || !valid_label(std::string(globl.tokens[1].text)))
+                return false;
+            entrypoint_label = globl.tokens[1].text;
+        }
+    }
+    if (text_pc - TEXT_START > uint64_t(TEXT_SEGMENT_SIZE) * 4
+        || data_pc - DATA_START > DATA_SEGMENT_SIZE)
+        return false;
+
+    uint32_t words = (text_pc - TEXT_START) >> 2;
+    assembling->text.assign(words, 0);
+    assembling->decoded.assign(words, SLL);
+    assembling->lines.assign(words, 0);
+
+    if (lazy_assembly)
+    {
+        // Only the data goes in now, the text waits until it runs.
+        AssemblyOutput out = AssemblyOutput();
+        out.second_pass = true;
+        SourceLine source;
+        try
+        {
+            for (const SourceChunk & chunk : chunks)
+                for (const LazyLine & data_line : chunk.data_lines)
+                {
+                    lex_line(data_line.text, data_line.line, source);
+                    emit_line(source, data_line.address, out);
+                }
+        }
+        catch (SimulatorError & e)
+        {
+            return false;
+        }
+
+        assembling->decoded.assign(words, NOT_ENCODED);
+        for (const SourceChunk & chunk : chunks)
+            lazy_lines.insert(lazy_lines.end(), chunk.text_lines.begin(), chunk.text_lines.end());
+
+        // Line numbers are known already, for errors in lines that
+        // have not been encoded.
+        unsigned int n = lazy_lines.size();
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            uint32_t end = (i + 1 < n ? lazy_lines[i + 1].address : uint32_t(text_pc));
+            for (uint32_t addr = lazy_lines[i].address; addr < end; addr += 4)
+                assembling->lines[(addr - TEXT_START) >> 2] = lazy_lines[i].line;
+        }
+        lazy_image = assembling;
+    }
+
+    std::vector< char > failed(lazy_assembly ? 0 : chunks.size(), false);
+    parallel_for(failed.size(), threads, [&](const unsigned int i)
+    {
+        try
+        {
+            emit_chunk(chunks[i]);
+        }
+        catch (SimulatorError & e)
+        {
+            failed[i] = true;
+        }
+    });
+    for (const char chunk_failed : failed)
+        if (chunk_failed)
+            return false;
+
+    // Leave the segments as the last line did.
+    current_segment = segment;
+    text_seg_addr = text_pc;
+    data_seg_addr = data_pc;
+    program_counter = (segment == DATA ? data_seg_addr : text_seg_addr);
+    text = assembling->text.data();
+    decoded = assembling->decoded.data();
+    text_size = assembling->text.size();
+    data_end = data_pc;
+
+    return true;
+}
+
+// First pass over a chunk: size it, see which segments it can start
+// in and find its labels and entrypoint.
+void Simulator::size_chunk(SourceChunk & chunk, const bool lazy) const
+{
+    chunk.text_bytes = 0;
+    chunk.data_bytes = 0;
+    chunk.failed = false;
+
+    // Which segment the chunk starts in is not known yet, so try each.
+    // After its first segment change they all agree.
+    MipsSegment segments[3] = { NONE, TEXT, DATA };
+    bool valid[3] = { true, true, true };
+    MipsSegment known = NONE;
+
+    Lexer lexer(chunk.source);
+    SourceLine source;
+    while (lexer.next_line())
+    {
+        lex_line(lexer.line_text(), lexer.line(), source);
+
+        // Where .align pads to depends on the chunks before this one.
+        if (source.kind == LINE_ALIGN)
+            chunk.failed = true;
+
+        if (!source.label.empty())
+        {
+            if (!valid_label(std::string(source.label)))
+                chunk.failed = true;
+            valid[NONE] = valid[NONE] && segments[NONE] != NONE;
+            chunk.labels.push_back({source.label, known, uint32_t(chunk.text_bytes),
+                                    uint32_t(chunk.data_bytes)});
+        }
+
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            switch (source.kind)
+            {
+                case LINE_INVALID:
+                    valid[i] = false;
+                    break;
+                case LINE_SEGMENT:
+                    if (source.directive == DIRECTIVE_TEXT)
+                        segments[i] = TEXT;
+                    else if (source.directive == DIRECTIVE_DATA)
+                        segments[i] = DATA;
+                    break;
+                case LINE_DATA:
+                    valid[i] = valid[i] && segments[i] == DATA;
+                    break;
+                case LINE_INSTRUCTION:
+                    valid[i] = valid[i] && segments[i] == TEXT;
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (source.kind == LINE_SEGMENT && segments[NONE] != NONE)
+            known = segments[NONE];
+
+        if (source.kind == LINE_GLOBL)
+            chunk.globls.push_back(source);
+        else if (source.kind == LINE_INSTRUCTION)
+        {
+            if (lazy)
+                chunk.text_lines.push_back({lexer.line_text(), lexer.line(), uint32_t(chunk.text_bytes)});
+            chunk.text_bytes += source.size;
+        }
+        else if (source.kind == LINE_DATA)
+        {
+            if (lazy)
+                chunk.data_lines.push_back({lexer.line_text(), lexer.line(), uint32_t(chunk.data_bytes)});
+            chunk.data_bytes += source.size;
+        }
+    }
+    chunk.line_count = lexer.line();
+
+    for (unsigned int i = 0; i < 3; ++i)
+    {
+        chunk.valid[i] = valid[i];
+        chunk.end_segment[i] = segments[i];
+    }
+
+    return;
+}
+
+// Second pass over a chunk: encode every line.
+void Simulator::emit_chunk(const SourceChunk & chunk)
+{
+    AssemblyOutput out = AssemblyOutput();
+    out.second_pass = true;
+
+    MipsSegment segment = chunk.start_segment;
+    uint32_t text_pc = chunk.text_start;
+    uint32_t data_pc = chunk.data_start;
+    Lexer lexer(chunk.source);
+    SourceLine source;
+    while (lexer.next_line())
+    {
+        lex_line(lexer.line_text(), chunk.first_line + lexer.line(), source);
+        emit_line(source, line_address(source, segment, text_pc, data_pc), out);
+    }
+
+    return;
+}
+
+// Throw away a partly assembled file to assemble it again.
+void Simulator::restart_assembly(const uint32_t text_start, const uint32_t data_start)
+{
+    assembling = std::make_shared< ProgramImage >();
+    image = assembling;
+    text = nullptr;
+    decoded = nullptr;
+    text_size = 0;
+
+    unmap_segment(data, DATA_SEGMENT_SIZE);
+    data = nullptr;
+    data = map_segment(DATA_SEGMENT_SIZE);
+
+    symbols.clear();
+    assembly_output = AssemblyOutput();
+    lazy_lines.clear();
+    lazy_image.reset();
+    current_segment = NONE;
+    text_seg_addr = text_start;
+    data_seg_addr = data_start;
+    entrypoint_label = "";
+
+    return;
+}
+
+// Move what assembling collected into the image and hand it over.
+void Simulator::finish_assembly(const uint32_t data_end)
+{
+    // Only defined labels make it into the image. They go in by
+    // address so the image does not depend on the order the labels
+    // were first seen in.
+    std::vector< Symbol > defined;
+    for (const Symbol & symbol : symbols.symbols())
+        if (symbol.defined)
+            defined.push_back(symbol);
+    std::sort(defined.begin(), defined.end(), [](const Symbol & a, const Symbol & b)
+              { return a.address != b.address ? a.address < b.address : a.name < b.name; });
+    assembling->labels.reserve(defined.size());
+    for (const Symbol & symbol : defined)
+        assembling->labels[std::string(symbol.name)] = symbol.address;
+    if (lazy_lines.empty())
+        symbols.clear();
+    assembly_output = AssemblyOutput();
+    
+    // Validate the entrypoint
+    if (image->labels.find(entrypoint_label) != image->labels.end())
+        assembling->entrypoint = image->labels.find(entrypoint_label)->second;
+    else
+        throw SimulatorError("No entrypoint defined. (.globl <label>)");
+
+    finish_image(data_end);
+
+    return;
+}
+
+void Simulator::assemble_files(const std::vector< std::string > & filenames)
+{
+    if (filenames.size() == 1)
+    {
+        assemble_file(filenames[0]);
+        return;
+    }
+
+    // Only files the cache has not seen as they are now get assembled.
+    unsigned int n = filenames.size();
+    std::vector< std::unique_ptr< MappedFile > > files(n);
+    std::vector< std::string_view > sources(n);
+    std::vector< std::shared_ptr< const LinkUnit > > units(n);
+    std::vector< unsigned int > missing;
+    for (unsigned int i = 0; i < n; ++i)
+    {
+        files[i].reset(new MappedFile(filenames[i]));
+        sources[i] = std::string_view((const char *)(files[i]->data()), files[i]->size());
+        if (unit_cache)
+            units[i] = unit_cache->find(filenames[i], sources[i]);
+        if (!units[i])
+            missing.push_back(i);
+    }
+
+    unsigned int threads = assembly_threads;
+    if (threads == 0)
+        threads = std::thread::hardware_concurrency();
+    threads = std::max(threads, 1u);
+
+    std::vector< std::string > errors(n);
+    parallel_for(missing.size(), threads, [&](const unsigned int j)
+    {
+        unsigned int i = missing[j];
+        try
+        {
+            Simulator sim;
+            units[i] = sim.assemble_unit(filenames[i], sources[i]);
+        }
+        catch (SimulatorError & e)
+        {
+            errors[i] = e.what();
+        }
+    });
+    for (unsigned int i = 0; i < n; ++i)
+        if (errors[i] != "")
+            throw SimulatorError(filenames[i] + ": " + errors[i]);
+
+    if (unit_cache)
+        for (unsigned int i : missing)
+            unit_cache->insert(sources[i], units[i]);
+
+    link(units);
+
+    return;
+}
+
+// Assemble one file of several, leaving every label reference for
+// link() to fill in.
+std::shared_ptr< const LinkUnit > Simulator::assemble_unit(const std::string & filename,
+                                                           const std::string_view source)
+{
+    size_t slash = filename.rfind('/');
+    source_dir = (slash == std::string::npos ? "" : filename.substr(0, slash + 1));
+    sim_mode = false;
+    current_segment = NONE;
+    assembling_unit = true;
+    data_alignment = LINK_DATA_ALIGN;
+    uint32_t data_end = assemble_lines(source);
+
+    std::shared_ptr< LinkUnit > unit = std::make_shared< LinkUnit >();
+    unit->filename = filename;
+    unit->text = assembling->text;
+    unit->lines = assembling->lines;
+    unit->data.assign(data, data + (data_end - DATA_START));
+    unit->data_alignment = data_alignment;
+    unit->position_dependent = assembly_output.position_dependent;
+    unit->incbin_files = assembling->incbin_files;
+
+    for (const Symbol & symbol : symbols.symbols())
+    {
+        bool in_text = symbol.address < DATA_START;
+        uint32_t offset = (!symbol.defined ? 0 : symbol.address - (in_text ? TEXT_START : DATA_START));
+        unit->symbols.push_back({ std::string(symbol.name), symbol.defined, in_text, offset });
+    }
+
+    for (const Relocation & relocation : assembly_output.relocations)
+    {
+        bool in_text = relocation.address < DATA_START;
+        uint32_t offset = relocation.address - (in_text ? TEXT_START : DATA_START);
+        unit->relocations.push_back({ in_text, offset, relocation.symbol, relocation.type, relocation.line });
+    }
+
+    for (const std::string_view globl : globls)
+    {
+        uint32_t id = symbols.find(globl);
+        if (id == NO_SYMBOL || !symbols[id].defined)
+            throw SimulatorError("Undefined .globl label " + std::string(globl) + ".");
+        unit->globls.push_back(std::string(globl));
+    }
+
+    return unit;
+}
+
+// Lay the files out one after another in each segment, then point
+// every reference at the label of that name in its own file, or else
+// at the .globl label of that name in any file.
+void Simulator::link(const std::vector< std::shared_ptr< const LinkUnit > > & units)
+{
+    restart_assembly(TEXT_START, DATA_START);
+    source_files.clear();
+
+    unsigned int n = units.size();
+    std::vector< uint32_t > text_base(n);
+    std::vector< uint32_t > data_base(n);
+    uint64_t text_pc = TEXT_START;
+    uint64_t data_pc = DATA_START;
+    for (unsigned int u = 0; u < n; ++u)
+    {
+        const LinkUnit & unit = *units[u];
+        if (unit.position_dependent && text_pc != TEXT_START)
+            throw SimulatorError(unit.filename + ": Branches to numeric addresses only work in the first file.");
+
+        source_files.push_back(std::make_pair(uint32_t((text_pc - TEXT_START) >> 2), unit.filename));
+        assembling->incbin_files.insert(assembling->incbin_files.end(), unit.incbin_files.begin(),
+                                        unit.incbin_files.end());
+        text_base[u] = text_pc;
+        text_pc += uint64_t(unit.text.size()) * 4;
+        data_pc = (data_pc + unit.data_alignment - 1) / unit.data_alignment * unit.data_alignment;
+        data_base[u] = data_pc;
+        data_pc += unit.data.size();
+    }
+    if (text_pc - TEXT_START > uint64_t(TEXT_SEGMENT_SIZE) * 4)
+        throw SimulatorError("Text segment is full.");
+    if (data_pc - DATA_START > DATA_SEGMENT_SIZE)
+        throw SimulatorError("Data segment is full.");
+
+    uint32_t words = (text_pc - TEXT_START) >> 2;
+    assembling->text.assign(words, 0);
+    assembling->decoded.assign(words, SLL);
+    assembling->lines.assign(words, 0);
+    for (unsigned int u = 0; u < n; ++u)
+    {
+        const LinkUnit & unit = *units[u];
+        for (uint32_t i = 0; i < unit.text.size(); ++i)
+            store_text(text_base[u] + 4 * i, unit.text[i], unit.lines[i]);
+        std::memcpy(data + (data_base[u] - DATA_START), unit.data.data(), unit.data.size());
+    }
+
+    auto address = [&](const unsigned int u, const bool in_text, const uint32_t offset)
+    { return (in_text ? text_base[u] : data_base[u]) + offset; };
+
+    // Every defined label by name, to find the .globl ones and to see
+    // which names more than one file uses.
+    std::unordered_map< std::string_view, uint32_t > globals;
+    std::unordered_map< std::string_view, unsigned int > definitions;
+    for (unsigned int u = 0; u < n; ++u)
+    {
+        const LinkUnit & unit = *units[u];
+        std::unordered_map< std::string_view, uint32_t > defined;
+        for (const UnitSymbol & symbol : unit.symbols)
+            if (symbol.defined)
+            {
+                defined[symbol.name] = address(u, symbol.text, symbol.offset);
+                ++definitions[symbol.name];
+            }
+
+        for (const std::string & globl : unit.globls)
+            if (!globals.insert({ globl, defined[globl] }).second)
+                throw SimulatorError(unit.filename + ": Duplicate .globl label " + globl + ".");
+    }
+
+    for (unsigned int u = 0; u < n; ++u)
+    {
+        const LinkUnit & unit = *units[u];
+        for (const UnitRelocation & relocation : unit.relocations)
+        {
+            const UnitSymbol & symbol = unit.symbols[relocation.symbol];
+            uint32_t target;
+            if (symbol.defined)
+                target = address(u, symbol.text, symbol.offset);
+            else if (globals.find(symbol.name) != globals.end())
+                target = globals.find(symbol.name)->second;
+            else
+                throw SimulatorError(unit.filename + ": (Line " + std::to_string(relocation.line)
+                                     + ") Simulator Error: Undefined label.");
+            relocate(address(u, relocation.text, relocation.offset), target, relocation.type);
+        }
+    }
+
+    // Labels more than one file defines are named after their file,
+    // unless they are the .globl one.
+    std::vector< std::pair< uint32_t, std::string > > labels;
+    for (unsigned int u = 0; u < n; ++u)
+        for (const UnitSymbol & symbol : units[u]->symbols)
+        {
+            if (!symbol.defined)
+                continue;
+
+            uint32_t addr = address(u, symbol.text, symbol.offset);
+            std::unordered_map< std::string_view, uint32_t >::const_iterator global = globals.find(symbol.name);
+            if (definitions[symbol.name] == 1 || (global != globals.end() && global->second == addr))
+                labels.push_back(std::make_pair(addr, symbol.name));
+            else
+                labels.push_back(std::make_pair(addr, units[u]->filename + ":" + symbol.name));
+        }
+    std::sort(labels.begin(), labels.end());
+    assembling->labels.reserve(labels.size());
+    for (const std::pair< uint32_t, std::string > & label : labels)
+        assembling->labels[label.second] = label.first;
+
+    if (units[0]->globls.empty())
+        throw SimulatorError("No entrypoint defined. (.globl <label>)");
+    assembling->entrypoint = globals[units[0]->globls[0]];
+
+    text = assembling->text.data();
+    decoded = assembling->decoded.data();
+    text_size = assembling->text.size();
+    finish_image(data_pc);
+
+    return;
+}
+
+// Encode the line of lazily assembled text that the i'th word is part
+// of.
+void Simulator::encode_lazy_line(const uint32_t i)
+{
+    // The last line starting at or before the word.
+    uint32_t addr = TEXT_START + 4 * i;
+    std::vector< LazyLine >::const_iterator it
+        = std::upper_bound(lazy_lines.begin(), lazy_lines.end(), addr,
+                           [](const uint32_t a, const LazyLine & l) { return a < l.address; });
+    if (it == lazy_lines.begin())
+        throw SimulatorError("No source line to encode the instruction from.");
+    --it;
+
+    SourceLine source;
+    lex_line(it->text, it->line, source);
+    AssemblyOutput out = AssemblyOutput();
+    out.second_pass = true;
+
+    assembling = lazy_image;
+    try
+    {
+        emit_line(source, it->address, out);
+    }
+    catch (SimulatorError & e)
+    {
+        assembling.reset();
+        throw e;
+    }
+    assembling.reset();
+
+    return;
+}
+
+// Encode whatever lazy assembly has not yet, after which the source
+// and labels can go.
+void Simulator::encode_lazy_text()
+{
+    for (const LazyLine & lazy_line : lazy_lines)
+    {
+        uint32_t i = (lazy_line.address - TEXT_START) >> 2;
+        if (decoded[i] != NOT_ENCODED)
+            continue;
+
+        try
+        {
+            encode_lazy_line(i);
+        }
+        catch (SimulatorError & e)
+        {
+            throw SimulatorError("(Line " + std::to_string(lazy_line.line) + ") Simulator Error: " + e.what());
+        }
+    }
+
+    lazy_lines.clear();
+    lazy_lines.shrink_to_fit();
+    if (lazy_image)
+    {
+        lazy_image->lines.clear();
+        lazy_image->lines.shrink_to_fit();
+    }
+    lazy_image.reset();
+    symbols.clear();
+    source_file.reset();
+
+    return;
+}
+
+// The program is fully assembled, capture the initial data segment
+// and hand the image over so it is never written again.
+void Simulator::finish_image(const uint32_t data_end)
+{
+    assembling->data.assign(data, data + (data_end - DATA_START));
+
+    SourceMap & source_map = assembling->source_map;
+    source_map.set_lines(assembling->lines.data(), assembling->lines.size());
+    source_map.set_labels(assembling->labels, TEXT_START);
+    source_map.set_files(source_files);
+
+    // Lazy assembly still writes the lines it encodes.
+    if (lazy_lines.empty())
+    {
+        assembling->lines.clear();
+        assembling->lines.shrink_to_fit();
+    }
+
+    // Put the initial data in an in-memory file so other simulators
+    // running this image can map it copy-on-write. They fall back to
+    // copying it if that is not possible.
+    int fd = memfd_create("mips_data", MFD_CLOEXEC);
+    if (fd >= 0)
+    {
+        size_t n = assembling->data.size();
+        size_t written = 0;
+        if (ftruncate(fd, DATA_SEGMENT_SIZE) == 0)
+        {
+            while (written < n)
+            {
+                ssize_t w = pwrite(fd, data + written, n - written, written);
+                if (w <= 0)
+                    break;
+                written += w;
+            }
+        }
+        
+        if (written == n)
+            assembling->data_fd = fd;
+        else
+            close(fd);
+    }
+
+    assembling.reset();
+
+    return;
+}
+
+// Switch to running a program assembled elsewhere.
+void Simulator::load_image(const std::shared_ptr< const ProgramImage > & program)
+{
+    assembling.reset();
+    image = program;
+    text = image->text_words();
+    decoded = image->decoded_words();
+    text_size = image->text_size();
+
+    // Start from the image's initial data.
+    if (image->data_fd >= 0)
+    {
+        unmap_segment(data, DATA_SEGMENT_SIZE);
+        data = nullptr;
+        data = map_segment(DATA_SEGMENT_SIZE, image->data_fd, image->data_offset);
+    }
+    else
+    {
+        std::memcpy(data, image->data_bytes(), image->data_size());
+    }
+
+    return;
+}
+
+void Simulator::reset(const std::shared_ptr< const ProgramImage > & program)
+{
+    watchpoints.clear();
+    if (watch_owner == this)
+        protect_watched_pages();
+
+    regs = RegisterFile();
+    regs[29] = STACK_END - 1;
+    heap_allocator = HeapAllocator(HEAP_START, HEAP_START + MAX_HEAP);
+    running = false;
+    exit_status = 0;
+    instructions_retired = 0;
+    cycles = 0;
+    deterministic_run = true;
+    waiting_for_input = false;
+
+    // Private anonymous pages read back as zeros once dropped. The
+    // data segment may be a copy-on-write view of the last image, so
+    // unless load_image() maps it from the new one it starts over.
+    madvise(heap, MAX_HEAP, MADV_DONTNEED);
+    madvise(stack, MAX_STACK, MADV_DONTNEED);
+    if (program->data_fd < 0)
+    {
+        unmap_segment(data, DATA_SEGMENT_SIZE);
+        data = nullptr;
+        data = map_segment(DATA_SEGMENT_SIZE);
+    }
+
+    mapped_regions.clear();
+    mmap_ptr = MMAP_START;
+    for (int fd : open_files)
+        if (fd >= 0)
+            close(fd);
+    open_files.clear();
+    input_addr.clear();
+    valid_sim_inputs.clear();
+
+    load_image(program);
+
+    return;
+}
+
+// Execute the loaded program from its entrypoint until an error
+// occurs or the program exits.
+void Simulator::run_program()
+{
+    start_program();
+    run_for(UINT64_MAX);
     
     return;
 }
 
-// Format the escape sequences back to normal
-// "'\\n'" --> "'\n'"
-void Simulator::read_format_ascii_escape_sequences(std::string & s) const
+// Get ready to run the loaded program from its entrypoint.
+void Simulator::start_program()
+{
+    running = true;
+    sim_mode = false;
+    exit_status = 0;
+    instructions_retired = 0;
+    cycles = 0;
+    deterministic_run = true;
+    program_counter = image->entrypoint;
+    if (syscall_log.mode() != SyscallLog::OFF)
+    {
+        syscall_log.start(image_hash());
+    }
+
+    return;
+}
+
+RunResult Simulator::run_for(const uint64_t instructions)
+{
+    uint64_t end = (instructions > UINT64_MAX - instructions_retired ? UINT64_MAX
+                    : instructions_retired + instructions);
+    waiting_for_input = false;
+
+    while (running && !waiting_for_input && instructions_retired < end)
+    {
+        try
+        {
+            step();
+        }
+        catch (SimulatorError & e)
+        {
+            guest_output.flush();
+            std::string location = image->location_of((program_counter - TEXT_START) >> 2);
+            if (location == "")
+                throw e;
+            throw SimulatorError(e.what() + " (" + location + ").");
+        }
+    }
+
+    // Whatever it printed goes out before it is left waiting or
+    // stopped, so a prompt does not sit in the buffer.
+    guest_output.flush();
+    if (!running)
+        return RUN_EXITED;
+
+    return (waiting_for_input ? RUN_WAITING : RUN_YIELDED);
+}
+
+uint64_t Simulator::image_hash()
+{
+    encode_lazy_text();
+    uint64_t h = SyscallLog::hash_text(text, text_size);
+    const uint8_t * bytes = image->data_bytes();
+    for (uint32_t i = 0; i < image->data_size(); ++i)
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    for (uint32_t n : { image->entrypoint, uint32_t(image->standard_lui), uint32_t(virtual_time) })
+        for (int shift = 0; shift < 32; shift += 8)
+            h = (h ^ ((n >> shift) & 0xff)) * 1099511628211ull;
+
+    return h;
+}
+
+void Simulator::save_result(RunRecord & record) const
+{
+    record.exit_status = exit_status;
+    record.instructions = instructions_retired;
+    record.cycles = cycles;
+    for (int i = 0; i < 32; ++i)
+        record.registers[i] = regs[i];
+    record.registers[32] = regs.hi();
+    record.registers[33] = regs.lo();
+    record.registers[34] = program_counter;
+
+    return;
+}
+
+void Simulator::restore_result(const RunRecord & record)
+{
+    running = false;
+    exit_status = record.exit_status;
+    instructions_retired = record.instructions;
+    cycles = record.cycles;
+    for (int i = 0; i < 32; ++i)
+        regs[i] = record.registers[i];
+    regs.hi() = record.registers[32];
+    regs.lo() = record.registers[33];
+    program_counter = record.registers[34];
+
+    return;
+}
+
+
+// Reuse what the line assembled to last time if its text is
+// unchanged, otherwise assemble it and remember the result. What file
+// needs to know about the line is added to it.
+void Simulator::assemble_cached_line(const std::string_view line_text, SourceLine & source,
+                                     const unsigned int line, CachedFile & file)
+{
+    // Only lines inside a segment depend on nothing but their text.
+    bool text_segment = (current_segment == TEXT);
+    uint32_t index = line - 1;
+    if (current_segment != NONE)
+    {
+        const CachedLine * entry = line_cache->find(line_text, text_segment);
+        if (entry != nullptr)
+        {
+            if (entry->label_start >= 0)
+            {
+                symbols.define(line_text.substr(entry->label_start, entry->label_length), program_counter);
+                file.labels.push_back({index, uint32_t(entry->label_start), entry->label_length,
+                                       program_counter, text_segment});
+            }
+
+            unsigned int n = entry->words.size();
+            for (unsigned int i = 0; i < n; ++i)
+                set_text(program_counter + 4 * i, entry->words[i], line);
+            if (!entry->bytes.empty())
+                std::memcpy(data + (program_counter - DATA_START), entry->bytes.data(), entry->bytes.size());
+
+            for (const CachedRelocation & r : entry->relocations)
+                assembly_output.relocations.push_back({program_counter + r.offset,
+                                                       symbols.intern(line_text.substr(r.name_start, r.name_length)),
+                                                       r.type, line});
+
+            program_counter += entry->size;
+            return;
+        }
+    }
+
+    lex_line(line_text, line, source);
+
+    MipsSegment segment = current_segment;
+    std::vector< Relocation > & relocations = assembly_output.relocations;
+    size_t first_relocation = relocations.size();
+    assembly_output.position_dependent = false;
+    uint32_t start = place_line(source);
+    emit_line(source, start, assembly_output);
+    if (!source.label.empty())
+        file.labels.push_back({index, uint32_t(source.label.data() - line_text.data()),
+                               uint32_t(source.label.size()), symbols[symbols.find(source.label)].address,
+                               text_segment});
+    if (source.kind == LINE_GLOBL)
+        file.globl_lines.push_back(index);
+    if (source.kind == LINE_ALIGN || assembly_output.position_dependent)
+        file.fixed_lines.push_back(index);
+    if (source.directive == DIRECTIVE_INCBIN)
+        file.incbin = true;
+    if (segment == NONE || source.kind == LINE_SEGMENT || source.kind == LINE_GLOBL
+        || source.kind == LINE_ALIGN || source.directive == DIRECTIVE_INCBIN
+        || assembly_output.position_dependent)
+        return;
+
+    CachedLine entry;
+    entry.text = line_text;
+    entry.text_segment = text_segment;
+    entry.size = program_counter - start;
+    entry.label_start = (source.label.empty() ? -1 : source.label.data() - line_text.data());
+    entry.label_length = source.label.size();
+    if (text_segment)
+        entry.words.assign(assembling->text.begin() + ((start - TEXT_START) >> 2),
+                           assembling->text.begin() + ((program_counter - TEXT_START) >> 2));
+    else
+        entry.bytes.assign(data + (start - DATA_START), data + (program_counter - DATA_START));
+
+    // Name each label by an occurrence of it in this line.
+    for (size_t i = first_relocation; i < relocations.size(); ++i)
+    {
+        std::string_view name = symbols[relocations[i].symbol].name;
+        entry.relocations.push_back({relocations[i].address - start,
+                                     uint32_t(line_text.find(name)), uint32_t(name.size()),
+                                     relocations[i].type});
+    }
+    line_cache->insert(std::move(entry));
+
+    return;
+}
+
+// Number of values a .word, .half or .byte line stores, counting every
+// repeat. Past the size of the data segment it no longer matters.
+static uint32_t value_count(const std::vector< Token > & tokens)
+{
+    uint64_t count = 0;
+    for (size_t i = 1; i < tokens.size(); ++i)
+        count += (tokens[i].type == TOKEN_REPEAT ? std::max(tokens[i].value, 1) - 1 : 1);
+
+    return std::min< uint64_t >(count, DATA_SEGMENT_SIZE + 1);
+}
+
+// Contents of a string literal.
+static std::string string_value(const Token & token)
+{
+    std::string s(Lexer::unescape(token.text, nullptr), '\0');
+    Lexer::unescape(token.text, (uint8_t *)(s.data()));
+
+    return s;
+}
+
+// A .incbin file, relative to the file including it.
+std::string Simulator::incbin_path(const Token & token) const
+{
+    std::string path = string_value(token);
+    if (path.empty() || path[0] == '/')
+        return path;
+
+    return source_dir + path;
+}
+
+// Lex a line and work out what it is and how large. Nothing is checked
+// that depends on the lines around it, and malformed lines are left for
+// emit_line() to report.
+void Simulator::lex_line(const std::string_view line_text, const unsigned int line,
+                         SourceLine & source) const
+{
+    std::vector< Token > & tokens = source.tokens;
+    Lexer::tokenize(line_text, tokens);
+    source.label = std::string_view();
+    source.kind = LINE_EMPTY;
+    source.directive = NO_DIRECTIVE;
+    source.pseudo = Instruction(0);
+    source.size = 0;
+    source.line = line;
+
+    if (!tokens.empty() && tokens[0].type == TOKEN_LABEL)
+    {
+        source.label = tokens[0].text;
+        tokens.erase(tokens.begin());
+    }
+
+    // Make sure there wasnt only a label
+    if (tokens.empty())
+        return;
+
+    if (tokens[0].type != TOKEN_NAME)
+    {
+        source.kind = LINE_INVALID;
+        return;
+    }
+
+    // '.' input, a segment change, an entrypoint (".globl main") or
+    // data.
+    if (tokens[0].text[0] == '.')
+    {
+        source.directive = get_directive(tokens[0].text);
+        unsigned int values = tokens.size() - 1;
+        if (values == 0)
+            source.kind = LINE_SEGMENT;
+        else if (values == 1 && source.directive == DIRECTIVE_GLOBL)
+            source.kind = LINE_GLOBL;
+        else if (values == 1 && source.directive == DIRECTIVE_ALIGN)
+            source.kind = LINE_ALIGN;
+        else
+        {
+            source.kind = LINE_DATA;
+            switch (source.directive)
+            {
+                case DIRECTIVE_WORD:
+                    source.size = 4 * value_count(tokens);
+                    break;
+                case DIRECTIVE_HALF:
+                    source.size = 2 * value_count(tokens);
+                    break;
+                case DIRECTIVE_BYTE:
+                    source.size = value_count(tokens);
+                    break;
+                case DIRECTIVE_SPACE:
+                    if (values == 1 && tokens[1].type == TOKEN_INTEGER)
+                        source.size = tokens[1].value;
+                    break;
+                case DIRECTIVE_ASCII:
+                case DIRECTIVE_ASCIIZ:
+                    if (values == 1 && tokens[1].type == TOKEN_STRING)
+                        source.size = Lexer::unescape(tokens[1].text, nullptr)
+                            + (source.directive == DIRECTIVE_ASCIIZ);
+                    break;
+                case DIRECTIVE_INCBIN:
+                    if (values == 1 && tokens[1].type == TOKEN_STRING)
+                    {
+                        struct stat st;
+                        if (stat(incbin_path(tokens[1]).c_str(), &st) == 0)
+                            source.size = std::min< uint64_t >(st.st_size, DATA_SEGMENT_SIZE + 1);
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        return;
+    }
+
+    // Pseudoinstructions take up the same space no matter their
+    // operands. Read mode always uses 2 instructions for li for
+    // consistency.
+    source.kind = LINE_INSTRUCTION;
+    source.pseudo = is_pseudo(tokens[0], tokens.back());
+    switch (source.pseudo)
+    {
+        case LI:
+        case LA:
+        case BLT:
+        case BLE:
+        case BGT:
+        case BGE:
+            source.size = 8;
+            break;
+        case LW:
+            source.size = 12;
+            break;
+        default:
+            source.size = 4;
+    }
+
+    return;
+}
+
+// Run a line through the segments: define its label, switch segments,
+// set the entrypoint. Returns the address the line's contents go at
+// and moves the program counter past them.
+uint32_t Simulator::place_line(const SourceLine & source)
+{
+    // .align moves the label on its line along with it.
+    if (source.kind == LINE_ALIGN)
+    {
+        if (current_segment != DATA)
+            throw SimulatorError(".align can only be used in the data segment.");
+        if (source.tokens[1].type != TOKEN_INTEGER || source.tokens[1].value < 0
+            || source.tokens[1].value > int32_t(MAX_ALIGN))
+            throw SimulatorError("Invalid .align value formatting.");
+
+        uint64_t alignment = 1ull << source.tokens[1].value;
+        uint64_t aligned = (program_counter + alignment - 1) / alignment * alignment;
+        if (aligned > DATA_START + DATA_SEGMENT_SIZE)
+            throw SimulatorError("Data segment is full.");
+        program_counter = aligned;
+        data_alignment = std::max(data_alignment, uint32_t(alignment));
+    }
+
+    // Handle labels
+    if (!source.label.empty())
+    {
+        if (current_segment == NONE)
+            throw SimulatorError("Labels cannot exist outside of a segment.");
+
+        if (!valid_label(std::string(source.label)))
+            throw SimulatorError("Invalid label.");
+
+        // Save the label with address
+        symbols.define(source.label, program_counter);
+    }
+
+    uint32_t addr = program_counter;
+    switch (source.kind)
+    {
+        case LINE_EMPTY:
+            break;
+
+        case LINE_INVALID:
+            throw SimulatorError("Invalid instruction.");
+
+        case LINE_SEGMENT:
+            if (source.directive == DIRECTIVE_TEXT)
+            {
+                switch (current_segment)
+                {
+                    case TEXT: // Ignore
+                        break;
+                    case DATA:
+                        current_segment = TEXT;
+                        data_seg_addr = program_counter;
+                        program_counter = text_seg_addr;
+                        break;
+                    case NONE:
+                        current_segment = TEXT;
+                        program_counter = text_seg_addr;
+                        break;
+                }
+            }
+
+            else if (source.directive == DIRECTIVE_DATA)
+            {
+                switch (current_segment)
+                {
+                    case TEXT:
+                        current_segment = DATA;
+                        text_seg_addr = program_counter;
+                        program_counter = data_seg_addr;
+                        break;
+                    case DATA: // Ignore
+                        break;
+                    case NONE:
+                        current_segment = DATA;
+                        program_counter = data_seg_addr;
+                }
+            }
+            break;
+
+        case LINE_ALIGN:
+            break;
+
+        case LINE_GLOBL:
+            if (source.tokens[1].type != TOKEN_NAME || !valid_label(std::string(source.tokens[1].text)))
+                throw SimulatorError("Invalid label.");
+            if (assembling_unit)
+            {
+                globls.push_back(source.tokens[1].text);
+                break;
+            }
+            if (entrypoint_label != "")
+                throw SimulatorError("Entrypoint already set (Duplicate .globl).");
+
+            // Set the entrypoint label.
+            entrypoint_label = source.tokens[1].text;
+            break;
+
+        case LINE_DATA:
+            if (current_segment != DATA)
+                throw SimulatorError("Data can only be declared in the data segment.");
+            if (source.size > DATA_START + DATA_SEGMENT_SIZE - program_counter)
+                throw SimulatorError("Data segment is full.");
+            program_counter += source.size;
+            break;
+
+        case LINE_INSTRUCTION:
+            // If you somehow made it here, you have a very interesting
+            // input in the data segment.
+            if (current_segment != TEXT)
+                throw SimulatorError("Invalid data segment input.");
+            program_counter += source.size;
+            break;
+    }
+
+    return addr;
+}
+
+// Encode a line's instructions or data at addr.
+void Simulator::emit_line(const SourceLine & source, const uint32_t addr, AssemblyOutput & out)
+{
+    const std::vector< Token > & tokens = source.tokens;
+    if (source.kind == LINE_DATA)
+    {
+        emit_data(tokens, addr, source.line, &out);
+        return;
+    }
+    if (source.kind != LINE_INSTRUCTION)
+        return;
+
+    // Throw errors if pseudoinstructions are not formatted correctly.
+    switch (source.pseudo)
+    {
+        case MOVE:
+        case LI:
+        case LW:
+        case LA:
+            if (tokens.size() != 3)
+                throw SimulatorError("Invalid parameters for pseudoinstruction " + std::string(tokens[0].text) + ".");
+            break;
+        case BLT:
+        case BLE:
+        case BGT:
+        case BGE:
+            if (tokens.size() != 4)
+                throw SimulatorError("Invalid parameters for pseudoinstruction " + std::string(tokens[0].text) + ".");
+            break;
+        default:
+            emit_instruction(tokens, addr, source.line, out);
+            return;
+    }
+
+    read_handle_pseudo(source.pseudo, tokens, addr, source.line, out);
+
+    return;
+}
+
+// Encode an instruction into the text segment. Operands naming a label
+// are left as 0 in the encoding and get a relocation instead.
+void Simulator::emit_instruction(std::vector< Token > tokens,
+                                 const uint32_t addr,
+                                 const unsigned int line,
+                                 AssemblyOutput & out)
+{
+    RelocationType type;
+    switch (get_instruction(tokens[0].text))
+    {
+        case BEQ:
+        case BNE:
+        case BGTZ:
+        case BLEZ:
+        case BGEZ:
+        case BLTZ:
+            type = RELOC_BRANCH;
+            break;
+        case J:
+        case JAL:
+            type = RELOC_JUMP;
+            break;
+        case LUI:
+            type = RELOC_HI;
+            break;
+        default:
+            type = RELOC_LO;
+    }
+
+    size_t first_relocation = out.relocations.size();
+    unsigned int n = tokens.size();
+    for (unsigned int i = 1; i < n; ++i)
+    {
+        if (tokens[i].type != TOKEN_NAME)
+            continue;
+
+        out.relocations.push_back({addr, reference_label(tokens[i].text, out), type, line});
+        tokens[i] = integer_token(0);
+    }
+
+    if (type == RELOC_BRANCH && out.relocations.size() == first_relocation)
+        out.position_dependent = true;
+
+    if (!out.second_pass)
+    {
+        set_text(addr, encode(tokens, addr), line);
+        return;
+    }
+
+    // Every label is known in the second pass.
+    store_text(addr, encode(tokens, addr), line);
+    for (size_t i = first_relocation; i < out.relocations.size(); ++i)
+        apply_relocation(out.relocations[i]);
+    out.relocations.resize(first_relocation);
+
+    return;
+}
+
+// Id of a label referenced by a line. In the second pass every label
+// has been defined already, and the table must not change under the
+// other threads.
+uint32_t Simulator::reference_label(const std::string_view name, const AssemblyOutput & out)
+{
+    if (!out.second_pass)
+        return symbols.intern(name);
+
+    uint32_t id = symbols.find(name);
+    if (id == NO_SYMBOL)
+        throw SimulatorError("Undefined label.");
+
+    return id;
+}
+
+// Patch every label reference now that all labels are known.
+void Simulator::apply_relocations()
+{
+    for (const Relocation & relocation : assembly_output.relocations)
+        apply_relocation(relocation);
+
+    return;
+}
+
+void Simulator::apply_relocation(const Relocation & relocation)
+{
+    const Symbol & symbol = symbols[relocation.symbol];
+    if (!symbol.defined)
+        throw SimulatorError("(Line " + std::to_string(relocation.line) + ") Simulator Error: Undefined label.");
+
+    relocate(relocation.address, symbol.address, relocation.type);
+
+    return;
+}
+
+// Point the reference at addr to target.
+void Simulator::relocate(const uint32_t addr, const uint32_t target, const RelocationType type)
+{
+    uint8_t * location = data + (addr - DATA_START);
+    switch (type)
+    {
+        case RELOC_BRANCH:
+            patch_text(addr, 0xffff, ((uint16_t)(target - addr)) >> 2);
+            break;
+        case RELOC_JUMP:
+            patch_text(addr, 0x3ffffff, (target >> 2) & 0x3ffffff);
+            break;
+        case RELOC_HI:
+            patch_text(addr, 0xffff, target >> 16);
+            break;
+        case RELOC_LO:
+            patch_text(addr, 0xffff, target & 0xffff);
+            break;
+        case RELOC_WORD:
+            location[0] = target >> 24;
+            location[1] = target >> 16;
+            location[2] = target >> 8;
+            location[3] = target;
+            break;
+        case RELOC_HALF:
+            location[0] = target >> 8;
+            location[1] = target;
+            break;
+        case RELOC_BYTE:
+            location[0] = target;
+            break;
+    }
+
+    return;
+}
+
+// Replace the bits of an encoded instruction selected by mask.
+void Simulator::patch_text(const uint32_t addr, const uint32_t mask, const uint32_t value)
+{
+    uint32_t i = (addr - TEXT_START) >> 2;
+    uint32_t encoded = assembling->text[i];
+    store_text(addr, (encoded & ~mask) | (value & mask), assembling->lines[i]);
+
+    return;
+}
+
+// Read file mode handling of pseudoinstructions, expanded starting
+// at addr.
+void Simulator::read_handle_pseudo(const Instruction & ins,
+                                   const std::vector< Token > & tokens,
+                                   const uint32_t addr,
+                                   const unsigned int line,
+                                   AssemblyOutput & out)
 {
-    int n = s.size() - 1;
-    bool escape_char = false;
-    for (int i = 1; i < n; ++i)
-    {
-        if (!escape_char && s[i] == '\\')
-            escape_char = true;
+    uint32_t immediate;
+    Token hi = tokens[2], lo = tokens[2];
 
-        else if (escape_char)
-        {
-            escape_char = false;
-            switch (s[i])
+    // Split each pseudoinstruction into its composite
+    // instructions and encode them.
+    switch (ins)
+    {
+        case MOVE:
+            emit_instruction({name_token("addu"), tokens[1], register_token(0), tokens[2]}, addr, line, out);
+            break;
+        case LI:
+        case LA:
+        case LW:
+            // Label addresses are split by their relocations.
+            if (tokens[2].type == TOKEN_INTEGER)
             {
-                case '0':
-                    s[i - 1] = '\0';
-                    break;
-                case '\\':
-                    s[i - 1] = '\\';
-                    break;
-                case 'v':
-                    s[i - 1] = '\v';
-                    break;
-                case 'n':
-                    s[i - 1] = '\n';
-                    break;
-                case 't':
-                    s[i - 1] = '\t';
-                    break;
-                case '\"':
-                    s[i - 1] = '\"';
-                    break;
+                immediate = tokens[2].value;
+                lo = integer_token(immediate & 0b1111111111111111);
+                hi = integer_token(immediate >> 16);
             }
-            s.erase(i, 1);
+            else if (ins == LI)
+                throw SimulatorError("Invalid parameters for pseudoinstruction li.");
 
-            --n;
-            --i;
-        }
+            if (ins == LW)
+            {
+                emit_instruction({name_token("ori"), register_token(1), register_token(0), lo}, addr, line, out);
+                emit_instruction({name_token("lui"), register_token(1), hi}, addr + 4, line, out);
+                emit_instruction({name_token("lw"), tokens[1], register_token(1), integer_token(0)}, addr + 8, line, out);
+            }
+            else
+            {
+                emit_instruction({name_token("ori"), tokens[1], register_token(0), lo}, addr, line, out);
+                emit_instruction({name_token("lui"), tokens[1], hi}, addr + 4, line, out);
+            }
+            break;
+        case BLT:
+            emit_instruction({name_token("slt"), register_token(1), tokens[1], tokens[2]}, addr, line, out);
+            emit_instruction({name_token("bne"), register_token(1), register_token(0), tokens[3]}, addr + 4, line, out);
+            break;
+        case BLE:
+            emit_instruction({name_token("slt"), register_token(1), tokens[2], tokens[1]}, addr, line, out);
+            emit_instruction({name_token("beq"), register_token(1), register_token(0), tokens[3]}, addr + 4, line, out);
+            break;
+        case BGT:
+            emit_instruction({name_token("slt"), register_token(1), tokens[2], tokens[1]}, addr, line, out);
+            emit_instruction({name_token("bne"), register_token(1), register_token(0), tokens[3]}, addr + 4, line, out);
+            break;
+        case BGE:
+            emit_instruction({name_token("slt"), register_token(1), tokens[1], tokens[2]}, addr, line, out);
+            emit_instruction({name_token("beq"), register_token(1), register_token(0), tokens[3]}, addr + 4, line, out);
+            break;
     }
     
     return;
@@ -1076,275 +2778,70 @@ std::string Simulator::strip_useless_whitespace(std::string s) const
     return s.substr(start, len);
 }
 
-std::string Simulator::get_numerical_register_str(std::string s) const
-{
-    // Only register with more than 2 characters.
-    if (s == "zero")
-        return "0";
-    
-    if (s.size() > 2)
-        throw SimulatorError("Invalid register.");
-    
-    bool all_digits = true;
-    for (char & c : s)
-    {
-        if (isalpha(c))
-        {
-            c = tolower(c);
-            all_digits = false;
-        }
-        
-        else if (!isdigit(c))
-            throw SimulatorError("Invalid register.");
-    }
-
-    if (all_digits)
-    {
-        if (std::stoi(s) > 31)
-            throw SimulatorError("Invalid register.");
-        return s;
-    }
-
-    const static std::unordered_map<std::string, std::string> numerical_reg_map =
-        {
-            {"at", "1"},
-            {"v0", "2"},
-            {"v1", "3"},
-            {"a0", "4"},
-            {"a1", "5"},
-            {"a2", "6"},
-            {"a3", "7"},
-            {"t0", "8"},
-            {"t1", "9"},
-            {"t2", "10"},
-            {"t3", "11"},
-            {"t4", "12"},
-            {"t5", "13"},
-            {"t6", "14"},
-            {"t7", "15"},
-            {"s0", "16"},
-            {"s1", "17"},
-            {"s2", "18"},
-            {"s3", "19"},
-            {"s4", "20"},
-            {"s5", "21"},
-            {"s6", "22"},
-            {"s7", "23"},
-            {"t8", "24"},
-            {"t9", "25"},
-            {"k0", "26"},
-            {"k1", "27"},
-            {"gp", "28"},
-            {"sp", "29"},
-            {"fp", "30"},
-            {"ra", "31"},
-        };
-    
-    if (numerical_reg_map.find(s) == numerical_reg_map.end())
-        throw SimulatorError("Invalid register.");
-    
-    return numerical_reg_map.find(s)->second;
-}
-
-std::string Simulator::replace_registers(std::string s) const
+// Address of a label, throws if it is undefined.
+uint32_t Simulator::label_address(const std::string & label) const
 {
-    unsigned int i = 0, n = s.size();
-    while (i < n)
-    {
-        // Find register $ symbol
-        if (s[i] == '$')
-        {
-            ++i;
-            unsigned int start = i, len = 0;
+    if (image->labels.find(label) == image->labels.end())
+        throw SimulatorError("Undefined label.");
 
-            while (i + len < n && isalnum(s[i + len]))
-                ++len;
-
-            // Isolate the register name and replace with
-            // its numerical representation
-            std::string reg = s.substr(i, len);
-            reg = get_numerical_register_str(reg);
-            s.replace(i, len, reg);
-            
-            i += reg.size() - 1; // -1 for the increment in the end of the loop.
-            n -= len - reg.size();
-        }
-        ++i;
-    }
-    
-    return s;
+    return image->labels.find(label)->second;
 }
 
-// Split the immediate and register values on instructions
-// like "lw $a0, 12($a0)"
-// "4($31)" --> { "$31", "4" }.
-std::vector< std::string > Simulator::split_immediate_and_register(const std::string & s) const
+// Replace labels with their address values
+void Simulator::replace_labels(std::vector< Token > & tokens) const
 {
-    std::vector< std::string > ret = { "", "" };
-
-    unsigned int i = 1;
-    for (const char & c : s)
+    // The first token is the instruction or directive itself.
+    unsigned int n = tokens.size();
+    for (unsigned int i = 1; i < n; ++i)
     {
-        switch (c)
+        if (tokens[i].type != TOKEN_NAME)
+            continue;
+
+        std::unordered_map< std::string, uint32_t >::const_iterator it
+            = image->labels.find(std::string(tokens[i].text));
+        if (it != image->labels.end())
         {
-            case '(':
-                --i;
-                break; // Switch to other string.
-            case ')':
-                break; // Final character, do nothing.
-            default:
-                ret[i].push_back(c);
+            tokens[i].type = TOKEN_INTEGER;
+            tokens[i].value = it->second;
         }
     }
     
-    return ret;
+    return;
 }
 
-// Break up the input into space separated strings
-std::vector< std::string > Simulator::split_input(const std::string & s) const
+// Integer value of a data segment entry at addr. While assembling a
+// file a label gets a relocation and 0 for now, unless it is already
+// known.
+int32_t Simulator::data_value(const Token & token, const RelocationType type, const uint32_t addr,
+                              const unsigned int line, AssemblyOutput * out)
 {
-    std::vector< std::string > ret = { "" }; // There will be at least one.
-
-    unsigned int n = s.size();
-    unsigned int i = 0;
-
-    // Should ALWAYS be an argument in front.
-    while (s[i] != ' ' && s[i] != '\t' && i < n)
-        ret[0].push_back(s[i++]);
-
-    bool looking_for_arg = false;
-    bool has_parenthases = false;
-    while (i < n)
+    if (token.type == TOKEN_NAME && out != nullptr && out->second_pass)
+        return symbols[reference_label(token.text, *out)].address;
+    if (token.type == TOKEN_NAME && out != nullptr)
     {
-        if (s[i] == ' ' || s[i] == '\t' || s[i] == ',')
-        {
-            ret.push_back("");
-            while (i < n && (s[i] == ' ' || s[i] == '\t' || s[i] == ','))
-                ++i;
-            
-            if (i >= n)
-                break;
-
-            // If it is a character value or a string value.
-            if (s[i] == '\"' || s[i] == '\'')
-            {
-                char search = s[i++];
-                ret.back().push_back(search);
-                
-                // Find matching symbol.
-                char escape_sequence = false;
-                while (escape_sequence || s[i] != search)
-                {
-                    if (!escape_sequence && s[i] == '\\')
-                        escape_sequence = true;
-                    else
-                        escape_sequence = false;
-                    
-                    ret.back().push_back(s[i++]);
-                }
-                ret.back().push_back(s[i++]);
-            }
-
-            // Not a string or character.
-            else
-            {
-                while (i < n && s[i] != ' ' && s[i] != '\t' && s[i] != ',')
-                {
-                    if (s[i] == '(')
-                        has_parenthases = true;
-                    ret.back().push_back(s[i++]);
-                }
-            
-                if (has_parenthases)
-                {
-                    has_parenthases = false;
-                    std::vector< std::string > split = split_immediate_and_register(ret.back());
-                    ret.pop_back();
-                    ret.insert(ret.end(), split.begin(), split.end());
-                }
-            }
-            
-            --i;
-        }
-        
-        ++i;
+        out->relocations.push_back({addr, reference_label(token.text, *out), type, line});
+        return 0;
     }
+    if (token.type == TOKEN_NAME)
+        throw SimulatorError("Undefined label.");
+    if (token.type != TOKEN_INTEGER)
+        throw SimulatorError("Invalid data value " + std::string(token.text) + ".");
 
-    if (ret.back() == "")
-        ret.pop_back();
-
-    return ret;
+    return token.value;
 }
 
-// Format immediates into base 10 numerical values
-void Simulator::format_immediates(std::vector< std::string > & strs) const
+// Add a piece of data into the data segment at the program counter.
+void Simulator::add_to_data_segment(const std::vector< Token > & tokens)
 {
-    for (std::string & s : strs)
-    {
-        std::string sub = s.substr(0, 2);
-
-        // Hexidecimal
-        if (sub == "0x")
-        {
-            s = std::to_string(std::stoi(s, 0, 16));
-        }
+    program_counter = emit_data(tokens, program_counter, 0, nullptr);
 
-        // Binary
-        else if (sub == "0b")
-        {
-            s = std::to_string(std::stoi(s.substr(2), 0, 2));
-        }
-
-        // Character value.
-        else if (s[0] == '\'')
-        {
-            // These will be escape sequences.
-            if (s.size() == 4 && s[1] == '\\')
-            {
-                char c = s[2];
-                switch (c)
-                {
-                    case '0':
-                        s = "0";
-                        break;
-                    case 't':
-                        s = "9";
-                        break;
-                    case 'n':
-                        s = "10";
-                        break;
-                    case 'v':
-                        s = "11";
-                        break;
-                    default:
-                        throw SimulatorError("Unsupported character escape sequence.");
-                }
-            }
-            
-            // These are normal characters.
-            else if (s.size() == 3)
-                s = std::to_string((int)(s[1]));
-
-            else
-                throw SimulatorError("Invalid character formatting.");
-        }
-    }
-    
-    return;
-}
-
-// Replace labels with their address values
-void Simulator::replace_labels(std::vector< std::string > & strs) const
-{
-    for (std::string & s : strs)
-        if (labels.find(s) != labels.end())
-            s = std::to_string(labels.find(s)->second);
-    
     return;
 }
 
-// Add a piece of data into the data segment
-void Simulator::add_to_data_segment(const std::vector< std::string > & strs)
+// Write a piece of data into the data segment at addr, returns the
+// address after it.
+uint32_t Simulator::emit_data(const std::vector< Token > & tokens, uint32_t addr,
+                              const unsigned int line, AssemblyOutput * out)
 {
     /*
       I will only accept the following types:
@@ -1355,168 +2852,176 @@ void Simulator::add_to_data_segment(const std::vector< std::string > & strs)
       .ascii
       .asciiz
     */    
-    if (strs[0] == ".space")
+    Directive directive = get_directive(tokens[0].text);
+    if (directive == DIRECTIVE_SPACE)
     {
-        if (strs.size() != 2)
+        if (tokens.size() != 2)
             throw SimulatorError("Invalid .space value formatting.");
 
         // move data segment address forward by the number of
         // bytes allocated.
-        program_counter += std::stoi(strs[1]);
+        if (tokens[1].type != TOKEN_INTEGER)
+            throw SimulatorError("Invalid .space value formatting.");
+        addr += tokens[1].value;
     }
     
-    else if (strs[0] == ".word")
-    {
-        if (strs.size() < 2)
-            throw SimulatorError("Invalid .word value formatting.");
+    else if (directive == DIRECTIVE_WORD)
+        addr = emit_values(tokens, 4, RELOC_WORD, addr, line, out);
 
-        // Store values in data segment and move program_counter
-        // forward.
-        unsigned int n = strs.size();
-        for (unsigned int i = 1; i < n; ++i)
-        {
-            uint32_t word = std::stoi(strs[i]);
-            uint8_t b0 = (word >> 24),
-                b1 = (word >> 16) & 0b11111111,
-                b2 = (word >> 8) & 0b11111111,
-                b3 = word & 0b11111111;
-            data[(program_counter++) - DATA_START] = b0;
-            data[(program_counter++) - DATA_START] = b1;
-            data[(program_counter++) - DATA_START] = b2;
-            data[(program_counter++) - DATA_START] = b3;
-        }
-    }
+    else if (directive == DIRECTIVE_HALF)
+        addr = emit_values(tokens, 2, RELOC_HALF, addr, line, out);
+
+    else if (directive == DIRECTIVE_BYTE)
+        addr = emit_values(tokens, 1, RELOC_BYTE, addr, line, out);
     
-    else if (strs[0] == ".half")
+    else if (directive == DIRECTIVE_ASCII || directive == DIRECTIVE_ASCIIZ)
     {
-        if (strs.size() < 2)
-            throw SimulatorError("Invalid .half value formatting.");
+        if (tokens.size() != 2 || tokens[1].type != TOKEN_STRING)
+            throw SimulatorError("Invalid " + std::string(tokens[0].text) + " value formatting.");
 
-        // Store values in data segment and move program_counter
+        // Store characters in data segment and move addr
         // forward.
-        unsigned int n = strs.size();
-        for (unsigned int i = 1; i < n; ++i)
-        {
-            uint16_t halfword = std::stoi(strs[i]);
-            uint8_t b0 = (halfword >> 8),
-                b1 = (halfword >> 16) & 0b11111111;
-            data[(program_counter++) - DATA_START] = b0;
-            data[(program_counter++) - DATA_START] = b1;
-        }
+        addr += Lexer::unescape(tokens[1].text, data + (addr - DATA_START));
+        if (directive == DIRECTIVE_ASCIIZ)
+            data[(addr++) - DATA_START] = (uint8_t)('\0');
     }
-    
-    else if (strs[0] == ".byte")
+
+    else if (directive == DIRECTIVE_INCBIN)
     {
-        if (strs.size() < 2)
-            throw SimulatorError("Invalid .byte value formatting.");
+        if (tokens.size() != 2 || tokens[1].type != TOKEN_STRING)
+            throw SimulatorError("Invalid .incbin value formatting.");
 
-        // Store values in data segment and move program_counter
-        // forward.
-        unsigned int n = strs.size();
-        for (unsigned int i = 1; i < n; ++i)
+        // Copied straight out of the file's mapping.
+        std::string path = incbin_path(tokens[1]);
+        MappedFile file(path);
         {
-            uint8_t byte = std::stoi(strs[i]);
-            data[(program_counter++) - DATA_START] = byte;
+            std::lock_guard< std::mutex > lock(incbin_mutex);
+            assembling->incbin_files.push_back(path);
         }
+        if (file.size() > DATA_START + DATA_SEGMENT_SIZE - addr)
+            throw SimulatorError("Data segment is full.");
+        if (file.size() > 0)
+            std::memcpy(data + (addr - DATA_START), file.data(), file.size());
+        addr += file.size();
     }
-    
-    else if (strs[0] == ".ascii")
-    {
-        if (strs.size() != 2)
-            throw SimulatorError("Invalid .ascii value formatting.");
 
-        // Store characters in data segment and move program_counter
-        // forward.
-        std::string str = strs[1];
-        if (sim_mode)
-            read_format_ascii_escape_sequences(str);
-        unsigned int n = str.size() - 1;
-        for (unsigned int i = 1; i < n; ++i)
-            data[(program_counter++) - DATA_START] = (uint8_t)(str[i]);
-    }
-    
-    else if (strs[0] == ".asciiz")
+    else
+        throw SimulatorError("Unsupported data segment type.");
+
+    return addr;
+}
+
+// Write the values of a .word (size 4), .half (2) or .byte (1) line
+// big-endian from addr, returns the address after them. "value:count"
+// stores value count times, filled in by doubling memcpys.
+uint32_t Simulator::emit_values(const std::vector< Token > & tokens, const unsigned int size,
+                                const RelocationType type, uint32_t addr,
+                                const unsigned int line, AssemblyOutput * out)
+{
+    if (tokens.size() < 2)
+        throw SimulatorError("Invalid " + std::string(tokens[0].text) + " value formatting.");
+
+    unsigned int n = tokens.size();
+    for (unsigned int i = 1; i < n; ++i)
     {
-        if (strs.size() != 2)
-            throw SimulatorError("Invalid .asciiz value formatting.");
+        if (tokens[i].type == TOKEN_REPEAT)
+            throw SimulatorError("Invalid " + std::string(tokens[0].text) + " value formatting.");
 
-        // Store characters in data segment and move program_counter
-        // forward.
-        std::string str = strs[1];
-        if (sim_mode)
-            read_format_ascii_escape_sequences(str);
-        unsigned int n = str.size() - 1;
-        for (unsigned int i = 1; i < n; ++i)
-            data[(program_counter++) - DATA_START] = (uint8_t)(str[i]);
-        data[(program_counter++) - DATA_START] = (uint8_t)('\0');
-    }
+        bool repeated = (i + 1 < n && tokens[i + 1].type == TOKEN_REPEAT);
+        uint64_t count = 1;
+        if (repeated)
+        {
+            if (tokens[i].type != TOKEN_INTEGER || tokens[i + 1].value < 1)
+                throw SimulatorError("Invalid " + std::string(tokens[0].text) + " value formatting.");
+            count = tokens[i + 1].value;
+        }
+        if (count * size > DATA_START + DATA_SEGMENT_SIZE - addr)
+            throw SimulatorError("Data segment is full.");
 
-    else
-        throw SimulatorError("Unsupported data segment type.");
+        uint32_t value = data_value(tokens[i], type, addr, line, out);
+        uint8_t * location = data + (addr - DATA_START);
+        switch (size)
+        {
+            case 4:
+                location[0] = value >> 24;
+                location[1] = value >> 16;
+                location[2] = value >> 8;
+                location[3] = value;
+                break;
+            case 2:
+                location[0] = value >> 8;
+                location[1] = value;
+                break;
+            default:
+                location[0] = value;
+                break;
+        }
 
-    return;
+        uint64_t filled = size;
+        uint64_t total = count * size;
+        while (filled < total)
+        {
+            uint64_t copy = std::min(filled, total - filled);
+            std::memcpy(location + filled, location, copy);
+            filled += copy;
+        }
+        addr += total;
+        if (repeated)
+            ++i;
+    }
+
+    return addr;
 }
 
 // Return value of pseudoinstruction if it is one, also returns
 // Instruction(0) so it can be used a boolean condition.
 // Throws errors if you dont have a defined label included
 // with a pseudoinstruction that requires one.
-Instruction Simulator::is_pseudo(const std::string & s,
-                                 const std::string & label) const
+Instruction Simulator::is_pseudo(const Token & ins,
+                                 const Token & label) const
 {
-    if (s == "move")
-        return MOVE;
-    else if (s == "li")
-        return LI;
-    else if (s == "lw")
+    const Instruction * found = mnemonic_table.find(ins.text);
+    if (found == nullptr)
+        return Instruction(0);
+
+    Instruction pseudo = *found;
+    switch (pseudo)
     {
-        if (isdigit(label[0]))
+        case MOVE:
+        case LI:
+            return pseudo;
+        case LW:
+            // Only a pseudoinstruction when loading from a label.
+            if (label.type != TOKEN_NAME)
+                return Instruction(0);
+            break;
+        case LA:
+        case BLT:
+        case BLE:
+        case BGT:
+        case BGE:
+            break;
+        default:
             return Instruction(0);
-        
-        if (sim_mode && labels.find(label) == labels.end())
-            throw SimulatorError("Undefined label.");
-        return LW;
-    }
-    else if (s == "la")
-    {
-        if (sim_mode && labels.find(label) == labels.end())
-            throw SimulatorError("Undefined label.");
-        return LA;
-    }
-    else if (s == "blt")
-    {
-        if (sim_mode && labels.find(label) == labels.end())
-            throw SimulatorError("Undefined label.");
-        return BLT;
-    }
-    else if (s == "ble")
-    {
-        if (sim_mode && labels.find(label) == labels.end())
-            throw SimulatorError("Undefined label.");
-        return BLE;
-    }
-    else if (s == "bgt")
-    {
-        if (sim_mode && labels.find(label) == labels.end())
-            throw SimulatorError("Undefined label.");
-        return BGT;
-    }
-    else if (s == "bge")
-    {
-        if (sim_mode && labels.find(label) == labels.end())
-            throw SimulatorError("Undefined label.");
-        return BGE;
     }
-    
-    return Instruction(0);
+
+    if (sim_mode && label.type == TOKEN_NAME
+        && image->labels.find(std::string(label.text)) == image->labels.end())
+        throw SimulatorError("Undefined label.");
+
+    return pseudo;
 }
 
 // Simulator mode handling of pseudoinstructions.
 void Simulator::handle_pseudo(const Instruction & ins,
-                              const std::vector< std::string > & strs)
+                              const std::vector< Token > & tokens)
 {
     uint32_t immediate;
     uint16_t param;
+
+    std::vector< std::string > strs;
+    for (const Token & token : tokens)
+        strs.push_back(std::string(token.text));
     
     switch (ins)
     {
@@ -1526,11 +3031,11 @@ void Simulator::handle_pseudo(const Instruction & ins,
             interpret_input("addu " + strs[1] + ", $0, " + strs[2]);
             break;
         case LI:
-            if (strs.size() != 3)
+            if (strs.size() != 3 || tokens[2].type != TOKEN_INTEGER)
                 throw SimulatorError("Invalid parameters for pseudoinstruction " + strs[0] + ".");
-            immediate = std::stoi(strs[2]);
+            immediate = tokens[2].value;
             // Bit pattern exceedes 32 bits.
-            if (immediate > 0xffff || immediate < 0)
+            if (immediate > 0xffff)
             {
                 param = immediate & 0b1111111111111111;
                 interpret_input("ori " + strs[1] + ", $0, " + std::to_string(param));
@@ -1553,7 +3058,7 @@ void Simulator::handle_pseudo(const Instruction & ins,
         case LA:
             if (strs.size() != 3)
                 throw SimulatorError("Invalid parameters for pseudoinstruction " + strs[0] + ".");
-            immediate = labels[strs[2]];
+            immediate = (tokens[2].type == TOKEN_INTEGER ? tokens[2].value : label_address(strs[2]));
             param = immediate & 0b1111111111111111;
             interpret_input("ori " + strs[1] + ", $0, " + std::to_string(param));
             param = immediate >> 16;
@@ -1589,68 +3094,21 @@ void Simulator::handle_pseudo(const Instruction & ins,
 }
 
 // get the instruction object from the string that denotes it
-Instruction Simulator::get_instruction(const std::string & s) const
-{
-    const static std::unordered_map< std::string, Instruction > string_instruction_map = {
-        { "add",    ADD    },
-        { "addi",   ADDI   },
-        { "addiu",  ADDIU  },
-        { "addu",   ADDU   },
-        { "and",    AND    },
-        { "andi",   ANDI   },
-        { "beq",    BEQ    },
-        { "bne",    BNE    },
-        { "j",      J      },
-        { "jal",    JAL    },
-        { "jr",     JR     },
-        { "lbu",    LBU    },
-        { "lhu",    LHU    },
-        { "lui",    LUI    },
-        { "lw",     LW     },
-        { "nor",    NOR    },
-        { "or",     OR     },
-        { "ori",    ORI    },
-        { "slt",    SLT    },
-        { "slti",   SLTI   },
-        { "sltiu",  SLTIU  },
-        { "sltu",   SLTU   },
-        { "sll",    SLL    },
-        { "srl",    SRL    },
-        { "sb",     SB     },
-        { "sc",     SC     },
-        { "sh",     SH     },
-        { "sw",     SW     },
-        { "sub",    SUB    },
-        { "subu",   SUBU   },
-        { "div",    DIV    },
-        { "divu",   DIVU   },
-        { "mfhi",   MFHI   },
-        { "mflo",   MFLO   },
-        { "mult",   MULT   },
-        { "multu",  MULTU  },
-        { "sra",    SRA    },
-        { "sllv",   SLLV   },
-        { "srav",   SRAV   },
-        { "srlv",   SRLV   },
-        { "xor",    XOR    },
-        { "xori",   XORI   },
-        { "bgtz",   BGTZ   },
-        { "blez",   BLEZ   },
-        { "jalr",   JALR   },
-        { "lb",     LB     },
-        { "lh",     LH     },
-        { "mthi",   MTHI   },
-        { "mtlo",   MTLO   },
-        { "syscall", SYSCALL },
-        { "seq",    SEQ    },
-        { "bgez",   BGEZ   },
-        { "bltz",   BLTZ   }
-    };
+Instruction Simulator::get_instruction(const std::string_view s) const
+{
+    const Instruction * found = mnemonic_table.find(s);
+    if (found == nullptr || *found >= MOVE)
+        throw SimulatorError("Unsupported instruction " + std::string(s) + ", no opcode found.");
+
+    return *found;
+}
 
-    if (string_instruction_map.find(s) == string_instruction_map.end())
-        throw SimulatorError("Unsupported instruction " + s + ", no opcode found.");
+// NO_DIRECTIVE if s is not a directive.
+Directive Simulator::get_directive(const std::string_view s) const
+{
+    const Directive * found = directive_table.find(s);
 
-    return string_instruction_map.find(s)->second;
+    return (found == nullptr ? NO_DIRECTIVE : *found);
 }
 
 // Get the opcode of a given instruction for encoding
@@ -1716,11 +3174,32 @@ uint8_t Simulator::get_opcode(const Instruction & instruction) const
     }
 }
 
+// Register number of an instruction argument.
+static uint8_t encode_register(const Token & token)
+{
+    if (token.type != TOKEN_REGISTER)
+        throw SimulatorError("Expected a register, found \"" + std::string(token.text) + "\".");
+
+    return token.value;
+}
+
+// Immediate value of an instruction argument, labels have already been
+// replaced by their addresses.
+static int32_t encode_immediate(const Token & token)
+{
+    if (token.type == TOKEN_NAME)
+        throw SimulatorError("Undefined label.");
+    if (token.type != TOKEN_INTEGER)
+        throw SimulatorError("Expected an immediate, found \"" + std::string(token.text) + "\".");
+
+    return token.value;
+}
+
 // Encode the given arguments into a 32 bit integer to be stored
 // into the text segment.
-uint32_t Simulator::encode(const std::vector< std::string > & args) const
+uint32_t Simulator::encode(const std::vector< Token > & args, const uint32_t addr) const
 {
-    Instruction instruction = get_instruction(args[0]);
+    Instruction instruction = get_instruction(args[0].text);
     uint8_t opcode = get_opcode(instruction);
     
     uint32_t encoding = 0;
@@ -1733,11 +3212,11 @@ uint32_t Simulator::encode(const std::vector< std::string > & args) const
         // I-Style OPERATION syntax encodings.
         case LUI: // ONLY 3 ARGS
             if (argc != 3)
-                throw SimulatorError("Invalid argument count for \"" + args[0] + "\".");
+                throw SimulatorError("Invalid argument count for \"" + std::string(args[0].text) + "\".");
             // Put opcode in front of integer.
             encoding = opcode << 26;
-            encoding |= uint8_t(std::stoi(args[1].substr(1))) << 16;
-            encoding |= uint16_t(std::stoi(args[2]));
+            encoding |= uint8_t(encode_register(args[1])) << 16;
+            encoding |= uint16_t(encode_immediate(args[2]));
             break;
         case ADDI:
         case ADDIU:
@@ -1756,43 +3235,43 @@ uint32_t Simulator::encode(const std::vector< std::string > & args) const
         case LB:
         case LH:  
             if (argc != 4)
-                throw SimulatorError("Invalid argument count for \"" + args[0] + "\".");
+                throw SimulatorError("Invalid argument count for \"" + std::string(args[0].text) + "\".");
             // Put opcode in front of integer.
             encoding = opcode << 26;
-            encoding |= uint8_t(std::stoi(args[2].substr(1))) << 21; // rs
-            encoding |= uint8_t(std::stoi(args[1].substr(1))) << 16; // rt
-            encoding |= uint16_t(std::stoi(args[3])); // immediate
+            encoding |= uint8_t(encode_register(args[2])) << 21; // rs
+            encoding |= uint8_t(encode_register(args[1])) << 16; // rt
+            encoding |= uint16_t(encode_immediate(args[3])); // immediate
             break;
         case BEQ:
         case BNE:
             if (argc != 4)
-                throw SimulatorError("Invalid argument count for \"" + args[0] + "\".");
+                throw SimulatorError("Invalid argument count for \"" + std::string(args[0].text) + "\".");
             // Put opcode in front of integer.
             encoding = opcode << 26;
-            encoding |= uint8_t(std::stoi(args[2].substr(1))) << 21; // rs
-            encoding |= uint8_t(std::stoi(args[1].substr(1))) << 16; // rt
-            encoding |= ((uint16_t)(std::stoi(args[3]) - program_counter)) >> 2; // immediate (jump distance)
+            encoding |= uint8_t(encode_register(args[2])) << 21; // rs
+            encoding |= uint8_t(encode_register(args[1])) << 16; // rt
+            encoding |= ((uint16_t)(encode_immediate(args[3]) - addr)) >> 2; // immediate (jump distance)
             break;
         case BGTZ:
         case BLEZ:
         case BGEZ:
         case BLTZ:
             if (argc != 3)
-                throw SimulatorError("Invalid argument count for \"" + args[0] + "\".");
+                throw SimulatorError("Invalid argument count for \"" + std::string(args[0].text) + "\".");
             // Put opcode in front of integer.
             encoding = opcode << 26;
-            encoding |= uint8_t(std::stoi(args[1].substr(1))) << 21; // rs
-            encoding |= ((uint16_t)(std::stoi(args[2]) - program_counter)) >> 2; // immediate (jump distance)
+            encoding |= uint8_t(encode_register(args[1])) << 21; // rs
+            encoding |= ((uint16_t)(encode_immediate(args[2]) - addr)) >> 2; // immediate (jump distance)
             break;
             
         // R-Style encodings
         case SLL:
         case SRL:
             if (argc != 4)
-                throw SimulatorError("Invalid argument count for \"" + args[0] + "\".");
-            encoding |= uint8_t(std::stoi(args[2].substr(1))) << 16;
-            encoding |= uint8_t(std::stoi(args[1].substr(1))) << 11;
-            encoding |= uint8_t(std::stoi(args[3])) << 6; // shamt value
+                throw SimulatorError("Invalid argument count for \"" + std::string(args[0].text) + "\".");
+            encoding |= uint8_t(encode_register(args[2])) << 16;
+            encoding |= uint8_t(encode_register(args[1])) << 11;
+            encoding |= uint8_t(encode_immediate(args[3])) << 6; // shamt value
             encoding |= opcode;
             break;
         case ADD:
@@ -1810,16 +3289,16 @@ uint32_t Simulator::encode(const std::vector< std::string > & args) const
         case SRLV:
         case SRAV:
             if (argc != 4)
-                throw SimulatorError("Invalid argument count for \"" + args[0] + "\".");
-            encoding |= uint8_t(std::stoi(args[2].substr(1))) << 21;
-            encoding |= uint8_t(std::stoi(args[3].substr(1))) << 16;
-            encoding |= uint8_t(std::stoi(args[1].substr(1))) << 11;
+                throw SimulatorError("Invalid argument count for \"" + std::string(args[0].text) + "\".");
+            encoding |= uint8_t(encode_register(args[2])) << 21;
+            encoding |= uint8_t(encode_register(args[3])) << 16;
+            encoding |= uint8_t(encode_register(args[1])) << 11;
             encoding |= opcode;
             break;
         case JR:
             if (argc != 2)
-                throw SimulatorError("Invalid argument count for \"" + args[0] + "\".");
-            encoding |= uint8_t(std::stoi(args[1].substr(1))) << 21;
+                throw SimulatorError("Invalid argument count for \"" + std::string(args[0].text) + "\".");
+            encoding |= uint8_t(encode_register(args[1])) << 21;
             encoding |= opcode;
             break;
         case DIV:
@@ -1827,9 +3306,9 @@ uint32_t Simulator::encode(const std::vector< std::string > & args) const
         case DIVU:
         case MULTU:
             if (argc != 3)
-                throw SimulatorError("Invalid argument count for \"" + args[0] + "\".");
-            encoding |= uint8_t(std::stoi(args[1].substr(1))) << 21;
-            encoding |= uint8_t(std::stoi(args[2].substr(1))) << 16;
+                throw SimulatorError("Invalid argument count for \"" + std::string(args[0].text) + "\".");
+            encoding |= uint8_t(encode_register(args[1])) << 21;
+            encoding |= uint8_t(encode_register(args[2])) << 16;
             encoding |= opcode;
             break;
         case MTHI:
@@ -1837,8 +3316,8 @@ uint32_t Simulator::encode(const std::vector< std::string > & args) const
         case MFHI:
         case MFLO:
             if (argc != 2)
-                throw SimulatorError("Invalid argument count for \"" + args[0] + "\".");
-            encoding |= uint8_t(std::stoi(args[1].substr(1))) << 11;
+                throw SimulatorError("Invalid argument count for \"" + std::string(args[0].text) + "\".");
+            encoding |= uint8_t(encode_register(args[1])) << 11;
             encoding |= opcode;
             break;
             
@@ -1846,9 +3325,9 @@ uint32_t Simulator::encode(const std::vector< std::string > & args) const
         case J:
         case JAL:
             if (argc != 2)
-                throw SimulatorError("Invalid argument count for \"" + args[0] + "\".");
+                throw SimulatorError("Invalid argument count for \"" + std::string(args[0].text) + "\".");
             encoding |= opcode << 26;
-            encoding |= (uint32_t(std::stoi(args[1])) >> 2) & 0b000011111111111111111111111111;
+            encoding |= (uint32_t(encode_immediate(args[1])) >> 2) & 0b000011111111111111111111111111;
             break;
 
         case SYSCALL:
@@ -1934,9 +3413,116 @@ Instruction Simulator::get_instruction(const uint8_t target, const bool is_funct
     throw SimulatorError("Unsupported target encoding in get_instruction().");
 }
 
-// Execute an instruction using the array of method
-// pointers.
+// Decode an instruction from its opcode (or funct value).
+Instruction Simulator::decode(const uint32_t & encoded) const
+{
+    bool is_funct;
+
+    uint8_t opcode = encoded >> 26;
+
+    is_funct = (opcode == 0);
+
+    // get funct value if necessary.
+    if (is_funct)
+        opcode = ((1 << 6) - 1) & encoded;
+
+    return get_instruction(opcode, is_funct);
+}
+
+// Store an encoded instruction in the text segment of the program
+// being assembled, along with its predecoded form.
+void Simulator::set_text(const uint32_t addr, const uint32_t encoded, const unsigned int line)
+{
+    uint32_t i = (addr - TEXT_START) >> 2;
+    if (i >= TEXT_SEGMENT_SIZE)
+        throw SimulatorError("Text segment is full.");
+
+    // Unwritten words are zero, which decodes to sll (a nop).
+    if (i >= assembling->text.size())
+    {
+        assembling->text.resize(i + 1, 0);
+        assembling->decoded.resize(i + 1, SLL);
+        assembling->lines.resize(i + 1, 0);
+    }
+
+    store_text(addr, encoded, line);
+
+    text = assembling->text.data();
+    decoded = assembling->decoded.data();
+    text_size = assembling->text.size();
+
+    return;
+}
+
+// Store an instruction without growing the text segment, which is
+// safe to do from several threads at once.
+void Simulator::store_text(const uint32_t addr, const uint32_t encoded, const unsigned int line)
+{
+    uint32_t i = (addr - TEXT_START) >> 2;
+    assembling->text[i] = encoded;
+    assembling->lines[i] = line;
+    try
+    {
+        assembling->decoded[i] = decode(encoded);
+    }
+    catch (SimulatorError & e)
+    {
+        // Reported if it is ever executed.
+        assembling->decoded[i] = TOTAL_INSTRUCTIONS;
+    }
+
+    return;
+}
+
+// Fetch and execute the instruction at the program counter.
+void Simulator::step()
+{
+    uint32_t i = (program_counter - TEXT_START) >> 2;
+    if (i >= text_size)
+        throw SimulatorError("Program counter is outside of the text segment.");
+
+    if (decoded[i] >= TOTAL_INSTRUCTIONS)
+    {
+        if (decoded[i] == NOT_ENCODED)
+            encode_lazy_line(i);
+        if (decoded[i] == TOTAL_INSTRUCTIONS)
+        {
+            execute(text[i]);
+            return;
+        }
+    }
+    dispatch(Instruction(decoded[i]), text[i]);
+
+    return;
+}
+
+// Decode and execute an instruction.
 void Simulator::execute(const uint32_t & encoded)
+{
+    dispatch(decode(encoded), encoded);
+
+    return;
+}
+
+// Cycles each instruction is counted as taking: one, except loads
+// (a load-use stall), multiplies and divides.
+static std::array< uint8_t, TOTAL_INSTRUCTIONS > cycle_costs()
+{
+    std::array< uint8_t, TOTAL_INSTRUCTIONS > costs;
+    costs.fill(1);
+    for (Instruction ins : { LW, LB, LBU, LH, LHU })
+        costs[ins] = 2;
+    costs[MULT] = costs[MULTU] = 5;
+    costs[DIV] = costs[DIVU] = 35;
+
+    return costs;
+}
+
+static const std::array< uint8_t, TOTAL_INSTRUCTIONS > CYCLE_COSTS = cycle_costs();
+
+// Execute a decoded instruction using the array of method
+// pointers.
+void Simulator::dispatch(const Instruction ins, const uint32_t & encoded)
 {
     /*
       THE FOLLOWING WILL RUN THE ins_add EXECUTION
@@ -1944,20 +3530,16 @@ void Simulator::execute(const uint32_t & encoded)
       
       (this->*ins_executions[ADD])(0);
     */
-    bool is_funct;
-
-    uint8_t opcode = encoded >> 26;
-
-    is_funct = (opcode == 0);
-
-    // get funct value if necessary.
-    if (is_funct)
-        opcode = ((1 << 6) - 1) & encoded;
-
-    Instruction ins = get_instruction(opcode, is_funct);
+    uint32_t pc = program_counter;
 
     // Execute the correct instruction using the method pointer array.
     (this->*ins_executions[ins])(encoded);
+    ++instructions_retired;
+    cycles += CYCLE_COSTS[ins];
+
+    // A store landed on a watched page.
+    if (watch_fault_pending && watch_owner == this)
+        check_watchpoints(pc);
     
     return;
 }
@@ -1968,10 +3550,12 @@ void Simulator::execute(const uint32_t & encoded)
 // correctly.
 void Simulator::get_location_and_start(const uint32_t & addr,
                                        uint8_t * & location,
-                                       unsigned int & start)
+                                       unsigned int & start,
+                                       const bool store,
+                                       const unsigned int bytes)
 {
     // Data segment
-    if (addr >= DATA_START && addr < DATA_START + DATA_SEGMENT_SIZE)
+    if (addr >= DATA_START && addr <= DATA_START + DATA_SEGMENT_SIZE - bytes)
     {
         location = data;
         start = DATA_START;
@@ -1981,25 +3565,568 @@ void Simulator::get_location_and_start(const uint32_t & addr,
     // TAKE UP EXACTLY HALF OF THE BLOCK THEY SHARE.
 
     // Heap
-    else if (addr >= HEAP_START && addr < HEAP_START + MAX_HEAP)
+    else if (addr >= HEAP_START && addr <= HEAP_START + MAX_HEAP - bytes)
     {
         location = heap;
         start = HEAP_START;
     }
 
     // Stack
-    else if (addr >= STACK_START && addr < STACK_START + MAX_STACK)
+    else if (addr >= STACK_START && addr <= STACK_START + MAX_STACK - bytes)
     {
         location = stack;
         start = STACK_START;
     }
     
+    // Mapped files. The host mapping ends with the file, so an access
+    // hanging off its end has to be refused rather than let fault.
+    else if (addr >= MMAP_START && addr < mmap_ptr)
+    {
+        for (MappedRegion & r : mapped_regions)
+        {
+            if (addr >= r.addr && uint64_t(addr) + bytes <= uint64_t(r.addr) + r.size)
+            {
+                if (store && !r.writable)
+                    throw SimulatorError("Store to read-only mapped file.");
+                location = r.file->data();
+                start = r.addr;
+                return;
+            }
+        }
+        throw SimulatorError("Invalid store/load location.");
+    }
+    
     else
         throw SimulatorError("Invalid store/load location.");
 
     return;
 }
 
+// One past the last address of the segment (or mapped file) holding
+// addr, which get_location_and_start() has accepted.
+uint32_t Simulator::segment_end(const uint32_t addr) const
+{
+    if (addr >= DATA_START && addr < DATA_START + DATA_SEGMENT_SIZE)
+        return DATA_START + DATA_SEGMENT_SIZE;
+    if (addr >= HEAP_START && addr < HEAP_START + MAX_HEAP)
+        return HEAP_START + MAX_HEAP;
+    if (addr >= STACK_START && addr < STACK_START + MAX_STACK)
+        return STACK_START + MAX_STACK;
+    for (const MappedRegion & r : mapped_regions)
+        if (addr >= r.addr && addr < r.addr + r.size)
+            return r.addr + r.size;
+
+    return addr;
+}
+
+// For syscall 30. Host time is outside input, so it goes through the
+// syscall log, virtual time does not need to.
+uint64_t Simulator::system_time()
+{
+    if (virtual_time)
+        return instructions_retired / VIRTUAL_INSTRUCTIONS_PER_MS;
+    deterministic_run = false;
+
+    std::string bytes;
+    if (syscall_log.mode() == SyscallLog::REPLAY)
+    {
+        syscall_log.read(30, bytes);
+        uint64_t ms;
+        if (bytes.size() != sizeof(ms))
+            throw SimulatorError("Syscall log has no time where the program reads it.");
+        std::memcpy(&ms, bytes.data(), sizeof(ms));
+        return le64toh(ms);
+    }
+
+    uint64_t ms = std::chrono::duration_cast< std::chrono::milliseconds >(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    if (syscall_log.mode() == SyscallLog::RECORD)
+    {
+        uint64_t logged = htole64(ms);
+        syscall_log.write(30, std::string((const char *)(&logged), sizeof(logged)));
+    }
+
+    return ms;
+}
+
+// Everything printed so far goes out before the program reads. If the
+// input is fed to a session and there is none yet, the syscall is left
+// to run again once there is: the program waits, without being counted
+// as having executed it.
+bool Simulator::await_input()
+{
+    guest_output.flush();
+    if (syscall_log.mode() == SyscallLog::REPLAY || guest_input.ready())
+        return true;
+
+    waiting_for_input = true;
+    --instructions_retired;
+    cycles -= CYCLE_COSTS[SYSCALL];
+
+    return false;
+}
+
+bool Simulator::read_input(const uint32_t syscall, std::string & line)
+{
+    if (syscall_log.mode() == SyscallLog::REPLAY)
+        return syscall_log.read(syscall, line);
+
+    bool read = guest_input.read_line(line);
+    if (syscall_log.mode() == SyscallLog::RECORD)
+        syscall_log.write(syscall, line, !read);
+
+    return read;
+}
+
+// A line of input for syscall 5: a decimal integer that fits in 32
+// bits, optionally surrounded by whitespace.
+int32_t Simulator::parse_input_int(const std::string & input)
+{
+    char * end;
+    errno = 0;
+    long long value = std::strtoll(input.c_str(), &end, 10);
+    while (isspace(*end))
+        ++end;
+    if (end == input.c_str() || *end != '\0' || errno == ERANGE || value < INT32_MIN || value > INT32_MAX)
+        throw SimulatorError("Invalid integer input \"" + input + "\".");
+
+    return value;
+}
+
+// Read a null terminated string out of guest memory.
+std::string Simulator::read_guest_string(const uint32_t addr)
+{
+    uint8_t * location;
+    unsigned int location_start;
+    get_location_and_start(addr, location, location_start);
+
+    // Up to the terminator, or the end of the segment if it has none.
+    std::string s;
+    unsigned int i = 0;
+    unsigned int max = segment_end(addr) - addr;
+    while (i < max && location[addr - location_start + i] != '\0')
+        s.push_back(location[addr - location_start + (i++)]);
+
+    return s;
+}
+
+// Map a host file into the next free guest range. The guest gets the
+// address in $v0 and the length in $v1, or -1 in $v0 on failure.
+void Simulator::map_file(const std::string & filename, const bool writable)
+{
+    deterministic_run = false;
+    std::unique_ptr< MappedFile > file;
+    try
+    {
+        file.reset(new MappedFile(filename, writable));
+    }
+    catch (SimulatorError & e)
+    {
+        regs[2] = -1;
+        regs[3] = 0;
+        return;
+    }
+
+    // Keep a guard page between mappings so a word access hanging
+    // off the end of one file cannot land in the next.
+    uint32_t size = file->size();
+    uint32_t pages = (size + 0xfff) >> 12;
+    if (uint64_t(mmap_ptr) + ((pages + 1) << 12) > STACK_START)
+    {
+        regs[2] = -1;
+        regs[3] = 0;
+        return;
+    }
+
+    regs[2] = mmap_ptr;
+    regs[3] = size;
+    mapped_regions.push_back({mmap_ptr, size, writable, std::move(file)});
+    mmap_ptr += (pages + 1) << 12;
+    
+    return;
+}
+
+void Simulator::unmap_file(const uint32_t addr)
+{
+    for (unsigned int i = 0; i < mapped_regions.size(); ++i)
+    {
+        if (mapped_regions[i].addr == addr)
+        {
+            mapped_regions.erase(mapped_regions.begin() + i);
+            return;
+        }
+    }
+
+    throw SimulatorError("No file mapped at the given address.");
+}
+
+// Open flags as in MARS: 0 read, 1 write (created or truncated), 9
+// append. The guest gets the lowest free descriptor, or -1.
+void Simulator::open_guest_file(const std::string & filename, const uint32_t flags)
+{
+    deterministic_run = false;
+    int host_flags;
+    if (flags == 0)
+        host_flags = O_RDONLY;
+    else if (flags == 1)
+        host_flags = O_WRONLY | O_CREAT | O_TRUNC;
+    else if (flags == 9)
+        host_flags = O_WRONLY | O_CREAT | O_APPEND;
+    else
+    {
+        regs[2] = -1;
+        return;
+    }
+
+    int fd = open(filename.c_str(), host_flags | O_CLOEXEC, 0644);
+    if (fd < 0)
+    {
+        regs[2] = -1;
+        return;
+    }
+
+    unsigned int i = 0;
+    while (i < open_files.size() && open_files[i] >= 0)
+        ++i;
+    if (i == open_files.size())
+        open_files.push_back(fd);
+    else
+        open_files[i] = fd;
+    regs[2] = i + 3;
+
+    return;
+}
+
+// Host descriptor of a guest's, -1 if it is not open.
+int Simulator::host_file(const uint32_t fd) const
+{
+    if (fd < 3)
+        return fd;
+    if (fd - 3 < open_files.size())
+        return open_files[fd - 3];
+
+    return -1;
+}
+
+// The kernel reads straight into guest memory, at most to the end of
+// the segment the buffer is in. $v0 gets the bytes read, 0 at the end
+// of the file, -1 on failure.
+void Simulator::read_guest_file(const uint32_t fd, const uint32_t addr, const uint32_t count)
+{
+    uint8_t * location;
+    unsigned int location_start;
+    get_location_and_start(addr, location, location_start, true);
+    uint8_t * p = location + (addr - location_start);
+    size_t n = std::min< size_t >(count, segment_end(addr) - addr);
+
+    // stdin shares the program's input with syscalls 5 and 8.
+    if (fd == 0)
+    {
+        std::string bytes;
+        if (syscall_log.mode() == SyscallLog::REPLAY)
+        {
+            syscall_log.read(14, bytes);
+            if (bytes.size() > n)
+                throw SimulatorError("Syscall log has more input than the program reads.");
+        }
+        else
+        {
+            bytes.resize(n);
+            bytes.resize(n > 0 ? guest_input.read(&bytes[0], n) : 0);
+            if (syscall_log.mode() == SyscallLog::RECORD)
+                syscall_log.write(14, bytes);
+        }
+        std::memcpy(p, bytes.data(), bytes.size());
+        regs[2] = bytes.size();
+        return;
+    }
+
+    int host = host_file(fd);
+    if (host < 0 || fd < 3)
+    {
+        regs[2] = -1;
+        return;
+    }
+
+    // Watched pages are write protected, the kernel would fail to write
+    // them instead of faulting, so their stores go through memcpy.
+    ssize_t got;
+    if (watchpoints.empty())
+        got = read(host, p, n);
+    else
+    {
+        std::vector< uint8_t > bytes(n);
+        got = read(host, bytes.data(), n);
+        if (got > 0)
+            std::memcpy(p, bytes.data(), got);
+    }
+    regs[2] = (got < 0 ? -1 : int32_t(got));
+
+    return;
+}
+
+// $v0 gets the bytes written, -1 on failure.
+void Simulator::write_guest_file(const uint32_t fd, const uint32_t addr, const uint32_t count)
+{
+    uint8_t * location;
+    unsigned int location_start;
+    get_location_and_start(addr, location, location_start);
+    const char * p = (const char *)(location + (addr - location_start));
+    size_t n = std::min< size_t >(count, segment_end(addr) - addr);
+
+    // stdout stays in order with the rest of the program's output.
+    if (fd == 1)
+    {
+        guest_output.write(p, n);
+        regs[2] = n;
+        return;
+    }
+    // stderr is not part of the output a run is cached with.
+    if (fd == 2)
+    {
+        guest_output.flush();
+        deterministic_run = false;
+    }
+
+    int host = host_file(fd);
+    ssize_t written = (host < 0 || fd == 0 ? -1 : write(host, p, n));
+    regs[2] = (written < 0 ? -1 : int32_t(written));
+
+    return;
+}
+
+void Simulator::close_guest_file(const uint32_t fd)
+{
+    if (fd >= 3 && fd - 3 < open_files.size() && open_files[fd - 3] >= 0)
+    {
+        close(open_files[fd - 3]);
+        open_files[fd - 3] = -1;
+    }
+
+    return;
+}
+
+// Allocate a page aligned segment of guest memory, zeroed or a private
+// copy-on-write view of the given file starting at offset.
+uint8_t * Simulator::map_segment(const unsigned int size, const int fd, const off_t offset)
+{
+    void * segment = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | (fd < 0 ? MAP_ANONYMOUS : 0), fd, offset);
+    if (segment == MAP_FAILED)
+        throw SimulatorError("Unable to allocate guest memory.");
+
+    return (uint8_t *)(segment);
+}
+
+void Simulator::unmap_segment(uint8_t * segment, const unsigned int size)
+{
+    if (segment != nullptr)
+        munmap(segment, size);
+
+    return;
+}
+
+// Turn a label or a hexadecimal string into an address.
+uint32_t Simulator::parse_address(const std::string & s) const
+{
+    if (image->labels.find(s) != image->labels.end())
+        return image->labels.find(s)->second;
+
+    // Anything but a plain hexadecimal number, a negative one or one
+    // too large for an address is an error.
+    char * end;
+    errno = 0;
+    unsigned long long addr = std::strtoull(s.c_str(), &end, 16);
+    if (s.empty() || !isxdigit(s[0]) || *end != '\0' || errno == ERANGE || addr > UINT32_MAX)
+        throw SimulatorError("Invalid label or hexadecimal address \"" + s + "\".");
+
+    return addr;
+}
+
+void Simulator::add_watchpoint(const uint32_t addr, const unsigned int bytes)
+{
+    if (watch_owner != nullptr && watch_owner != this)
+        throw SimulatorError("Watchpoints are already in use by another simulator.");
+    if (bytes == 0)
+        throw SimulatorError("Watchpoints must cover at least one byte.");
+    if (bytes - 1 > UINT32_MAX - addr)
+        throw SimulatorError("Watchpoints cannot run past the end of memory.");
+    if ((bytes == 2 || bytes == 4) && addr % bytes != 0)
+        throw SimulatorError("Watched halfwords and words must be aligned.");
+
+    // Both ends have to be in the same segment so the range is
+    // contiguous in host memory.
+    uint8_t * location;
+    uint8_t * end_location;
+    unsigned int location_start;
+    unsigned int end_start;
+    get_location_and_start(addr, location, location_start);
+    get_location_and_start(addr + bytes - 1, end_location, end_start);
+    if (location != end_location)
+        throw SimulatorError("Watchpoints cannot span multiple segments.");
+
+    uint8_t * host = location + (addr - location_start);
+    watchpoints.push_back({addr, bytes, std::vector< uint8_t >(host, host + bytes)});
+
+    try
+    {
+        protect_watched_pages();
+    }
+    catch (SimulatorError & e)
+    {
+        watchpoints.pop_back();
+        protect_watched_pages();
+        throw e;
+    }
+    
+    return;
+}
+
+void Simulator::remove_watchpoint(const uint32_t addr)
+{
+    unsigned int n = watchpoints.size();
+    for (unsigned int i = 0; i < watchpoints.size(); ++i)
+        if (watchpoints[i].addr == addr)
+            watchpoints.erase(watchpoints.begin() + (i--));
+
+    if (watchpoints.size() == n)
+        throw SimulatorError("No watchpoint at that address.");
+
+    protect_watched_pages();
+    
+    return;
+}
+
+// Rebuild the table of write protected pages from the current
+// watchpoints, and install or remove the fault handler as needed.
+void Simulator::protect_watched_pages()
+{
+    if (!watchpoints.empty() && watch_owner != this)
+    {
+        Simulator * none = nullptr;
+        if (!watch_owner.compare_exchange_strong(none, this))
+            throw SimulatorError("Watchpoints are already in use by another simulator.");
+        struct sigaction action;
+        std::memset(&action, 0, sizeof(action));
+        action.sa_sigaction = watch_fault_handler;
+        action.sa_flags = SA_SIGINFO;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGSEGV, &action, &previous_segv_action);
+    }
+    else if (watch_owner != this)
+        return;
+
+    // Open every page back up before working out the new set.
+    for (int i = 0; i < watched_page_count; ++i)
+        mprotect((void *)(watched_pages[i]), host_page_size, PROT_READ | PROT_WRITE);
+    watched_page_count = 0;
+    watch_fault_pending = 0;
+
+    if (watchpoints.empty())
+    {
+        sigaction(SIGSEGV, &previous_segv_action, nullptr);
+        watch_owner = nullptr;
+        return;
+    }
+
+    unsigned int count = 0;
+    for (const Watchpoint & w : watchpoints)
+    {
+        uint8_t * location;
+        unsigned int location_start;
+        get_location_and_start(w.addr, location, location_start);
+        
+        uintptr_t first = uintptr_t(location + (w.addr - location_start)) & ~(host_page_size - 1);
+        uintptr_t last = uintptr_t(location + (w.addr - location_start) + w.bytes - 1) & ~(host_page_size - 1);
+        for (uintptr_t page = first; page <= last; page += host_page_size)
+        {
+            unsigned int i = 0;
+            while (i < count && watched_pages[i] != page)
+                ++i;
+            if (i < count)
+                continue;
+            
+            if (count == MAX_WATCHED_PAGES)
+                throw SimulatorError("Too many pages watched.");
+            watched_pages[count] = page;
+            watched_page_faulted[count] = 0;
+            ++count;
+        }
+    }
+
+    for (unsigned int i = 0; i < count; ++i)
+        mprotect((void *)(watched_pages[i]), host_page_size, PROT_READ);
+    watched_page_count = count;
+    
+    return;
+}
+
+// Called after an instruction faulted on a watched page. Compare each
+// watchpoint against its last known contents, report the changes and
+// protect the pages again. Read mode stops on a change.
+void Simulator::check_watchpoints(const uint32_t pc)
+{
+    watch_fault_pending = 0;
+
+    bool hit = false;
+    for (Watchpoint & w : watchpoints)
+    {
+        uint8_t * location;
+        unsigned int location_start;
+        get_location_and_start(w.addr, location, location_start);
+        uint8_t * host = location + (w.addr - location_start);
+        
+        if (std::memcmp(host, w.value.data(), w.bytes) == 0)
+            continue;
+        hit = true;
+
+        // Show the whole value of small watchpoints, otherwise the
+        // word starting at the first changed byte.
+        unsigned int offset = 0;
+        while (w.bytes > 4 && host[offset] == w.value[offset])
+            ++offset;
+        unsigned int n = std::min(w.bytes - offset, 4u);
+        uint32_t old_val = 0;
+        uint32_t new_val = 0;
+        for (unsigned int i = 0; i < n; ++i)
+        {
+            old_val = (old_val << 8) | w.value[offset + i];
+            new_val = (new_val << 8) | host[offset + i];
+        }
+
+        guest_output.flush();
+        std::cout << "Watchpoint 0x" << std::hex << std::setfill('0') << std::setw(8)
+                  << w.addr + offset << " changed at pc 0x" << std::setw(8) << pc
+                  << std::setfill(' ') << std::dec;
+        std::string source = image->location_of((pc - TEXT_START) >> 2);
+        if (source != "")
+            std::cout << " (" << source << ")";
+        for (const InputAddressPair & p : input_addr)
+            if (p.address == pc)
+                std::cout << " (\"" << p.input << "\")";
+        std::cout << ": " << int32_t(old_val) << " -> " << int32_t(new_val) << '\n';
+
+        w.value.assign(host, host + w.bytes);
+    }
+
+    for (int i = 0; i < watched_page_count; ++i)
+    {
+        if (watched_page_faulted[i])
+        {
+            watched_page_faulted[i] = 0;
+            mprotect((void *)(watched_pages[i]), host_page_size, PROT_READ);
+        }
+    }
+
+    if (hit && !sim_mode)
+    {
+        std::cout << "Stopped at the watchpoint.\n";
+        running = false;
+    }
+    
+    return;
+}
+
 /////////////////////////////////////////
 /// Instruction execution defenitions ///
 /////////////////////////////////////////
@@ -2165,7 +4292,7 @@ void Simulator::ins_lhu(const uint32_t & encoded)
     uint32_t addr = regs[rs] + immediate;
     uint8_t * location;
     unsigned int location_start;
-    get_location_and_start(addr, location, location_start);
+    get_location_and_start(addr, location, location_start, false, 2);
 
     uint32_t val = location[addr - location_start] << 8;
     val |= location[addr - location_start + 1];
@@ -2182,6 +4309,8 @@ void Simulator::ins_lui(const uint32_t & encoded)
     uint8_t rt = (encoded >> 16) & 0b11111;
     uint16_t immediate = encoded & 0b1111111111111111;
 
+    if (image->standard_lui)
+        regs[rt] = 0;
     regs[rt] &= 0b00000000000000001111111111111111;
     regs[rt] |= immediate << 16;
 
@@ -2199,7 +4328,7 @@ void Simulator::ins_lw(const uint32_t & encoded)
     uint32_t addr = regs[rs] + immediate;
     uint8_t * location;
     unsigned int location_start;
-    get_location_and_start(addr, location, location_start);
+    get_location_and_start(addr, location, location_start, false, 4);
 
     uint32_t val = location[addr - location_start] << 24;
     val |= location[addr - location_start + 1] << 16;
@@ -2339,7 +4468,7 @@ void Simulator::ins_sb(const uint32_t & encoded)
     uint32_t addr = regs[rs] + immediate;
     uint8_t * location;
     unsigned int location_start;
-    get_location_and_start(addr, location, location_start);
+    get_location_and_start(addr, location, location_start, true);
 
     location[addr - location_start] = regs[rt] & 0b11111111;
     
@@ -2357,7 +4486,7 @@ void Simulator::ins_sc(const uint32_t & encoded)
     uint32_t addr = regs[rs] + immediate;
     uint8_t * location;
     unsigned int location_start;
-    get_location_and_start(addr, location, location_start);
+    get_location_and_start(addr, location, location_start, true);
 
     // For a conditional, should only be 0 or 1, so only look at first bit.
     location[addr - location_start] = regs[rt] & 0b1;
@@ -2376,7 +4505,7 @@ void Simulator::ins_sh(const uint32_t & encoded)
     uint32_t addr = regs[rs] + immediate;
     uint8_t * location;
     unsigned int location_start;
-    get_location_and_start(addr, location, location_start);
+    get_location_and_start(addr, location, location_start, true, 2);
 
     location[addr - location_start] = (regs[rt] >> 8) & 0b11111111;
     location[addr - location_start + 1] = regs[rt] & 0b11111111;
@@ -2395,7 +4524,7 @@ void Simulator::ins_sw(const uint32_t & encoded)
     uint32_t addr = regs[rs] + immediate;
     uint8_t * location;
     unsigned int location_start;
-    get_location_and_start(addr, location, location_start);
+    get_location_and_start(addr, location, location_start, true, 4);
     
     location[addr - location_start] = regs[rt] >> 24;
     location[addr - location_start + 1] = (regs[rt] >> 16) & 0b11111111;
@@ -2652,7 +4781,7 @@ void Simulator::ins_lh(const uint32_t & encoded)
     uint32_t addr = regs[rs] + immediate;
     uint8_t * location;
     unsigned int location_start;
-    get_location_and_start(addr, location, location_start);
+    get_location_and_start(addr, location, location_start, false, 2);
 
     uint32_t val = location[addr - location_start] << 8;
     val |= location[addr - location_start + 1];
@@ -2693,7 +4822,7 @@ void Simulator::ins_syscall(const uint32_t & encoded)
         // PRINT INT
         case 1:
             // Print $a0 as integer.
-            std::cout << int(regs[4]);
+            guest_output.write_int(int(regs[4]));
             break;
         // PRINT STRING
         case 4:
@@ -2703,32 +4832,41 @@ void Simulator::ins_syscall(const uint32_t & encoded)
             unsigned int location_start;
             get_location_and_start(addr, location, location_start);
 
-            unsigned int i = 0;
-            while (location[addr - location_start + i] != '\0')
-                std::cout << location[addr - location_start + (i++)];
+            // Up to the terminator, or the end of the segment if it
+            // has none.
+            const char * start = (const char *)(location + (addr - location_start));
+            size_t max = segment_end(addr) - addr;
+            const char * end = (const char *)(std::memchr(start, '\0', max));
+            guest_output.write(start, (end != nullptr ? end - start : max));
             
             break;
         }
         // READ INT
         case 5: // Input integer into $a0
         {
+            if (!await_input())
+                return;
             std::string input;
-            std::getline(std::cin, input);
-            regs[2] = std::stoi(input);
+            if (!read_input(5, input))
+                throw SimulatorError("No input left to read an integer from.");
+            regs[2] = parse_input_int(input);
             break;
         }
         // READ STRING
         case 8:
         {
+            if (!await_input())
+                return;
             std::string input;
-            std::getline(std::cin, input);
+            read_input(8, input);
             input.push_back('\n'); // Mips appends a newline character.
             
             uint32_t addr = regs[4]; // $a0
             uint32_t max_chars = (regs[5] > input.size() ? input.size() : regs[5]);; // $a1
             uint8_t * location;
             unsigned int location_start;
-            get_location_and_start(addr, location, location_start);
+            get_location_and_start(addr, location, location_start, true);
+            max_chars = std::min(max_chars, segment_end(addr) - addr);
 
             unsigned int i = 0;
             while (i < max_chars)
@@ -2738,18 +4876,78 @@ void Simulator::ins_syscall(const uint32_t & encoded)
         }
         // ALLOCATE HEAP MEMORY
         case 9:
-            // Give first address of bytes allocated to $v0.
-            regs[2] = heap_ptr;
-            heap_ptr += regs[4]; // Move heap pointer forward by the
-                                 // amount of bytes denoted by $a0.
-
+            // Give first address of bytes allocated to $v0 and move
+            // the break forward by the amount of bytes denoted by $a0.
+            regs[2] = heap_allocator.sbrk(regs[4]);
             break;
         case 10:
             running = false;
-            std::cout << "Simulator exiting..." << std::endl;
+            exit_status = 0;
+            guest_output.flush();
+            // The simulator's message, not the program's output, so
+            // it is left out of output captured for a client or cache.
+            if (!guest_output.capturing())
+                std::cout << "Simulator exiting..." << std::endl;
+            break;
+        // OPEN FILE
+        case 13: // $a0 = filename, $a1 = flags, descriptor returned in $v0.
+            open_guest_file(read_guest_string(regs[4]), regs[5]);
+            break;
+        // READ FROM FILE
+        case 14: // $a0 = descriptor, $a1 = buffer, $a2 = bytes.
+            if (regs[4] == 0 && !await_input())
+                return;
+            read_guest_file(regs[4], regs[5], regs[6]);
+            break;
+        // WRITE TO FILE
+        case 15: // $a0 = descriptor, $a1 = buffer, $a2 = bytes.
+            write_guest_file(regs[4], regs[5], regs[6]);
+            break;
+        // CLOSE FILE
+        case 16: // $a0 = descriptor.
+            close_guest_file(regs[4]);
+            break;
+        // EXIT WITH STATUS
+        case 17: // $a0 = status.
+            running = false;
+            exit_status = int(regs[4]);
+            guest_output.flush();
             break;
         case 11: // Print $a0 as a character.
-            std::cout << char(regs[4]);
+            guest_output.put(char(regs[4]));
+            break;
+        // MALLOC
+        case 92: // $a0 = bytes, address returned in $v0.
+            regs[2] = heap_allocator.allocate(regs[4]);
+            break;
+        // FREE
+        case 93: // $a0 = address returned by syscall 92.
+            heap_allocator.release(regs[4]);
+            break;
+        // MAP FILE
+        case 90: // $a0 = filename, $a1 = 0 for read-only, 1 for copy-on-write.
+            map_file(read_guest_string(regs[4]), regs[5] == 1);
+            break;
+        // UNMAP FILE
+        case 91: // $a0 = address returned by syscall 90.
+            unmap_file(regs[4]);
+            break;
+        // SYSTEM TIME
+        case 30: // Milliseconds since 1970 (or the start in virtual time), low in $a0, high in $a1.
+        {
+            uint64_t ms = system_time();
+            regs[4] = uint32_t(ms);
+            regs[5] = uint32_t(ms >> 32);
+            break;
+        }
+        // INSTRUCTION AND CYCLE COUNTS
+        case 94: // Instructions retired, low in $a0, high in $a1.
+            regs[4] = uint32_t(instructions_retired);
+            regs[5] = uint32_t(instructions_retired >> 32);
+            break;
+        case 95: // Cycles, low in $a0, high in $a1.
+            regs[4] = uint32_t(cycles);
+            regs[5] = uint32_t(cycles >> 32);
             break;
         default:
             throw SimulatorError("Undefined syscall $v0 value.");
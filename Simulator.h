@@ -7,6 +7,20 @@
 
 #include "Common.h"
 #include "RegisterFile.h"
+#include "MappedFile.h"
+#include "HeapAllocator.h"
+#include "ProgramImage.h"
+#include "Lexer.h"
+#include "SymbolTable.h"
+#include "LineCache.h"
+#include "LinkUnit.h"
+#include "ControlFlow.h"
+#include "GuestOutput.h"
+#include "GuestInput.h"
+#include "SyscallLog.h"
+#include "ResultCache.h"
+
+#include <mutex>
 
 const unsigned int TEXT_SEGMENT_SIZE = 1000000;
 const unsigned int DATA_SEGMENT_SIZE = 1000000;
@@ -15,6 +29,22 @@ const unsigned int MAX_STACK = 1000000; // Grows downwards.
 
 const unsigned int TOTAL_INSTRUCTIONS = 53;
 
+// How run_for() stopped.
+enum RunResult
+{
+    RUN_EXITED,  // The program exited.
+    RUN_WAITING, // It needs input that has not been fed yet.
+    RUN_YIELDED  // It used up its instructions.
+};
+
+// Virtual time (see set_virtual_time()) advances a millisecond every
+// this many instructions, a 1 GHz machine retiring one per cycle.
+const uint64_t VIRTUAL_INSTRUCTIONS_PER_MS = 1000000;
+
+// Predecoded value of a word of text that lazy assembly has not encoded
+// yet.
+const uint8_t NOT_ENCODED = TOTAL_INSTRUCTIONS + 1;
+
 // FN means it is a function, so it gets the R (register) encoding scheme
 // OP means an operation, so it has an opcode and gets the I (immediate) encoding scheme.
 // Some OP instructions get the jump encoding scheme if they are jumps.
@@ -86,6 +116,128 @@ enum Instruction
     BGE
 };
 
+// Assembler directives, NO_DIRECTIVE so it can be used as a boolean
+// condition.
+enum Directive
+{
+    NO_DIRECTIVE = 0,
+    DIRECTIVE_TEXT,
+    DIRECTIVE_DATA,
+    DIRECTIVE_GLOBL,
+    DIRECTIVE_WORD,
+    DIRECTIVE_HALF,
+    DIRECTIVE_BYTE,
+    DIRECTIVE_SPACE,
+    DIRECTIVE_ASCII,
+    DIRECTIVE_ASCIIZ,
+    DIRECTIVE_ALIGN,
+    DIRECTIVE_INCBIN
+};
+
+// Simple enum to keep track of which segment you are in.
+enum MipsSegment
+{
+    NONE, // Not in a segment, awaiting segment change.
+    TEXT, // In the text segment.
+    DATA  // In the data segment.
+};
+
+// Largest .align, as a power of two.
+const unsigned int MAX_ALIGN = 12;
+
+// Files at least this large are assembled by every core at once.
+const unsigned int PARALLEL_ASSEMBLY_SIZE = 256 * 1024;
+
+// What a line of a file does.
+enum LineKind
+{
+    LINE_EMPTY,       // Nothing, or only a label.
+    LINE_INVALID,     // Does not start with a name.
+    LINE_SEGMENT,     // ".text" or ".data"
+    LINE_GLOBL,       // ".globl <label>"
+    LINE_ALIGN,       // ".align <n>", its size depends on where it is.
+    LINE_DATA,        // Any other directive.
+    LINE_INSTRUCTION  // Instruction or pseudoinstruction.
+};
+
+// A line of a file, lexed and sized. Working this out needs nothing but
+// the line itself, so lines can be lexed in any order.
+struct SourceLine
+{
+    std::vector< Token > tokens; // Without the label.
+    std::string_view label;      // Defined by the line, empty if none.
+    LineKind kind;
+    Directive directive;
+    Instruction pseudo;          // Instruction(0) if not a pseudoinstruction.
+    uint32_t size;               // Bytes taken up in its segment.
+    unsigned int line;
+};
+
+// Label references left by emitting lines, to be patched once every
+// label is known.
+struct AssemblyOutput
+{
+    std::vector< Relocation > relocations;
+
+    // Emitting in the second pass of a two pass assembly: every label
+    // is defined and the text segment is sized, so references are
+    // patched on the spot and neither is changed (other threads may be
+    // reading them).
+    bool second_pass;
+
+    // A branch to a numeric address was emitted, which is encoded
+    // relative to where it is.
+    bool position_dependent;
+};
+
+// A line kept by lazy assembly to be encoded later. address is from
+// the start of its chunk until the chunk's position is known.
+struct LazyLine
+{
+    std::string_view text;
+    unsigned int line;
+    uint32_t address;
+};
+
+// A label defined in a chunk, by where it is in the chunk.
+struct ChunkLabel
+{
+    std::string_view name;
+    MipsSegment segment; // NONE if it is in whichever one the chunk starts in.
+    uint32_t text_offset;
+    uint32_t data_offset;
+};
+
+// A run of whole lines of a file, assembled by one thread. Only what
+// the first pass finds out is kept, the second pass lexes the lines
+// again.
+struct SourceChunk
+{
+    std::string_view source;
+    unsigned int line_count;
+    uint64_t text_bytes;
+    uint64_t data_bytes;
+
+    // Indexed by the segment the chunk starts in: whether every line is
+    // in a segment it may be in, and the segment the chunk ends in.
+    bool valid[3];
+    MipsSegment end_segment[3];
+
+    std::vector< ChunkLabel > labels;
+    std::vector< SourceLine > globls;
+    bool failed;
+
+    // Lazy assembly only, the lines that go in each segment.
+    std::vector< LazyLine > text_lines;
+    std::vector< LazyLine > data_lines;
+
+    // Where the chunk starts, known once the chunks before it are sized.
+    MipsSegment start_segment;
+    uint32_t text_start;
+    uint32_t data_start;
+    unsigned int first_line;
+};
+
 
 // Structure used to keep track of instructions
 // and where they are in memory.
@@ -95,35 +247,54 @@ struct InputAddressPair
     uint32_t address;
 };
 
-// Structure to keep track of a list of instructions
-// to be encoded, or data to be put into the data segment.
-struct StrsAddressSegmentLine
+// A guest address range that is reported whenever its contents change.
+// The host pages behind it are write protected, so only stores that
+// land on those pages pay for the check.
+struct Watchpoint
 {
-    std::vector< std::string > strs;
-    uint32_t address;
-    bool text;
-    unsigned int line;
+    uint32_t addr;
+    unsigned int bytes;
+    std::vector< uint8_t > value; // Contents as of the last check.
 };
 
-// Simple enum to keep track of which segment you are in.
-enum MipsSegment
+// A host file mapped into the guest address space by syscall 90.
+// Guest accesses go straight to the host mapping.
+struct MappedRegion
 {
-    NONE, // Not in a segment, awaiting segment change.
-    TEXT, // In the text segment.
-    DATA  // In the data segment.
+    uint32_t addr;
+    uint32_t size;
+    bool writable;
+    std::unique_ptr< MappedFile > file;
 };
 
+
 class Simulator
 {
 public:
     Simulator() :
         running(false),
+        exit_status(0),
+        instructions_retired(0),
+        cycles(0),
+        virtual_time(false),
+        deterministic_run(true),
+        waiting_for_input(false),
         current_segment(NONE),
         text_seg_addr(0x00040000),
         data_seg_addr(0x10010000),
         sim_currently_pseudo(false),
         entrypoint_label(""),
-        entrypoint_addr(0),
+        assembling(std::make_shared< ProgramImage >()),
+        image(assembling),
+        text(nullptr),
+        decoded(nullptr),
+        text_size(0),
+        assembly_output(),
+        assembly_threads(0),
+        assembling_unit(false),
+        data_alignment(LINK_DATA_ALIGN),
+        lazy_assembly(false),
+        guest_output(STDOUT_FILENO),
         ins_executions{ // Method pointer array initialization.
         &Simulator::ins_add,
         &Simulator::ins_addi,
@@ -180,16 +351,155 @@ public:
         &Simulator::ins_bltz,
         }
     {
+        // Back the data, heap and stack segments with their own
+        // mappings so their pages can be protected for watchpoints.
+        data = map_segment(DATA_SEGMENT_SIZE);
+        heap = map_segment(MAX_HEAP);
+        stack = map_segment(MAX_STACK);
+        
         // Init the stack pointer to be at the end of the stack.
         regs[29] = STACK_END - 1;
     }
 
-    ~Simulator()
-    {}
+    // Run a program assembled by another simulator. The image is
+    // shared, not copied.
+    Simulator(const std::shared_ptr< const ProgramImage > & program) :
+        Simulator()
+    {
+        load_image(program);
+    }
+
+    ~Simulator();
+
+    // The segments are owned mappings, so no copying.
+    Simulator(const Simulator &) = delete;
+    Simulator & operator=(const Simulator &) = delete;
 
     // Function called by main to run the MIPS simulation.
     void run();
 
+    // Assemble a file without running it, after which program_image()
+    // can be handed to other simulators.
+    void assemble_file(const std::string & filename);
+    std::shared_ptr< const ProgramImage > program_image();
+
+    // Basic blocks, loops and functions of the loaded program (see
+    // ControlFlow.h), worked out the first time they are asked for and
+    // kept until another program is loaded.
+    const ControlFlowGraph & control_flow();
+
+    // Assemble several files into one program (see LinkUnit.h). Files
+    // are assembled on their own, several at once, and then linked.
+    void assemble_files(const std::vector< std::string > & filenames);
+
+    // Save the assembled program as an object file, or load one (or
+    // a linked ELF executable, see ElfFile.h) instead of assembling.
+    // load_file() does whichever the file is.
+    void save_object(const std::string & filename);
+    void load_object(const std::string & filename);
+    void load_elf(const std::string & filename);
+    void load_file(const std::string & filename);
+
+    // Keep what each line assembled to in cache, so assembling a newer
+    // version of the same file in another simulator only redoes the
+    // lines that changed.
+    void set_line_cache(const std::shared_ptr< LineCache > & cache)
+    { line_cache = cache; }
+
+    // The same for assemble_files(), by whole file.
+    void set_unit_cache(const std::shared_ptr< UnitCache > & cache)
+    { unit_cache = cache; }
+
+    // Threads to assemble files with, 0 picks one per core for large
+    // files. The result is the same either way. Assembling with a line
+    // cache always uses one.
+    void set_assembly_threads(const unsigned int threads)
+    { assembly_threads = threads; }
+
+    // Only size the text segment when assembling, each line is encoded
+    // the first time it is executed. Errors in a line are then only
+    // reported if it runs. Sharing or saving the program encodes the
+    // rest of it first.
+    void set_lazy_assembly(const bool lazy)
+    { lazy_assembly = lazy; }
+
+    // Run the loaded program from its entrypoint until it exits.
+    void run_program();
+
+    // Or in slices: start it, then run it for at most the given number
+    // of instructions at a time, until it exits.
+    void start_program();
+    RunResult run_for(const uint64_t instructions);
+
+    // Run as a session (see SessionServer.h): input is fed in as it
+    // arrives, a program that reads before it has any waits, and what
+    // it prints is kept for captured_output().
+    void set_session()
+    {
+        guest_input.open_feed();
+        guest_output.capture();
+    }
+    void feed_input(const char * p, const size_t n)
+    { guest_input.feed(p, n); }
+    void end_input()
+    { guest_input.end_feed(); }
+
+    // What the program printed since the last call.
+    std::string captured_output()
+    { return guest_output.take_captured(); }
+
+    // Put the simulator back the way a new one is, with program
+    // loaded, without mapping its segments again. Pages the last
+    // program touched are given back to the host.
+    void reset(const std::shared_ptr< const ProgramImage > & program);
+
+    // Read what the program reads from a file instead of std::cin, and
+    // print what it prints to one instead of stdout.
+    void set_input(const std::string & filename)
+    { guest_input.open(filename); }
+    void set_output(const std::string & filename)
+    { guest_output.open(filename); }
+
+    // Log what the program reads to a file, or read it back from one
+    // instead of the input (see SyscallLog.h). Either way the whole
+    // text is encoded before the program starts, lazily assembled or
+    // not.
+    void set_record(const std::string & filename)
+    { syscall_log.record(filename); }
+    void set_replay(const std::string & filename)
+    { syscall_log.replay(filename); }
+
+    // Status the program exited with, 0 for syscall 10 and $a0 for
+    // syscall 17.
+    int exit_code() const
+    { return exit_status; }
+
+    // Make syscall 30 return the time as if every instruction took a
+    // nanosecond, counted from 0 when the program starts, so timing
+    // measured inside the program is the same on every host and run.
+    void set_virtual_time(const bool on)
+    { virtual_time = on; }
+
+    // For ResultCache: a hash of everything loaded that decides how the
+    // program runs, whether the run so far could be cached, and its
+    // end state out of or back into a RunRecord (restoring it leaves
+    // the program exited, as if it had run).
+    uint64_t image_hash();
+    bool deterministic() const
+    { return deterministic_run; }
+    void save_result(RunRecord & record) const;
+    void restore_result(const RunRecord & record);
+
+    // Report whenever the given guest address range changes, stopping
+    // a program run outside the interpreter. The fault handler behind
+    // them is process wide, so while one simulator has watchpoints any
+    // other adding one gets a SimulatorError.
+    void add_watchpoint(const uint32_t addr, const unsigned int bytes);
+    void remove_watchpoint(const uint32_t addr);
+
+    // A label or hexadecimal address.
+    uint32_t parse_address(const std::string & s) const;
+
 private:
     ///////////////////////////////
     //////////  OBJECTS  //////////
@@ -197,35 +507,78 @@ private:
 
     bool sim_mode;
     bool running;
+    int exit_status;
+
+    // Instructions executed since the program started, and what they
+    // would have taken on a simple in-order pipeline (see
+    // CYCLE_COSTS). Syscall 30 derives time from the first in virtual
+    // time.
+    uint64_t instructions_retired;
+    uint64_t cycles;
+    bool virtual_time;
+
+    // Nothing but the program and its input has decided how the run
+    // went so far (see ResultCache.h).
+    bool deterministic_run;
+
+    // A syscall found no input fed yet, see await_input().
+    bool waiting_for_input;
     RegisterFile regs;
     MipsSegment current_segment;
     bool sim_currently_pseudo;
 
     const uint32_t TEXT_START = 0x00040000;
-    uint32_t text[TEXT_SEGMENT_SIZE];
     
     // First address is 0x10010000.
     const uint32_t DATA_START = 0x10010000;
-    uint8_t data[DATA_SEGMENT_SIZE];
+    uint8_t * data;
 
     // First address is at 0x10040000 (goes up)
     const uint32_t HEAP_START = 0x10040000;
-    uint32_t heap_ptr = HEAP_START;
-    uint8_t heap[MAX_HEAP];
+    HeapAllocator heap_allocator{HEAP_START, HEAP_START + MAX_HEAP};
+    uint8_t * heap;
 
     // First address is at 0x7ffffe00 (goes down)
     const uint32_t STACK_END = 0x7ffffe00;
     const uint32_t STACK_START = STACK_END - MAX_STACK;
-    uint8_t stack[MAX_STACK];
+    uint8_t * stack;
+
+    // Files mapped by syscall 90 are placed at 0x20000000 and up,
+    // each starting on its own page.
+    const uint32_t MMAP_START = 0x20000000;
+    uint32_t mmap_ptr = MMAP_START;
+    std::vector< MappedRegion > mapped_regions;
+
+    // Host descriptors of files opened by syscall 13, for guest
+    // descriptors 3 and up (0 to 2 are stdin, stdout and stderr). -1
+    // once closed.
+    std::vector< int > open_files;
 
     // Addresses to be used during computation.
     uint32_t text_seg_addr;
     uint32_t data_seg_addr;
     uint32_t program_counter;
     std::string entrypoint_label;
-    uint32_t entrypoint_addr;
 
-    std::unordered_map< std::string, uint32_t > labels;
+    // The program being built while assembling, null once it has been
+    // handed over to image for good.
+    std::shared_ptr< ProgramImage > assembling;
+
+    // Files being assembled by their first word of text, for the
+    // image's source map.
+    std::vector< std::pair< uint32_t, std::string > > source_files;
+
+    // The program being run (text, labels, source lines, initial data).
+    std::shared_ptr< const ProgramImage > image;
+
+    // The image's text segment and predecoded instructions, cached
+    // for instruction fetch.
+    const uint32_t * text;
+    const uint8_t * decoded;
+    uint32_t text_size;
+
+    // Active watchpoints.
+    std::vector< Watchpoint > watchpoints;
     
     // This vector of instructions and encodings
     // is stored in the order they are addressed in,
@@ -233,10 +586,45 @@ private:
     // Every instruction is of size 0x00000004.
     std::vector< InputAddressPair > input_addr;
 
-    // A vector or instructions to be encoded as well as data
-    // to be put into the data segment after finding the
-    // values of the input labels. Used by read file mode.
-    std::vector< StrsAddressSegmentLine > to_be_encoded;
+    // Labels of the file being assembled and the places that refer
+    // to them, patched once the whole file has been read. Used by
+    // read file mode.
+    SymbolTable symbols;
+    AssemblyOutput assembly_output;
+    std::shared_ptr< LineCache > line_cache;
+    unsigned int assembly_threads;
+
+    // Assembling one file of several: .globl adds to globls instead of
+    // setting the entrypoint.
+    bool assembling_unit;
+    std::vector< std::string_view > globls;
+    uint32_t data_alignment; // Largest .align, in bytes.
+    std::shared_ptr< UnitCache > unit_cache;
+
+    // Lazy assembly: the source, which lines still point into, and the
+    // text lines in address order. The symbol table is kept until
+    // every line has been encoded.
+    bool lazy_assembly;
+    std::unique_ptr< MappedFile > source_file;
+    std::shared_ptr< ProgramImage > lazy_image;
+
+    // Directory of the file being assembled, which relative .incbin
+    // paths start from. Empty for the working directory. Data lines
+    // can be emitted on several threads, incbin_mutex guards the
+    // image's incbin_files.
+    std::string source_dir;
+    std::mutex incbin_mutex;
+    std::vector< LazyLine > lazy_lines;
+
+    // control_flow() and the image it was built from.
+    std::unique_ptr< ControlFlowGraph > control_flow_graph;
+    std::shared_ptr< const ProgramImage > control_flow_image;
+
+    // What the program prints, flushed before it reads input, when it
+    // exits and before the simulator prints anything itself.
+    GuestOutput guest_output;
+    GuestInput guest_input;
+    SyscallLog syscall_log;
 
     // valid inputs to save to file in interpreter mode.
     std::vector< std::string > valid_sim_inputs;
@@ -259,17 +647,50 @@ private:
     void print_registers() const;
     void print_labels() const;
     void print_data_segment() const;
+    void print_heap_stats() const;
 
     // Read mode functions.
     void run_read_mode();
-    void run_file(std::ifstream & file);
-    void prepare_read_input(std::string input, unsigned int line);
+    void assemble(const std::string_view source);
+    uint32_t assemble_lines(const std::string_view source);
+    uint32_t assemble_cached(const std::string_view source, std::unique_ptr< CachedFile > & file);
+    bool assemble_changes(const std::string_view source, const CachedFile & previous,
+                          CachedFile & file, uint32_t & data_end);
+    CachedState line_state() const;
+    void restore_state(const CachedState & state);
+    bool assemble_two_pass(const std::string_view source, const unsigned int threads,
+                           uint32_t & data_end);
+    void size_chunk(SourceChunk & chunk, const bool lazy) const;
+    void emit_chunk(const SourceChunk & chunk);
+    void restart_assembly(const uint32_t text_start, const uint32_t data_start);
+    void finish_assembly(const uint32_t data_end);
+    std::shared_ptr< const LinkUnit > assemble_unit(const std::string & filename,
+                                                    const std::string_view source);
+    void link(const std::vector< std::shared_ptr< const LinkUnit > > & units);
+    void encode_lazy_line(const uint32_t i);
+    void encode_lazy_text();
+    void finish_image(const uint32_t data_end);
+    void load_image(const std::shared_ptr< const ProgramImage > & program);
+    void assemble_cached_line(const std::string_view line_text, SourceLine & source,
+                              const unsigned int line, CachedFile & file);
+    void lex_line(const std::string_view line_text, const unsigned int line,
+                  SourceLine & source) const;
+    uint32_t place_line(const SourceLine & source);
+    void emit_line(const SourceLine & source, const uint32_t addr, AssemblyOutput & out);
     void read_handle_pseudo(const Instruction & ins,
-                            const std::vector< std::string > & s,
-                            const uint32_t & addr,
+                            const std::vector< Token > & tokens,
+                            const uint32_t addr,
                             const unsigned int line,
-                            std::unordered_map< uint32_t, unsigned int > & line_numbers);
-    void read_format_ascii_escape_sequences(std::string & s) const;
+                            AssemblyOutput & out);
+    void emit_instruction(std::vector< Token > tokens,
+                          const uint32_t addr,
+                          const unsigned int line,
+                          AssemblyOutput & out);
+    uint32_t reference_label(const std::string_view name, const AssemblyOutput & out);
+    void apply_relocations();
+    void apply_relocation(const Relocation & relocation);
+    void relocate(const uint32_t addr, const uint32_t target, const RelocationType type);
+    void patch_text(const uint32_t addr, const uint32_t mask, const uint32_t value);
     
     // Shared functions.
     inline
@@ -288,42 +709,87 @@ private:
 
     std::string truncate_comments(std::string s) const;
     std::string strip_useless_whitespace(std::string s) const;
-    std::string get_numerical_register_str(std::string s) const;
-    std::string replace_registers(std::string s) const;
-
-    // "4($31)" --> { "$31", "4" }.
-    std::vector< std::string > split_immediate_and_register(const std::string & s) const;
-    std::vector< std::string > split_input(const std::string & s) const;
 
-    // "0x42" --> "66"
-    // "0b1001" --> "9"
-    // "'\n'" --> "10"
-    void format_immediates(std::vector< std::string > & strs) const;
+    // Address of a label, throws if it is undefined.
+    uint32_t label_address(const std::string & label) const;
     
     // Replace labels with their numerical values for computation.
-    void replace_labels(std::vector< std::string > & strs) const;
+    void replace_labels(std::vector< Token > & tokens) const;
 
     // Adding values to data segment.
-    void add_to_data_segment(const std::vector< std::string > & strs);
+    // While assembling a file out collects label references, in
+    // interpreter mode it is null.
+    int32_t data_value(const Token & token, const RelocationType type, const uint32_t addr,
+                       const unsigned int line, AssemblyOutput * out);
+    std::string incbin_path(const Token & token) const;
+    uint32_t emit_data(const std::vector< Token > & tokens, uint32_t addr,
+                       const unsigned int line, AssemblyOutput * out);
+    uint32_t emit_values(const std::vector< Token > & tokens, const unsigned int size,
+                         const RelocationType type, uint32_t addr,
+                         const unsigned int line, AssemblyOutput * out);
+    void add_to_data_segment(const std::vector< Token > & tokens);
 
     // Pseudoinstruction handling
-    Instruction is_pseudo(const std::string & s, const std::string & label) const;
-    void handle_pseudo(const Instruction & s, const std::vector< std::string > & strs);
+    Instruction is_pseudo(const Token & ins, const Token & label) const;
+    void handle_pseudo(const Instruction & s, const std::vector< Token > & tokens);
     
     // Encoding
-    Instruction get_instruction(const std::string & s) const;
+    Instruction get_instruction(const std::string_view s) const;
+    Directive get_directive(const std::string_view s) const;
     uint8_t get_opcode(const Instruction & instruction) const;
-    uint32_t encode(const std::vector< std::string > & args) const;
+    uint32_t encode(const std::vector< Token > & args, const uint32_t addr) const;
 
     // Decoding and Execution
     Instruction get_instruction(const uint8_t target, const bool is_funct) const;
+    Instruction decode(const uint32_t & encoded) const;
+    void set_text(const uint32_t addr, const uint32_t encoded, const unsigned int line = 0);
+    void store_text(const uint32_t addr, const uint32_t encoded, const unsigned int line);
+    void step();
     void execute(const uint32_t & encoded);
+    void dispatch(const Instruction ins, const uint32_t & encoded);
+
+    // Segment memory management. Segments are anonymous memory unless
+    // a file descriptor to map copy-on-write is given.
+    static uint8_t * map_segment(const unsigned int size, const int fd = -1, const off_t offset = 0);
+    static void unmap_segment(uint8_t * segment, const unsigned int size);
+
+    // Watchpoint handling.
+    void protect_watched_pages();
+    void check_watchpoints(const uint32_t pc);
 
     // Function for determining the locations of store and load instructions.
     // Also will give the starting address of that segment for computation.
+    // Stores are rejected for read-only mapped files, and accesses of
+    // the given number of bytes that run off the end of a segment.
     void get_location_and_start(const uint32_t & addr,
                                 uint8_t * & location,
-                                unsigned int & start);
+                                unsigned int & start,
+                                const bool store = false,
+                                const unsigned int bytes = 1);
+    uint32_t segment_end(const uint32_t addr) const;
+
+    // A line of input for a syscall, through the syscall log if there
+    // is one. False if the input has run out.
+    bool await_input();
+    bool read_input(const uint32_t syscall, std::string & line);
+    uint64_t system_time();
+
+    // Syscall 5's input as an integer, throws unless it is one.
+    static int32_t parse_input_int(const std::string & input);
+
+    // Null terminated string in guest memory.
+    std::string read_guest_string(const uint32_t addr);
+
+    // File mapping syscalls.
+    void map_file(const std::string & filename, const bool writable);
+    void unmap_file(const uint32_t addr);
+
+    // File syscalls, results are left in $v0.
+    void open_guest_file(const std::string & filename, const uint32_t flags);
+    void read_guest_file(const uint32_t fd, const uint32_t addr, const uint32_t count);
+    void write_guest_file(const uint32_t fd, const uint32_t addr, const uint32_t count);
+    void close_guest_file(const uint32_t fd);
+    int host_file(const uint32_t fd) const;
     
     // Individual instruction executions
     void ins_add(const uint32_t & encoded);
@@ -0,0 +1,207 @@
+//   File: SourceMap.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "SourceMap.h"
+
+#include <algorithm>
+#include <cstring>
+
+void RunIndex::build(const std::vector< Run > & runs, const uint32_t count)
+{
+    // A leading run without a value means every word is in one.
+    runs_.assign(1, Run{ 0, NONE });
+    for (const Run & run : runs)
+    {
+        if (run.start >= count)
+            break;
+        if (run.start == runs_.back().start)
+            runs_.back() = run;
+        else
+            runs_.push_back(run);
+    }
+
+    count_ = count;
+    blocks_.assign((count + SOURCE_MAP_BLOCK - 1) / SOURCE_MAP_BLOCK, 0);
+    uint32_t r = 0;
+    for (uint32_t b = 0; b < blocks_.size(); ++b)
+    {
+        while (r + 1 < runs_.size() && runs_[r + 1].start <= b * SOURCE_MAP_BLOCK)
+            ++r;
+        blocks_[b] = r;
+    }
+
+    return;
+}
+
+void SourceMap::set_lines(const uint32_t * lines, const uint32_t count)
+{
+    deltas_.assign(count, 0);
+    bases_.assign((count + SOURCE_MAP_BLOCK - 1) / SOURCE_MAP_BLOCK, 0);
+    far_lines_.clear();
+
+    for (uint32_t b = 0; b < bases_.size(); ++b)
+    {
+        uint32_t start = b * SOURCE_MAP_BLOCK;
+        uint32_t end = std::min(start + SOURCE_MAP_BLOCK, count);
+
+        uint32_t base = 0;
+        for (uint32_t i = start; i < end; ++i)
+            if (lines[i] != 0 && (base == 0 || lines[i] < base))
+                base = lines[i];
+        bases_[b] = base;
+
+        for (uint32_t i = start; i < end; ++i)
+        {
+            if (lines[i] == 0)
+                continue;
+            if (lines[i] - base + 1 < FAR_LINE)
+                deltas_[i] = lines[i] - base + 1;
+            else
+            {
+                deltas_[i] = FAR_LINE;
+                far_lines_.push_back(std::make_pair(i, lines[i]));
+            }
+        }
+    }
+
+    return;
+}
+
+void SourceMap::set_labels(const std::unordered_map< std::string, uint32_t > & labels,
+                           const uint32_t text_start)
+{
+    // Of several labels on one word the first by name is used, so the
+    // map does not depend on the order of the table.
+    std::vector< std::pair< uint32_t, std::string > > text_labels;
+    uint64_t text_end = text_start + uint64_t(deltas_.size()) * 4;
+    for (const std::pair< const std::string, uint32_t > & label : labels)
+        if (label.second >= text_start && label.second < text_end)
+            text_labels.push_back(std::make_pair((label.second - text_start) >> 2, label.first));
+    std::sort(text_labels.begin(), text_labels.end(),
+              [](const std::pair< uint32_t, std::string > & a, const std::pair< uint32_t, std::string > & b)
+              { return a.first != b.first ? a.first < b.first : a.second > b.second; });
+
+    std::vector< RunIndex::Run > runs;
+    label_names_.clear();
+    for (const std::pair< uint32_t, std::string > & label : text_labels)
+    {
+        runs.push_back(RunIndex::Run{ label.first, uint32_t(label_names_.size()) });
+        label_names_.push_back(label.second);
+    }
+    labels_.build(runs, deltas_.size());
+
+    return;
+}
+
+void SourceMap::set_files(const std::vector< std::pair< uint32_t, std::string > > & files)
+{
+    std::vector< RunIndex::Run > runs;
+    file_names_.clear();
+    for (const std::pair< uint32_t, std::string > & file : files)
+    {
+        runs.push_back(RunIndex::Run{ file.first, uint32_t(file_names_.size()) });
+        file_names_.push_back(file.second);
+    }
+    files_.build(runs, deltas_.size());
+
+    return;
+}
+
+unsigned int SourceMap::far_line(const uint32_t i) const
+{
+    std::vector< std::pair< uint32_t, uint32_t > >::const_iterator it
+        = std::lower_bound(far_lines_.begin(), far_lines_.end(), std::make_pair(i, uint32_t(0)));
+
+    return it != far_lines_.end() && it->first == i ? it->second : 0;
+}
+
+static void pad(std::ostream & os, const uint64_t n)
+{
+    static const char zeros[4] = { 0, 0, 0, 0 };
+    os.write(zeros, (4 - n % 4) % 4);
+
+    return;
+}
+
+/*
+  Layout, all uint32_t in host byte order, each part padded to 4 bytes:
+    word count, far line count, file count, 0
+    deltas      word count x uint8_t
+    bases       one per block
+    far lines   far line count x { word, line }
+    files       file count x { first word, name length, name }
+*/
+void SourceMap::write(std::ostream & os) const
+{
+    std::vector< RunIndex::Run > files;
+    for (const RunIndex::Run & run : files_.runs())
+        if (run.value != RunIndex::NONE)
+            files.push_back(run);
+
+    uint32_t header[4] = { uint32_t(deltas_.size()), uint32_t(far_lines_.size()),
+                           uint32_t(files.size()), 0 };
+    os.write((const char *)(header), sizeof(header));
+    os.write((const char *)(deltas_.data()), deltas_.size());
+    pad(os, deltas_.size());
+    os.write((const char *)(bases_.data()), bases_.size() * 4);
+    for (const std::pair< uint32_t, uint32_t > & far : far_lines_)
+    {
+        uint32_t entry[2] = { far.first, far.second };
+        os.write((const char *)(entry), sizeof(entry));
+    }
+
+    for (const RunIndex::Run & run : files)
+    {
+        const std::string & name = file_names_[run.value];
+        uint32_t entry[2] = { run.start, uint32_t(name.size()) };
+        os.write((const char *)(entry), sizeof(entry));
+        os.write(name.data(), name.size());
+        pad(os, name.size());
+    }
+
+    return;
+}
+
+uint64_t SourceMap::read(const uint8_t * p, const uint64_t size)
+{
+    uint32_t header[4];
+    if (size < sizeof(header))
+        return 0;
+    std::memcpy(header, p, sizeof(header));
+
+    uint64_t blocks = (uint64_t(header[0]) + SOURCE_MAP_BLOCK - 1) / SOURCE_MAP_BLOCK;
+    uint64_t bases_offset = sizeof(header) + (uint64_t(header[0]) + 3) / 4 * 4;
+    uint64_t far_offset = bases_offset + blocks * 4;
+    uint64_t offset = far_offset + uint64_t(header[1]) * 8;
+    if (offset > size)
+        return 0;
+
+    deltas_.assign(p + sizeof(header), p + sizeof(header) + header[0]);
+    bases_.resize(blocks);
+    std::memcpy(bases_.data(), p + bases_offset, blocks * 4);
+    far_lines_.resize(header[1]);
+    for (uint32_t i = 0; i < header[1]; ++i)
+    {
+        uint32_t entry[2];
+        std::memcpy(entry, p + far_offset + i * 8, sizeof(entry));
+        far_lines_[i] = std::make_pair(entry[0], entry[1]);
+    }
+
+    std::vector< std::pair< uint32_t, std::string > > files;
+    for (uint32_t i = 0; i < header[2]; ++i)
+    {
+        uint32_t entry[2];
+        if (offset + sizeof(entry) > size)
+            return 0;
+        std::memcpy(entry, p + offset, sizeof(entry));
+        offset += sizeof(entry);
+        if (offset + entry[1] > size)
+            return 0;
+        files.push_back(std::make_pair(entry[0], std::string((const char *)(p + offset), entry[1])));
+        offset += (uint64_t(entry[1]) + 3) / 4 * 4;
+    }
+    set_files(files);
+
+    return std::min(offset, size);
+}
@@ -0,0 +1,133 @@
+//   File: SourceMap.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef SOURCE_MAP_H
+#define SOURCE_MAP_H
+
+#include "Common.h"
+
+/*
+  Where each word of text came from: its source line, the label it is
+  under and the file it was assembled from, looked up by word index
+  ((pc - TEXT_START) >> 2) in constant time so error messages,
+  profilers and coverage reports can all afford it.
+
+  Words are grouped in blocks of SOURCE_MAP_BLOCK. A line is stored as
+  one byte per word, relative to the lowest line in its block, with the
+  rare line too far from it kept separately. Labels and files change
+  rarely along the text, so they are stored as runs, with the run each
+  block starts in so a lookup only scans the runs inside one block.
+*/
+
+const unsigned int SOURCE_MAP_BLOCK_BITS = 6;
+const unsigned int SOURCE_MAP_BLOCK = 1 << SOURCE_MAP_BLOCK_BITS;
+
+// Values that stay the same over runs of words.
+class RunIndex
+{
+public:
+    static const uint32_t NONE = 0xffffffff;
+
+    struct Run
+    {
+        uint32_t start; // First word of the run.
+        uint32_t value;
+    };
+
+    RunIndex() :
+        count_(0)
+    {}
+
+    // Runs in order of their start, covering count words. Words before
+    // the first run have no value.
+    void build(const std::vector< Run > & runs, const uint32_t count);
+
+    uint32_t find(const uint32_t i) const
+    {
+        if (i >= count_)
+            return NONE;
+
+        uint32_t r = blocks_[i >> SOURCE_MAP_BLOCK_BITS];
+        while (r + 1 < runs_.size() && runs_[r + 1].start <= i)
+            ++r;
+
+        return runs_[r].value;
+    }
+
+    const std::vector< Run > & runs() const
+    { return runs_; }
+
+private:
+    std::vector< Run > runs_;
+    std::vector< uint32_t > blocks_;
+    uint32_t count_;
+};
+
+class SourceMap
+{
+public:
+    // One line per word of text, 0 where there is none.
+    void set_lines(const uint32_t * lines, const uint32_t count);
+
+    // Every word is under the closest label at or before it.
+    void set_labels(const std::unordered_map< std::string, uint32_t > & labels,
+                    const uint32_t text_start);
+
+    // The files words were assembled from, by the first word of each.
+    void set_files(const std::vector< std::pair< uint32_t, std::string > > & files);
+
+    // Line of the i'th word, 0 if it is not known.
+    unsigned int line(const uint32_t i) const
+    {
+        if (i >= deltas_.size())
+            return 0;
+
+        uint8_t delta = deltas_[i];
+        if (delta == 0)
+            return 0;
+        if (delta == FAR_LINE)
+            return far_line(i);
+
+        return bases_[i >> SOURCE_MAP_BLOCK_BITS] + delta - 1;
+    }
+
+    // Label and file of the i'th word, empty if there is none.
+    const std::string & label(const uint32_t i) const
+    { return name(label_names_, labels_.find(i)); }
+    const std::string & file(const uint32_t i) const
+    { return name(file_names_, files_.find(i)); }
+
+    uint32_t size() const
+    { return deltas_.size(); }
+    uint32_t file_count() const
+    { return file_names_.size(); }
+
+    // Lines and files as stored in object files (labels are stored
+    // there anyway), and reading them back. read() returns the bytes
+    // used, or 0 if they are not a valid map.
+    void write(std::ostream & os) const;
+    uint64_t read(const uint8_t * p, const uint64_t size);
+
+private:
+    static const uint8_t FAR_LINE = 0xff;
+
+    std::vector< uint8_t > deltas_;
+    std::vector< uint32_t > bases_;
+    std::vector< std::pair< uint32_t, uint32_t > > far_lines_; // By word.
+
+    RunIndex labels_;
+    std::vector< std::string > label_names_;
+    RunIndex files_;
+    std::vector< std::string > file_names_;
+
+    unsigned int far_line(const uint32_t i) const;
+
+    static const std::string & name(const std::vector< std::string > & names, const uint32_t i)
+    {
+        static const std::string none;
+        return i == RunIndex::NONE ? none : names[i];
+    }
+};
+
+#endif
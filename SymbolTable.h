@@ -0,0 +1,115 @@
+//   File: SymbolTable.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+
+#include "Common.h"
+
+#include <string_view>
+
+/*
+  Labels seen while assembling a file. Each name is interned into an
+  integer id the first time it shows up, whether that is its definition
+  or a reference to it, and instructions refer to labels through
+  relocations on that id. Names point into the source text, so the
+  table is only valid while the source is.
+*/
+
+struct Symbol
+{
+    std::string_view name;
+    uint32_t address;
+    bool defined;
+};
+
+// How a label's address gets patched into the word at a relocation.
+enum RelocationType
+{
+    RELOC_BRANCH, // Text, low 16 bits: distance from the branch / 4.
+    RELOC_JUMP,   // Text, low 26 bits: address / 4.
+    RELOC_HI,     // Text, low 16 bits: upper half of the address.
+    RELOC_LO,     // Text, low 16 bits: lower half of the address.
+    RELOC_WORD,   // Data, the whole address.
+    RELOC_HALF,   // Data, truncated to 16 bits.
+    RELOC_BYTE    // Data, truncated to 8 bits.
+};
+
+struct Relocation
+{
+    uint32_t address;
+    uint32_t symbol;
+    RelocationType type;
+    unsigned int line;
+};
+
+// find() of a name that has not been interned.
+const uint32_t NO_SYMBOL = 0xffffffff;
+
+class SymbolTable
+{
+public:
+    // Id of name, adding it as undefined if it is new.
+    uint32_t intern(const std::string_view name)
+    {
+        std::pair< std::unordered_map< std::string_view, uint32_t >::iterator, bool > it =
+            ids_.insert({name, uint32_t(symbols_.size())});
+        if (it.second)
+            symbols_.push_back({name, 0, false});
+
+        return it.first->second;
+    }
+
+    // Id of name without adding it, so the table can be read from
+    // several threads at once.
+    uint32_t find(const std::string_view name) const
+    {
+        std::unordered_map< std::string_view, uint32_t >::const_iterator it = ids_.find(name);
+
+        return (it == ids_.end() ? NO_SYMBOL : it->second);
+    }
+
+    // Returns the label's id.
+    uint32_t define(const std::string_view name, const uint32_t address)
+    {
+        uint32_t id = intern(name);
+        Symbol & symbol = symbols_[id];
+        if (symbol.defined)
+            throw SimulatorError("Duplicate label.");
+
+        symbol.address = address;
+        symbol.defined = true;
+
+        return id;
+    }
+
+    const Symbol & operator[](const uint32_t id) const
+    { return symbols_[id]; }
+
+    const std::vector< Symbol > & symbols() const
+    { return symbols_; }
+
+    // Make room for n names.
+    void reserve(const size_t n)
+    {
+        ids_.reserve(n);
+        symbols_.reserve(n);
+
+        return;
+    }
+
+    void clear()
+    {
+        ids_.clear();
+        symbols_.clear();
+
+        return;
+    }
+
+private:
+    std::unordered_map< std::string_view, uint32_t > ids_;
+    std::vector< Symbol > symbols_;
+};
+
+#endif
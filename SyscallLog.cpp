@@ -0,0 +1,132 @@
+//   File: SyscallLog.cpp
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#include "SyscallLog.h"
+
+#include <cstring>
+#include <endian.h>
+
+static const uint64_t HEADER_SIZE = 16;
+
+void SyscallLog::record(const std::string & filename)
+{
+    out_.open(filename, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+    if (out_.fail())
+        throw SimulatorError("Unable to write syscall log \"" + filename + "\".");
+    mode_ = RECORD;
+    filename_ = filename;
+
+    return;
+}
+
+void SyscallLog::replay(const std::string & filename)
+{
+    in_.reset(new MappedFile(filename));
+    if (in_->size() < HEADER_SIZE || std::memcmp(in_->data(), SYSCALL_LOG_MAGIC, 4) != 0)
+        throw SimulatorError("\"" + filename + "\" is not a syscall log.");
+
+    uint32_t version;
+    std::memcpy(&version, in_->data() + 4, 4);
+    if (le32toh(version) != SYSCALL_LOG_VERSION)
+        throw SimulatorError("Syscall log \"" + filename + "\" is from another version of the simulator.");
+    std::memcpy(&program_hash_, in_->data() + 8, 8);
+    program_hash_ = le64toh(program_hash_);
+
+    mode_ = REPLAY;
+    filename_ = filename;
+
+    return;
+}
+
+void SyscallLog::start(const uint64_t program_hash)
+{
+    if (mode_ == RECORD)
+    {
+        uint32_t version = htole32(SYSCALL_LOG_VERSION);
+        uint64_t hash = htole64(program_hash);
+        out_.write(SYSCALL_LOG_MAGIC, 4);
+        out_.write((const char *)(&version), 4);
+        out_.write((const char *)(&hash), 8);
+    }
+    else if (mode_ == REPLAY)
+    {
+        if (program_hash != program_hash_)
+            throw SimulatorError("Syscall log \"" + filename_ + "\" was recorded from a different program.");
+        next_ = HEADER_SIZE;
+    }
+
+    return;
+}
+
+void SyscallLog::write(const uint32_t syscall, const std::string & input, const bool ended)
+{
+    put_varint(syscall);
+    put_varint(ended ? 0 : input.size() + 1);
+    out_.write(input.data(), (ended ? 0 : input.size()));
+
+    return;
+}
+
+bool SyscallLog::read(const uint32_t syscall, std::string & input)
+{
+    if (next_ >= in_->size())
+        throw SimulatorError("Syscall log ran out before syscall " + std::to_string(syscall) + ".");
+
+    uint64_t logged = get_varint();
+    if (logged != syscall)
+        throw SimulatorError("Syscall log has input for syscall " + std::to_string(logged)
+                             + " where the program uses syscall " + std::to_string(syscall) + ".");
+
+    uint64_t length = get_varint();
+    if (length == 0)
+    {
+        input.clear();
+        return false;
+    }
+    if (length - 1 > in_->size() - next_)
+        throw SimulatorError("Syscall log \"" + filename_ + "\" is cut short.");
+
+    input.assign((const char *)(in_->data() + next_), length - 1);
+    next_ += length - 1;
+
+    return true;
+}
+
+uint64_t SyscallLog::hash_text(const uint32_t * text, const uint32_t size)
+{
+    uint64_t h = 14695981039346656037ull;
+    const uint8_t * p = (const uint8_t *)(text);
+    for (uint64_t i = 0; i < uint64_t(size) * 4; ++i)
+        h = (h ^ p[i]) * 1099511628211ull;
+
+    return h;
+}
+
+void SyscallLog::put_varint(uint64_t n)
+{
+    while (n >= 0x80)
+    {
+        out_.put(char(0x80 | (n & 0x7f)));
+        n >>= 7;
+    }
+    out_.put(char(n));
+
+    return;
+}
+
+uint64_t SyscallLog::get_varint()
+{
+    uint64_t n = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7)
+    {
+        if (next_ >= in_->size())
+            break;
+        uint8_t byte = in_->data()[next_++];
+        n |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+            return n;
+    }
+
+    throw SimulatorError("Syscall log \"" + filename_ + "\" is cut short.");
+}
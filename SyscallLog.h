@@ -0,0 +1,80 @@
+//   File: SyscallLog.h
+// Author: Grant Clark
+//   Date: 10/19/2026
+
+#ifndef SYSCALL_LOG_H
+#define SYSCALL_LOG_H
+
+#include "Common.h"
+#include "MappedFile.h"
+
+/*
+  Everything a run read from outside the simulator, in the order the
+  syscalls read it, so the run can be replayed exactly without a
+  terminal: recording writes each syscall's input to the log, replaying
+  hands the logged input to the same syscalls instead of reading any.
+
+  File layout:
+    magic "MSRL", version (uint32_t), hash of the program (its text,
+    initial data and entrypoint, as Simulator::image_hash() gives it)
+    (uint64_t), all little-endian, then one entry per syscall:
+      syscall number  varint
+      length + 1      varint, 0 if the input had run out
+      length bytes
+  where a varint is 7 bits per byte, lowest first, the top bit set on
+  every byte but the last.
+*/
+
+const char SYSCALL_LOG_MAGIC[4] = { 'M', 'S', 'R', 'L' };
+const uint32_t SYSCALL_LOG_VERSION = 2;
+
+class SyscallLog
+{
+public:
+    enum Mode { OFF, RECORD, REPLAY };
+
+    SyscallLog() :
+        mode_(OFF),
+        program_hash_(0),
+        next_(0)
+    {}
+
+    SyscallLog(const SyscallLog &) = delete;
+    SyscallLog & operator=(const SyscallLog &) = delete;
+
+    // Record into or replay from filename, the program being run has
+    // to wait for start().
+    void record(const std::string & filename);
+    void replay(const std::string & filename);
+
+    Mode mode() const
+    { return mode_; }
+
+    // The program is about to run. A replay has to be of the program
+    // it was recorded from.
+    void start(const uint64_t program_hash);
+
+    // Log a syscall's input, false for ended if there was none left.
+    void write(const uint32_t syscall, const std::string & input, const bool ended = false);
+
+    // The next logged input, which has to be for this syscall. Returns
+    // false if the input had run out.
+    bool read(const uint32_t syscall, std::string & input);
+
+    // FNV-1a over the words of a program's text.
+    static uint64_t hash_text(const uint32_t * text, const uint32_t size);
+
+private:
+    Mode mode_;
+    std::string filename_;
+    uint64_t program_hash_;
+
+    std::ofstream out_;
+    std::unique_ptr< MappedFile > in_;
+    uint64_t next_; // Offset of the next entry in in_.
+
+    void put_varint(uint64_t n);
+    uint64_t get_varint();
+};
+
+#endif
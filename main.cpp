@@ -3,12 +3,400 @@
 //   Date: 12/17/2023
 
 #include "Simulator.h"
+#include "ObjectFile.h"
+#include "ElfFile.h"
+#include "SessionServer.h"
+#include "Daemon.h"
 
-int main()
+#include <cstring>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static int usage()
+{
+    std::cerr << "usage: mips_sim\n"
+              << "       mips_sim run [--source | --object | --elf] [--watch | --lazy] <file>\n"
+              << "       mips_sim run [--watch] <file.s> <file.s>...\n"
+              << "           [--input <file>] [--output <file>]\n"
+              << "           [--record <file.log> | --replay <file.log>] [--virtual-time]\n"
+              << "           [--result-cache <dir>] [--watch-address <address>[:<bytes>]]...\n"
+              << "       mips_sim assemble <file.s>... -o <file.o>\n"
+              << "       mips_sim cfg <file>... [-o <file.dot>]\n"
+              << "       mips_sim serve <socket> [--threads <n>] <file>...\n"
+              << "       mips_sim daemon <socket> [--threads <n>] [--result-cache <dir>]\n"
+              << "       mips_sim submit <socket> <file>... [--input <file>]\n"
+              << "       mips_sim submit <socket> --stats\n"
+              << "\n"
+              << "With no arguments the interactive menu is started. run\n"
+              << "assembles source or loads an object file or ELF\n"
+              << "executable, whichever the file is unless --source,\n"
+              << "--object or --elf says otherwise.\n"
+              << "--watch runs the program again every time the file\n"
+              << "changes. Only the lines from the first change to the\n"
+              << "last are assembled again, the ones around them are\n"
+              << "moved into place with the references that moved patched.\n"
+              << "--lazy encodes each line of source the first time\n"
+              << "it runs, it cannot be combined with --watch.\n"
+              << "Several source files are assembled separately and\n"
+              << "linked, starting at the first .globl of the first.\n"
+              << "--input and --output replace stdin and stdout for the\n"
+              << "program's syscalls, the exit status is the program's\n"
+              << "(syscall 17) or 1 if it fails. --record logs what the\n"
+              << "program reads, --replay runs it again on the logged\n"
+              << "input without reading any. --virtual-time makes\n"
+              << "syscall 30 count a nanosecond per instruction.\n"
+              << "--result-cache answers a run of the same program on the\n"
+              << "same input from <dir> without running it, reading all\n"
+              << "of the input first, and reports the hit rate on stderr.\n"
+              << "--watch-address reports each change to the <bytes> (4\n"
+              << "by default) at a label or hexadecimal address and stops\n"
+              << "the program at the first.\n"
+              << "cfg writes the program's control-flow graph for\n"
+              << "Graphviz, one cluster per function.\n"
+              << "serve runs the program for every client of a Unix\n"
+              << "socket, on a few threads however many are connected.\n"
+              << "daemon keeps programs assembled between runs, submit\n"
+              << "runs one on it with stdin (or --input) as its input\n"
+              << "and exits with its status, --stats prints the daemon's\n"
+              << "cache hit rates.\n";
+
+    return 2;
+}
+
+// Modification time of a file, zero if it cannot be read.
+static timespec modified_time(const std::string & filename)
+{
+    struct stat st;
+    if (stat(filename.c_str(), &st) != 0)
+        return timespec{0, 0};
+
+    return st.st_mtim;
+}
+
+// Block until any of the files is written again.
+static void wait_for_change(const std::vector< std::string > & filenames,
+                            const std::vector< timespec > & last)
+{
+    while (true)
+    {
+        usleep(200000);
+        for (unsigned int i = 0; i < filenames.size(); ++i)
+        {
+            timespec now = modified_time(filenames[i]);
+            if (now.tv_sec != last[i].tv_sec || now.tv_nsec != last[i].tv_nsec)
+                return;
+        }
+    }
+}
+
+// run --watch-address: a label or hexadecimal address, optionally
+// followed by the number of bytes to watch.
+static void add_watchpoints(Simulator & sim, const std::vector< std::string > & specs)
+{
+    for (const std::string & spec : specs)
+    {
+        size_t colon = spec.find(':');
+        unsigned long bytes = 4;
+        if (colon != std::string::npos)
+        {
+            char * end;
+            std::string count = spec.substr(colon + 1);
+            bytes = std::strtoul(count.c_str(), &end, 10);
+            if (count.empty() || !isdigit(count[0]) || *end != '\0' || bytes == 0 || bytes > UINT32_MAX)
+                throw SimulatorError("Invalid watchpoint size in \"" + spec + "\".");
+        }
+        sim.add_watchpoint(sim.parse_address(spec.substr(0, colon)), bytes);
+    }
+
+    return;
+}
+
+// run --result-cache: the whole input is read up front, since it is
+// half of what the result is cached by.
+static int run_from_cache(Simulator & sim, const std::string & directory,
+                          const std::string & input_filename, const std::string & output_filename)
+{
+    // Streamed rather than mapped, so a pipe is read whole.
+    std::string input;
+    if (input_filename != "")
+    {
+        std::ifstream in(input_filename, std::ifstream::in | std::ifstream::binary);
+        if (!in)
+            throw SimulatorError("Unable to open input file \"" + input_filename + "\".");
+        input.assign(std::istreambuf_iterator< char >(in), std::istreambuf_iterator< char >());
+        if (in.bad())
+            throw SimulatorError("Unable to read input file \"" + input_filename + "\".");
+    }
+    else
+        input.assign(std::istreambuf_iterator< char >(std::cin), std::istreambuf_iterator< char >());
+
+    ResultCache cache(directory);
+    RunRecord record = run_with_cache(sim, input, &cache);
+    if (output_filename != "")
+    {
+        std::ofstream out(output_filename, std::ofstream::out | std::ofstream::trunc | std::ofstream::binary);
+        out.write(record.output.data(), record.output.size());
+        if (out.fail())
+            throw SimulatorError("Unable to open output file \"" + output_filename + "\".");
+    }
+    else
+        std::cout.write(record.output.data(), record.output.size());
+    std::cerr << cache.report() << std::endl;
+
+    if (record.error != "")
+    {
+        std::cout << record.error << std::endl;
+        return 1;
+    }
+
+    return record.exit_status;
+}
+
+int main(int argc, char ** argv)
 {
-    Simulator sim;
+    // Interactive menu.
+    if (argc == 1)
+    {
+        Simulator sim;
+        sim.run();
+        return 0;
+    }
+
+    try
+    {
+        if (std::strcmp(argv[1], "run") == 0)
+        {
+            std::string format = "";
+            std::vector< std::string > filenames;
+            std::string input = "";
+            std::string output = "";
+            std::string record = "";
+            std::string replay = "";
+            std::string result_cache = "";
+            std::vector< std::string > watch_addresses;
+            bool watch = false;
+            bool lazy = false;
+            bool virtual_time = false;
+            for (int i = 2; i < argc; ++i)
+            {
+                if (std::strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+                    input = argv[++i];
+                else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+                    output = argv[++i];
+                else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+                    record = argv[++i];
+                else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+                    replay = argv[++i];
+                else if (std::strcmp(argv[i], "--result-cache") == 0 && i + 1 < argc)
+                    result_cache = argv[++i];
+                else if (std::strcmp(argv[i], "--watch-address") == 0 && i + 1 < argc)
+                    watch_addresses.push_back(argv[++i]);
+                else if (std::strcmp(argv[i], "--source") == 0 || std::strcmp(argv[i], "--object") == 0
+                    || std::strcmp(argv[i], "--elf") == 0)
+                    format = argv[i];
+                else if (std::strcmp(argv[i], "--watch") == 0)
+                    watch = true;
+                else if (std::strcmp(argv[i], "--lazy") == 0)
+                    lazy = true;
+                else if (std::strcmp(argv[i], "--virtual-time") == 0)
+                    virtual_time = true;
+                else if (argv[i][0] != '-')
+                    filenames.push_back(argv[i]);
+                else
+                    return usage();
+            }
+            if (filenames.empty() || (filenames.size() > 1 && (format != "" || lazy)) || (watch && lazy)
+                || (record != "" && replay != "")
+                || (result_cache != "" && (watch || record != "" || replay != "" || !watch_addresses.empty())))
+                return usage();
+            const std::string & filename = filenames[0];
+
+            if (!watch)
+            {
+                Simulator sim;
+                sim.set_lazy_assembly(lazy);
+                sim.set_virtual_time(virtual_time);
+                if (input != "" && result_cache == "")
+                    sim.set_input(input);
+                if (output != "" && result_cache == "")
+                    sim.set_output(output);
+                if (record != "")
+                    sim.set_record(record);
+                if (replay != "")
+                    sim.set_replay(replay);
+                if (filenames.size() > 1)
+                    sim.assemble_files(filenames);
+                else if (format == "--source")
+                    sim.assemble_file(filename);
+                else if (format == "--object")
+                    sim.load_object(filename);
+                else if (format == "--elf")
+                    sim.load_elf(filename);
+                else
+                    sim.load_file(filename);
+
+                if (result_cache != "")
+                    return run_from_cache(sim, result_cache, input, output);
+                add_watchpoints(sim, watch_addresses);
+                sim.run_program();
+                return sim.exit_code();
+            }
+
+            // Every run gets a fresh simulator, the caches carry over
+            // between them.
+            std::shared_ptr< LineCache > cache = std::make_shared< LineCache >();
+            std::shared_ptr< UnitCache > unit_cache = std::make_shared< UnitCache >();
+            while (true)
+            {
+                std::vector< timespec > last;
+                for (const std::string & name : filenames)
+                    last.push_back(modified_time(name));
+                try
+                {
+                    Simulator sim;
+                    sim.set_line_cache(cache);
+                    sim.set_unit_cache(unit_cache);
+                    sim.set_virtual_time(virtual_time);
+                    if (input != "")
+                        sim.set_input(input);
+                    if (output != "")
+                        sim.set_output(output);
+                    if (record != "")
+                        sim.set_record(record);
+                    if (replay != "")
+                        sim.set_replay(replay);
+                    if (filenames.size() > 1)
+                        sim.assemble_files(filenames);
+                    else if (format == "--object" || (format == "" && is_object_file(filename)))
+                        sim.load_object(filename);
+                    else if (format == "--elf" || (format == "" && is_elf_file(filename)))
+                        sim.load_elf(filename);
+                    else
+                        sim.assemble_file(filename);
+                    add_watchpoints(sim, watch_addresses);
+                    sim.run_program();
+                }
+                catch (SimulatorError & e)
+                {
+                    std::cout << e.what() << std::endl;
+                }
+
+                std::cout << "\n--- waiting for " << (filenames.size() > 1 ? "the files" : filename)
+                          << " to change ---" << std::endl;
+                wait_for_change(filenames, last);
+            }
+        }
+
+        else if (std::strcmp(argv[1], "assemble") == 0)
+        {
+            if (argc < 5 || std::strcmp(argv[argc - 2], "-o") != 0)
+                return usage();
+
+            Simulator sim;
+            sim.assemble_files(std::vector< std::string >(argv + 2, argv + argc - 2));
+            sim.save_object(argv[argc - 1]);
+        }
+
+        else if (std::strcmp(argv[1], "serve") == 0)
+        {
+            unsigned int threads = 0;
+            std::vector< std::string > filenames;
+            for (int i = 3; i < argc; ++i)
+            {
+                if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+                    threads = std::atoi(argv[++i]);
+                else if (argv[i][0] != '-')
+                    filenames.push_back(argv[i]);
+                else
+                    return usage();
+            }
+            if (argc < 4 || filenames.empty())
+                return usage();
+
+            Simulator sim;
+            if (filenames.size() == 1)
+                sim.load_file(filenames[0]);
+            else
+                sim.assemble_files(filenames);
+            SessionServer server(argv[2], sim.program_image(), threads);
+            server.run();
+        }
+
+        else if (std::strcmp(argv[1], "daemon") == 0)
+        {
+            if (argc < 3)
+                return usage();
+            unsigned int threads = 0;
+            std::string result_cache = "";
+            for (int i = 3; i < argc; ++i)
+            {
+                if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+                    threads = std::atoi(argv[++i]);
+                else if (std::strcmp(argv[i], "--result-cache") == 0 && i + 1 < argc)
+                    result_cache = argv[++i];
+                else
+                    return usage();
+            }
+
+            Daemon daemon(argv[2], threads, result_cache);
+            daemon.run();
+        }
+
+        else if (std::strcmp(argv[1], "submit") == 0)
+        {
+            if (argc == 4 && std::strcmp(argv[3], "--stats") == 0)
+                return daemon_stats(argv[2]);
+
+            std::string input_filename = "";
+            std::vector< std::string > filenames;
+            for (int i = 3; i < argc; ++i)
+            {
+                if (std::strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+                    input_filename = argv[++i];
+                else if (argv[i][0] != '-')
+                    filenames.push_back(argv[i]);
+                else
+                    return usage();
+            }
+            if (argc < 4 || filenames.empty())
+                return usage();
+
+            return submit_to_daemon(argv[2], filenames, input_filename);
+        }
+
+        else if (std::strcmp(argv[1], "cfg") == 0)
+        {
+            int files_end = argc;
+            if (argc >= 4 && std::strcmp(argv[argc - 2], "-o") == 0)
+                files_end = argc - 2;
+            if (files_end < 3)
+                return usage();
+
+            Simulator sim;
+            if (files_end == 3)
+                sim.load_file(argv[2]);
+            else
+                sim.assemble_files(std::vector< std::string >(argv + 2, argv + files_end));
+
+            if (files_end == argc)
+                sim.control_flow().write_dot(std::cout);
+            else
+            {
+                std::ofstream out(argv[argc - 1]);
+                if (!out)
+                    throw SimulatorError("Unable to write \"" + std::string(argv[argc - 1]) + "\".");
+                sim.control_flow().write_dot(out);
+            }
+        }
+
+        else
+            return usage();
+    }
+    catch (SimulatorError & e)
+    {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
 
-    sim.run();
-    
     return 0;
 }
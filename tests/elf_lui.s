@@ -0,0 +1,28 @@
+# A compiler's address load: lui then addiu, into a register that
+# already holds something in its low half. Real lui clears it.
+# Built with:
+#   llvm-mc -triple=mips-linux-gnu -filetype=obj elf_lui.s -o elf_lui.o
+#   ld.lld -static -z max-page-size=4096 -z norelro -Ttext=0x40000 -Tdata=0x10010000 -e __start elf_lui.o -o elf_lui.elf
+    .set noreorder
+    .text
+    .globl __start
+__start:
+    addiu $2, $0, 5
+    lui $2, %hi(x)
+    addiu $2, $2, %lo(x)
+    lw $4, 0($2)
+    addiu $2, $0, 1
+    syscall
+    nop
+    addiu $2, $0, 5
+    lui $2, 0x1001
+    addiu $4, $2, 0
+    addiu $2, $0, 1
+    syscall
+    nop
+    addiu $4, $0, 0
+    addiu $2, $0, 17
+    syscall
+    nop
+    .data
+x:  .word 7
@@ -0,0 +1,12 @@
+# A bad load in a function main calls, which has to be reported at
+# its own source line.
+        .text
+        .globl main
+main:
+        li $t0, 1
+        jal helper
+        li $v0, 10
+        syscall
+helper:
+        lw $t1, 0($zero)
+        jr $ra
@@ -0,0 +1,9 @@
+# Prints the same line forever.
+        .data
+line:   .asciiz "xxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxxx\n"
+        .text
+        .globl main
+main:   la $a0, line
+        li $v0, 4
+loop:   syscall
+        j loop
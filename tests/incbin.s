@@ -0,0 +1,29 @@
+# .incbin copies a file (relative to this one) into the data segment,
+# .align moves the next label to a 2^n byte boundary.
+        .data
+first:  .byte 1
+        .align 2
+word:   .word 0x11223344
+text:   .incbin "incbin.txt"
+        .byte 0
+        .align 3
+after:  .word 99
+        .text
+        .globl main
+main:   la $a0, text
+        li $v0, 4
+        syscall
+        la $t0, word
+        andi $a0, $t0, 3
+        li $v0, 1
+        syscall
+        la $t0, after
+        andi $a0, $t0, 7
+        syscall
+        lw $a0, 0($t0)
+        syscall
+        li $a0, 10
+        li $v0, 11
+        syscall
+        li $v0, 10
+        syscall
@@ -0,0 +1,16 @@
+# Reads an integer and prints it back on a line of its own.
+        .data
+newline: .asciiz "\n"
+        .text
+        .globl main
+main:
+        li $v0, 5
+        syscall
+        move $a0, $v0
+        li $v0, 1
+        syscall
+        la $a0, newline
+        li $v0, 4
+        syscall
+        li $v0, 10
+        syscall
@@ -0,0 +1,149 @@
+#!/bin/sh
+# Regression tests: runs every program here that has a .expected file
+# and compares what it prints, then checks the other ways of loading
+# and running programs.
+#   tests/run.sh <path to mips_sim>
+sim=${1:-./mips_sim}
+dir=$(dirname "$0")
+tmp=$(mktemp -d)
+trap 'rm -rf "$tmp"' EXIT
+failed=0
+
+# check <name> <expected> <command>...: runs the command on the
+# caller's stdin and compares everything it prints with expected.
+check()
+{
+    name=$1
+    expected=$2
+    shift 2
+    if [ "$("$@" 2>&1)" = "$expected" ]; then
+        echo "ok   $name"
+    else
+        echo "FAIL $name"
+        failed=1
+    fi
+}
+
+# wait_for_socket <path>: gives a server up to five seconds to start
+# listening.
+wait_for_socket()
+{
+    tries=50
+    while [ ! -S "$1" ] && [ $tries -gt 0 ]; do
+        sleep 0.1
+        tries=$((tries - 1))
+    done
+}
+
+for expected in "$dir"/*.expected; do
+    name=${expected%.expected}
+    program=$(ls "$name".elf "$name".o "$name".s 2>/dev/null | head -n 1)
+    if "$sim" run "$program" < /dev/null | cmp -s - "$expected"; then
+        echo "ok   $(basename "$name")"
+    else
+        echo "FAIL $(basename "$name")"
+        failed=1
+    fi
+done
+
+# Object files run the same as their source, and damaged ones are
+# rejected when they are read rather than when they run.
+"$sim" assemble "$dir/read_int.s" -o "$tmp/read_int.o"
+echo 7 | check object "7
+Simulator exiting..." "$sim" run "$tmp/read_int.o"
+# The byte each instruction decodes to follows the 64-byte header and
+# the text, whose length in words is at offset 20.
+words=$(od -An -tu4 -j20 -N4 "$tmp/read_int.o" | tr -d ' ')
+cp "$tmp/read_int.o" "$tmp/bad.o"
+printf '\377' | dd of="$tmp/bad.o" bs=1 seek=$((64 + 4 * words)) conv=notrunc 2> /dev/null
+check object_bad_decoded "Invalid object file \"$tmp/bad.o\"." "$sim" run "$tmp/bad.o" < /dev/null
+head -c 40 "$tmp/read_int.o" > "$tmp/short.o"
+check object_truncated "Invalid object file \"$tmp/short.o\"." "$sim" run --object "$tmp/short.o" < /dev/null
+
+# ELF executables load whether or not --elf says so, and one cut short
+# is rejected.
+check elf_forced "$(cat "$dir/elf_lui.expected")" "$sim" run --elf "$dir/elf_lui.elf" < /dev/null
+head -c 100 "$dir/elf_lui.elf" > "$tmp/short.elf"
+check elf_truncated "Invalid ELF file \"$tmp/short.elf\"." "$sim" run "$tmp/short.elf" < /dev/null
+
+# Object files keep the source map, so errors still name the line.
+"$sim" assemble "$dir/fault_line.s" -o "$tmp/fault_line.o"
+check object_source_map "$(cat "$dir/fault_line.expected")" "$sim" run "$tmp/fault_line.o" < /dev/null
+
+# .incbin reads its file when the program is assembled, not when it is
+# loaded from an object file.
+"$sim" assemble "$dir/incbin.s" -o "$tmp/incbin.o"
+check object_incbin "$(cat "$dir/incbin.expected")" "$sim" run "$tmp/incbin.o" < /dev/null
+
+# A recorded run replays without its input, but not on a program whose
+# text or data differ.
+echo 12 | "$sim" run --record "$tmp/read_int.log" "$dir/read_int.s" > /dev/null
+check replay "12
+Simulator exiting..." "$sim" run --replay "$tmp/read_int.log" "$dir/read_int.s" < /dev/null
+sed 's/"\\n"/" "/' "$dir/read_int.s" > "$tmp/other_data.s"
+check replay_other_program "Syscall log \"$tmp/read_int.log\" was recorded from a different program." \
+    "$sim" run --replay "$tmp/read_int.log" "$tmp/other_data.s" < /dev/null
+
+# The result cache misses once, then answers the same run with the same
+# output. Input can come from a pipe. A run that writes to stderr is
+# not cached, or its stderr would be lost.
+report()
+{
+    echo "Result cache: $1 hits, $2 misses ($3% hit rate), 0 stale from another simulator build, 0 corrupt, $4 runs not cacheable."
+}
+echo 5 | check result_cache_miss "5
+$(report 0 1 0 0)" "$sim" run --result-cache "$tmp/results" "$dir/read_int.s"
+echo 5 | check result_cache_hit "5
+$(report 1 0 100 0)" "$sim" run --result-cache "$tmp/results" "$dir/read_int.s"
+echo 6 | check result_cache_input "6
+$(report 0 1 0 0)" "$sim" run --result-cache "$tmp/results" "$dir/read_int.s"
+echo 6 | check result_cache_pipe "6
+$(report 1 0 100 0)" "$sim" run --result-cache "$tmp/results" --input /dev/stdin "$dir/read_int.s"
+for run in 1 2; do
+    check result_cache_stderr_$run "to stderr
+$(report 0 1 0 1)" "$sim" run --result-cache "$tmp/results" "$dir/stderr.s" < /dev/null
+done
+
+# The session server runs the program for each client on what the
+# client sends, many clients at a time on fewer threads. Connecting to
+# its socket takes python3.
+if command -v python3 > /dev/null; then
+    client='import socket, sys
+s = socket.socket(socket.AF_UNIX)
+s.connect(sys.argv[1])
+s.sendall(sys.stdin.buffer.read())
+s.shutdown(socket.SHUT_WR)
+sys.stdout.buffer.write(b"".join(iter(lambda: s.recv(65536), b"")))'
+    "$sim" serve "$tmp/serve.sock" --threads 2 "$dir/read_int.s" > /dev/null 2>&1 &
+    server=$!
+    wait_for_socket "$tmp/serve.sock"
+    echo 8 | check session "8" python3 -c "$client" "$tmp/serve.sock"
+    clients=
+    for n in $(seq 1 20); do
+        echo $n | python3 -c "$client" "$tmp/serve.sock" > "$tmp/session_$n" &
+        clients="$clients $!"
+    done
+    wait $clients
+    check sessions_at_once "$(seq 1 20)" sh -c 'for n in $(seq 1 20); do cat "$0/session_$n"; done' "$tmp"
+    kill $server
+else
+    echo "skip session (needs python3)"
+fi
+
+# The daemon keeps programs assembled between requests, sends back
+# errors, and stops a run once it has printed too much.
+"$sim" daemon "$tmp/daemon.sock" --threads 2 > /dev/null 2>&1 &
+daemon=$!
+wait_for_socket "$tmp/daemon.sock"
+echo 3 | check daemon_run "3" "$sim" submit "$tmp/daemon.sock" "$dir/read_int.s"
+echo 4 | check daemon_run_again "4" "$sim" submit "$tmp/daemon.sock" "$dir/read_int.s"
+check daemon_error "$(cat "$dir/fault_line.expected")" "$sim" submit "$tmp/daemon.sock" "$dir/fault_line.s" < /dev/null
+check daemon_missing_file "Unable to open file \"$tmp/missing.s\"." \
+    "$sim" submit "$tmp/daemon.sock" "$tmp/missing.s" < /dev/null
+check daemon_output_limit "Output limit of 16777216 bytes reached, run stopped." \
+    sh -c '"$0" submit "$1" "$2" < /dev/null | tail -n 1 | sed "s/^x*//"' "$sim" "$tmp/daemon.sock" "$dir/flood.s"
+check daemon_stats "Program cache: 1 hits, 3 misses (25% hit rate).
+Result cache: off." "$sim" submit "$tmp/daemon.sock" --stats
+kill $daemon
+
+exit $failed
@@ -0,0 +1,13 @@
+# Writes a message to stderr (descriptor 2) with syscall 15.
+        .data
+message: .ascii "to stderr\n"
+        .text
+        .globl main
+main:
+        li $a0, 2
+        la $a1, message
+        li $a2, 10
+        li $v0, 15
+        syscall
+        li $v0, 10
+        syscall